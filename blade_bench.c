@@ -0,0 +1,1039 @@
+// blade_bench.c - Headless end-to-end scan benchmark (Windows and Linux)
+//
+//   blade_bench --gen <dir> [--depth 4] [--fanout 8] [--files 100000]
+//               [--name-min 4] [--name-max 24] [--name-dist uniform|short]
+//               [--plant needle] [--hit-rate 0.01] [--seed 1]
+//   blade_bench [--threads 16] [--batch 64] [--runs 5] [--cold]
+//               [--json out.json] [--baseline base.json] [--tolerance 10] <dir> <search_term>
+//   blade_bench --match [--names 16384] [--min-ms 10] [--seed 1] [--json out.json]
+//   blade_bench --check <dir>
+//
+// --gen writes a reproducible tree: every directory down to --depth has
+// --fanout subdirectories, and --files empty files are spread over all of
+// them with names drawn from a seeded generator. A --hit-rate fraction of the
+// names contain the --plant word, so a search for it has a known hit count.
+//
+// A run is the TUI's pipeline without a console: the work-stealing scan
+// (blade_scan.h), the compiled query (blade_query.h) on every name, a stat for
+// each match and per-worker batches committed under one shared lock. For each
+// cache state it reports entries/sec, time to the first result, matches, the
+// time workers spent waiting for the commit lock and the process's peak RSS.
+// Warm figures are the median of --runs passes after one warm-up pass; a cold
+// pass (--cold) drops the page cache first, which on Linux needs root
+// (/proc/sys/vm/drop_caches) and is reported as skipped otherwise.
+//
+// --json writes the results as one JSON object; --baseline reads such a file
+// back and exits 1 if warm entries/sec fell by more than --tolerance percent.
+//
+// --match times the name matchers on their own, in memory: the match_find
+// kernel for a literal and the compiled glob for prefix*, *suffix (what ext:
+// reduces to), *contains* and multi-star *a*b*c* patterns. Needle length, hit
+// rate and name-length distribution vary over a fixed matrix, and every case
+// runs on each SIMD level the CPU supports. It reports ns/name and bytes per
+// TSC cycle, and first checks every name against a plain reference matcher;
+// any disagreement makes the exit status 1.
+//
+// --check runs consistency checks against a tree and exits 1 if any fails:
+// with maxdepth set, the subdirectories flagged descend (the ones --ordered
+// reserves output slots for) are exactly the ones scanned; and a persistent
+// index (blade_index.h) built, reopened and refreshed after scratch files are
+// created and deleted lists exactly what a fresh walk finds. The scratch files
+// are removed again and the index is written next to the tree as <dir>.check.idx.
+
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+#include "blade_scan.h"
+#include "blade_index.h"
+#include "blade_query.h"
+#include "blade_match.h"
+
+// ==========================================
+// CONFIGURATION
+// ==========================================
+#define BENCH_MAX_RUNS 64
+#define BENCH_BATCH_MAX 4096
+#define BENCH_PATH_MAX 4096
+
+static const char *const bench_exts[] = { ".c", ".h", ".txt", ".log", ".png", ".jpg", ".json", ".md", ".dll", ".exe", ".zip", ".pdf" };
+
+// ==========================================
+// CLOCK & MEMORY
+// ==========================================
+static uint64_t bench_now_ns(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER t;
+    if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&t);
+    return (uint64_t)((double)t.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// Peak resident set of the process so far, in KB
+static uint64_t bench_peak_rss_kb(void) {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+    return (uint64_t)pmc.PeakWorkingSetSize / 1024;
+#else
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+    return (uint64_t)ru.ru_maxrss;
+#endif
+}
+
+static void bench_sleep_ms(int ms) {
+#ifdef _WIN32
+    Sleep((DWORD)ms);
+#else
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000 };
+    nanosleep(&ts, NULL);
+#endif
+}
+
+// Empties the page cache so the next pass reads from the disk. 0 if not permitted.
+static int bench_drop_caches(void) {
+#ifdef _WIN32
+    return 0;
+#else
+    sync();
+    FILE *f = fopen("/proc/sys/vm/drop_caches", "w");
+    if (!f) return 0;
+    int ok = fputs("3\n", f) >= 0;
+    return fclose(f) == 0 && ok;
+#endif
+}
+
+// ==========================================
+// TREE GENERATOR
+// ==========================================
+typedef struct {
+    int depth;
+    int fanout;
+    long files;
+    int name_min;
+    int name_max;
+    int name_short;     // short names more likely than long ones
+    const char *plant;
+    double hit_rate;
+    uint64_t seed;
+} GenOptions;
+
+typedef struct {
+    uint64_t state;
+    long dirs;
+    long files_left;
+    long dirs_left;
+    long files_made;
+    long hits;
+} GenState;
+
+static uint64_t gen_next(GenState *g) {
+    uint64_t z = (g->state += 0x9e3779b97f4a7c15ULL);   // splitmix64
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static double gen_unit(GenState *g) {
+    return (double)(gen_next(g) >> 11) / 9007199254740992.0;
+}
+
+static int gen_mkdir(const char *path) {
+#ifdef _WIN32
+    return CreateDirectoryA(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+// A name of the configured length, the plant word spliced in for a hit
+static size_t gen_name(GenState *g, const GenOptions *o, int file, char *out) {
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789_-";
+    double u = gen_unit(g);
+    if (o->name_short) u *= u;
+    int len = o->name_min + (int)(u * (o->name_max - o->name_min + 1));
+    if (len > o->name_max) len = o->name_max;
+    for (int i = 0; i < len; i++) out[i] = alphabet[gen_next(g) % (sizeof(alphabet) - 1)];
+    if (file && o->plant && gen_unit(g) < o->hit_rate) {
+        size_t pl = strlen(o->plant);
+        size_t at = len > (int)pl ? (size_t)(gen_next(g) % (len - pl + 1)) : 0;
+        if (at + pl > (size_t)len) len = (int)(at + pl);
+        memcpy(out + at, o->plant, pl);
+        g->hits++;
+    }
+    size_t n = (size_t)len;
+    if (file) {
+        const char *ext = bench_exts[gen_next(g) % (sizeof(bench_exts) / sizeof(bench_exts[0]))];
+        memcpy(out + n, ext, strlen(ext));
+        n += strlen(ext);
+    }
+    out[n] = '\0';
+    return n;
+}
+
+// Each directory takes an equal share of the files still to place
+static int gen_dir(GenState *g, const GenOptions *o, char *path, size_t len, int depth) {
+    long share = g->dirs_left > 0 ? g->files_left / g->dirs_left : g->files_left;
+    g->dirs_left--;
+    char name[BENCH_PATH_MAX];
+    for (long i = 0; i < share; i++) {
+        size_t n = gen_name(g, o, 1, name);
+        if (len + 1 + n + 1 > BENCH_PATH_MAX) return 0;
+        path[len] = SCAN_SEP;
+        memcpy(path + len + 1, name, n + 1);
+        FILE *f = fopen(path, "wb");
+        if (f) { fclose(f); g->files_made++; }
+        g->files_left--;
+    }
+    if (depth >= o->depth) return 1;
+    for (int i = 0; i < o->fanout; i++) {
+        gen_name(g, o, 0, name);
+        int w = snprintf(path + len, BENCH_PATH_MAX - len, "%c%s%d", SCAN_SEP, name, i);   // index keeps siblings distinct
+        if (w < 0 || len + w >= BENCH_PATH_MAX || !gen_mkdir(path)) return 0;
+        g->dirs++;
+        if (!gen_dir(g, o, path, len + w, depth + 1)) return 0;
+    }
+    path[len] = '\0';
+    return 1;
+}
+
+static int run_generate(const char *root, const GenOptions *o) {
+    GenState g;
+    memset(&g, 0, sizeof(g));
+    g.state = o->seed;
+    g.files_left = o->files;
+    long dirs = 1, level = 1;
+    for (int d = 0; d < o->depth; d++) { level *= o->fanout; dirs += level; }
+    g.dirs_left = dirs;
+
+    char path[BENCH_PATH_MAX];
+    snprintf(path, sizeof(path), "%s", root);
+    if (!gen_mkdir(path) || !gen_dir(&g, o, path, strlen(path), 0)) {
+        fprintf(stderr, "Could not create the tree under %s\n", root);
+        return 1;
+    }
+    printf("Generated %s: %ld directories, %ld files, %ld with \"%s\" (seed %llu)\n", root, g.dirs + 1,
+           g.files_made, g.hits, o->plant ? o->plant : "", (unsigned long long)o->seed);
+    return 0;
+}
+
+// ==========================================
+// PIPELINE
+// ==========================================
+typedef struct {
+    int threads;
+    int batch;
+    int runs;
+    int cold;
+} RunOptions;
+
+typedef struct {
+    Query query;
+    int batch;
+    uint64_t start_ns;
+    uint64_t first_ns;              // 0 until the first match is committed
+    scan_lock_t commit_lock;        // the results store's lock
+    uint64_t lock_wait_ns;          // summed over workers, under commit_lock
+    uint64_t matches;
+    uint64_t bytes;                 // names committed, standing in for the store's copy
+} Pipeline;
+
+typedef struct {
+    int count;
+    uint64_t lock_wait_ns;
+    uint16_t lens[BENCH_BATCH_MAX];
+} PipelineBatch;
+
+typedef struct {
+    int ran;
+    double seconds;
+    uint64_t dirs;
+    uint64_t entries;
+    uint64_t matches;
+    double first_ms;
+    double lock_wait_ms;
+    uint64_t peak_rss_kb;
+} RunResult;
+
+static void pipe_flush(Pipeline *p, PipelineBatch *b) {
+    if (b->count == 0) return;
+    uint64_t t0 = bench_now_ns();
+    scan_lock(&p->commit_lock);
+    uint64_t t1 = bench_now_ns();
+    b->lock_wait_ns += t1 - t0;
+    if (!p->first_ns) p->first_ns = t1;
+    p->matches += (uint64_t)b->count;
+    for (int i = 0; i < b->count; i++) p->bytes += b->lens[i];
+    scan_unlock(&p->commit_lock);
+    b->count = 0;
+}
+
+static void pipe_start(ScanWorker *w) {
+    w->local = calloc(1, sizeof(PipelineBatch));
+}
+
+static int pipe_entry(ScanWorker *w, const ScanJob *dir, ScanEntry *e) {
+    (void)dir;
+    Pipeline *p = (Pipeline*)w->ctx->user;
+    PipelineBatch *b = (PipelineBatch*)w->local;
+    if (!b || !query_match(&p->query, e->name, e->name_len)) return SCAN_CONTINUE;
+    scan_entry_stat(e);
+    b->lens[b->count++] = (uint16_t)e->name_len;
+    if (b->count >= p->batch) pipe_flush(p, b);
+    return SCAN_CONTINUE;
+}
+
+static void pipe_idle(ScanWorker *w) {
+    if (w->local) pipe_flush((Pipeline*)w->ctx->user, (PipelineBatch*)w->local);
+}
+
+static void pipe_stop(ScanWorker *w) {
+    Pipeline *p = (Pipeline*)w->ctx->user;
+    PipelineBatch *b = (PipelineBatch*)w->local;
+    if (!b) return;
+    pipe_flush(p, b);
+    scan_lock(&p->commit_lock);
+    p->lock_wait_ns += b->lock_wait_ns;
+    scan_unlock(&p->commit_lock);
+    free(b);
+    w->local = NULL;
+}
+
+static int pipe_run(Pipeline *p, const char *root, int threads, RunResult *r) {
+    p->first_ns = 0;
+    p->lock_wait_ns = 0;
+    p->matches = 0;
+    p->bytes = 0;
+    ScanCtx *ctx = scan_create(threads, p);
+    if (!ctx) return 0;
+    ctx->on_start = pipe_start;
+    ctx->on_entry = pipe_entry;
+    ctx->on_idle = pipe_idle;
+    ctx->on_stop = pipe_stop;
+    scan_add_root(ctx, root);
+    p->start_ns = bench_now_ns();
+    scan_start(ctx);
+    scan_wait(ctx);
+    uint64_t end = bench_now_ns();
+
+    memset(r, 0, sizeof(*r));
+    r->ran = 1;
+    for (int i = 0; i < ctx->worker_count; i++) {
+        r->dirs += ctx->workers[i].dirs_scanned;
+        r->entries += ctx->workers[i].entries_seen;
+    }
+    scan_release(ctx);
+    r->seconds = (double)(end - p->start_ns) / 1e9;
+    r->matches = p->matches;
+    r->first_ms = p->first_ns ? (double)(p->first_ns - p->start_ns) / 1e6 : -1.0;
+    r->lock_wait_ms = (double)p->lock_wait_ns / 1e6;
+    r->peak_rss_kb = bench_peak_rss_kb();
+    return 1;
+}
+
+static int run_cmp(const void *a, const void *b) {
+    double x = ((const RunResult*)a)->seconds, y = ((const RunResult*)b)->seconds;
+    return (x > y) - (x < y);
+}
+
+// ==========================================
+// REPORTING
+// ==========================================
+static double run_rate(const RunResult *r) {
+    return r->seconds > 0 ? (double)r->entries / r->seconds : 0.0;
+}
+
+static void print_run(const char *cache, const RunResult *r) {
+    if (!r->ran) { printf("%-6s %s\n", cache, "skipped (dropping the page cache needs root)"); return; }
+    printf("%-6s %10.3f %12llu %12llu %14.0f %10llu %12.3f %12.3f %12llu\n", cache, r->seconds,
+           (unsigned long long)r->dirs, (unsigned long long)r->entries, run_rate(r), (unsigned long long)r->matches,
+           r->first_ms, r->lock_wait_ms, (unsigned long long)r->peak_rss_kb);
+}
+
+static void json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fprintf(f, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20) fprintf(f, "\\u%04x", *s);
+        else fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static void json_run(FILE *f, const char *key, const RunResult *r) {
+    fprintf(f, "  \"%s\": ", key);
+    if (!r->ran) { fprintf(f, "null"); return; }
+    fprintf(f, "{\"seconds\": %.6f, \"dirs\": %llu, \"entries\": %llu, \"entries_per_sec\": %.1f, \"matches\": %llu, "
+               "\"first_result_ms\": %.3f, \"lock_wait_ms\": %.3f, \"peak_rss_kb\": %llu}",
+            r->seconds, (unsigned long long)r->dirs, (unsigned long long)r->entries, run_rate(r),
+            (unsigned long long)r->matches, r->first_ms, r->lock_wait_ms, (unsigned long long)r->peak_rss_kb);
+}
+
+static int write_json(const char *file, const char *root, const char *term, const RunOptions *o, const RunResult *cold, const RunResult *warm) {
+    FILE *f = fopen(file, "w");
+    if (!f) return 0;
+    fprintf(f, "{\n  \"simd\": \"%s\",\n  \"root\": ", match_level_names[match_active]);
+    json_string(f, root);
+    fprintf(f, ",\n  \"term\": ");
+    json_string(f, term);
+    fprintf(f, ",\n  \"threads\": %d,\n  \"batch\": %d,\n  \"runs\": %d,\n", o->threads, o->batch, o->runs);
+    json_run(f, "cold", cold);
+    fprintf(f, ",\n");
+    json_run(f, "warm", warm);
+    fprintf(f, "\n}\n");
+    return fclose(f) == 0;
+}
+
+// Number following "key": inside the object that follows "section":, as written by write_json
+static int json_number(const char *text, const char *section, const char *key, double *out) {
+    char pat[64];
+    snprintf(pat, sizeof(pat), "\"%s\":", section);
+    const char *s = strstr(text, pat);
+    if (!s) return 0;
+    const char *end = strchr(s, '}');
+    snprintf(pat, sizeof(pat), "\"%s\":", key);
+    const char *k = strstr(s, pat);
+    if (!k || !end || k > end) return 0;
+    *out = strtod(k + strlen(pat), NULL);
+    return 1;
+}
+
+// Prints the warm figures against the baseline's; 1 if entries/sec regressed past tolerance
+static int compare_baseline(const char *file, const RunResult *warm, double tolerance) {
+    FILE *f = fopen(file, "rb");
+    if (!f) { fprintf(stderr, "Cannot read baseline %s\n", file); return 1; }
+    static char text[65536];
+    size_t n = fread(text, 1, sizeof(text) - 1, f);
+    fclose(f);
+    text[n] = '\0';
+
+    double rate, first, wait, entries;
+    if (!warm->ran || !json_number(text, "warm", "entries_per_sec", &rate) || !json_number(text, "warm", "first_result_ms", &first) ||
+        !json_number(text, "warm", "lock_wait_ms", &wait) || !json_number(text, "warm", "entries", &entries)) {
+        fprintf(stderr, "Baseline %s has no warm results\n", file);
+        return 1;
+    }
+    if ((uint64_t)entries != warm->entries) printf("note: the baseline saw %.0f entries, this run %llu\n", entries, (unsigned long long)warm->entries);
+    double change = rate > 0 ? (run_rate(warm) - rate) * 100.0 / rate : 0.0;
+    printf("vs baseline: entries/sec %.0f -> %.0f (%+.1f%%), first result %.3f -> %.3f ms, lock wait %.3f -> %.3f ms\n",
+           rate, run_rate(warm), change, first, warm->first_ms, wait, warm->lock_wait_ms);
+    if (change < -tolerance) {
+        printf("REGRESSION: entries/sec fell more than %.1f%%\n", tolerance);
+        return 1;
+    }
+    return 0;
+}
+
+// ==========================================
+// MATCHER MICROBENCHMARK
+// ==========================================
+#define MB_LITERAL  0   // match_find kernel on its own (the TUI's and GUI's plain term)
+#define MB_PREFIX   1   // lit*
+#define MB_SUFFIX   2   // *lit, the shape ext: and *.ext reduce to
+#define MB_CONTAINS 3   // *lit*
+#define MB_MULTI    4   // *a*b*c*, the Shift-And NFA
+#define MB_SHAPES   5
+#define MB_LEVELS   (MATCH_AVX512 + 1)
+
+static const char *const mb_shape_names[MB_SHAPES] = { "literal", "prefix", "suffix", "contains", "multi" };
+static const int mb_needle_lens[] = { 2, 4, 8, 16, 32 };
+static const double mb_hit_rates[] = { 0.0, 0.01, 0.5 };
+static const struct { const char *name; int min, max, skew; } mb_dists[] = {
+    { "short", 4, 16, 0 }, { "mixed", 4, 128, 1 }, { "long", 100, 255, 0 },
+};
+
+typedef struct {
+    int shape;
+    const char *needle;     // the literal the pattern is built from
+    size_t needle_len;
+    char pattern[MATCH_NEEDLE_MAX + 8];
+    MatchNeedle lit;
+    GlobProgram glob;
+    char *text;             // names back to back, NUL separated
+    uint32_t *offs;
+    uint16_t *lens;
+    long count;
+    uint64_t bytes;
+} MbCase;
+
+typedef struct {
+    double ns_per_name;
+    double bytes_per_cycle;     // -1 where there is no cycle counter
+    long matches;
+} MbResult;
+
+static uint64_t mb_cycles(void) {
+#ifdef MATCH_X86
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Plain backtracking '*' matcher, the definition the compiled globs must agree with
+static int mb_reference_glob(const char *p, const char *s, size_t len) {
+    const char *star = NULL;
+    size_t i = 0, mark = 0;
+    while (i < len) {
+        if (*p == '*') { star = ++p; mark = i; }
+        else if (*p && match_fold[(uint8_t)*p] == match_fold[(uint8_t)s[i]]) { p++; i++; }
+        else if (star) { p = star; i = ++mark; }
+        else return 0;
+    }
+    while (*p == '*') p++;
+    return *p == '\0';
+}
+
+static int mb_reference(const MbCase *c, const char *s, size_t len) {
+    if (c->shape == MB_LITERAL) return match_reference(c->needle, s, len) != 0;
+    return mb_reference_glob(c->pattern, s, len);
+}
+
+// Multi splits the literal at a and b into up to three starred pieces
+static void mb_cuts(size_t nl, size_t *a, size_t *b) {
+    *a = nl / 3 ? nl / 3 : 1;
+    *b = 2 * nl / 3 > *a ? 2 * nl / 3 : *a + 1;
+}
+
+static void mb_pattern(MbCase *c) {
+    const char *n = c->needle;
+    size_t nl = c->needle_len, a, b;
+    mb_cuts(nl, &a, &b);
+    switch (c->shape) {
+        case MB_LITERAL: snprintf(c->pattern, sizeof(c->pattern), "%s", n); break;
+        case MB_PREFIX: snprintf(c->pattern, sizeof(c->pattern), "%s*", n); break;
+        case MB_SUFFIX: snprintf(c->pattern, sizeof(c->pattern), "*%s", n); break;
+        case MB_CONTAINS: snprintf(c->pattern, sizeof(c->pattern), "*%s*", n); break;
+        default:
+            if (b == nl) snprintf(c->pattern, sizeof(c->pattern), "*%.*s*%s*", (int)a, n, n + a);
+            else snprintf(c->pattern, sizeof(c->pattern), "*%.*s*%.*s*%s*", (int)a, n, (int)(b - a), n + a, n + b);
+    }
+}
+
+// Writes count names of the distribution; a hit_rate share get the needle
+// planted (in mixed case) where the shape needs it
+static int mb_names(MbCase *c, GenState *g, int dist, double hit_rate, long count) {
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789._- ";
+    c->count = count;
+    c->bytes = 0;
+    c->text = (char*)malloc((size_t)count * 256);
+    c->offs = (uint32_t*)malloc((size_t)count * sizeof(uint32_t));
+    c->lens = (uint16_t*)malloc((size_t)count * sizeof(uint16_t));
+    if (!c->text || !c->offs || !c->lens) return 0;
+    uint32_t at = 0;
+    for (long i = 0; i < count; i++) {
+        double u = gen_unit(g);
+        if (mb_dists[dist].skew) u *= u;
+        int span = mb_dists[dist].max - mb_dists[dist].min + 1;
+        size_t len = (size_t)(mb_dists[dist].min + (int)(u * span));
+        if (len > (size_t)mb_dists[dist].max) len = (size_t)mb_dists[dist].max;
+        char *s = c->text + at;
+        for (size_t k = 0; k < len; k++) s[k] = alphabet[gen_next(g) % (sizeof(alphabet) - 1)];
+        if (gen_unit(g) < hit_rate) {
+            size_t nl = c->needle_len;
+            if (len < nl + 2) len = nl + 2;
+            if (len > 255) len = 255;
+            if (c->shape == MB_MULTI) {
+                // Pieces in order with gaps between them
+                size_t a, b;
+                mb_cuts(nl, &a, &b);
+                size_t room = len - nl, g1 = room ? (size_t)(gen_next(g) % (room + 1)) : 0, g2 = room - g1 ? (size_t)(gen_next(g) % (room - g1 + 1)) : 0;
+                memcpy(s + g1, c->needle, a);
+                memcpy(s + g1 + a + g2, c->needle + a, b - a);
+                memcpy(s + len - (nl - b), c->needle + b, nl - b);
+            } else {
+                size_t pos = c->shape == MB_PREFIX ? 0 : c->shape == MB_SUFFIX ? len - nl : (size_t)(gen_next(g) % (len - nl + 1));
+                memcpy(s + pos, c->needle, nl);
+            }
+            for (size_t k = 0; k < len; k++) {
+                if ((gen_next(g) & 3) == 0 && s[k] >= 'a' && s[k] <= 'z') s[k] -= 32;
+            }
+        }
+        s[len] = '\0';
+        c->offs[i] = at;
+        c->lens[i] = (uint16_t)len;
+        c->bytes += len;
+        at += (uint32_t)len + 1;
+    }
+    return 1;
+}
+
+static void mb_free(MbCase *c) {
+    free(c->text);
+    free(c->offs);
+    free(c->lens);
+}
+
+static long mb_pass(const MbCase *c, match_fn fn) {
+    long hits = 0;
+    if (c->shape == MB_LITERAL) {
+        for (long i = 0; i < c->count; i++) hits += fn(&c->lit, c->text + c->offs[i], c->lens[i]) != 0;
+    } else {
+        for (long i = 0; i < c->count; i++) hits += glob_match(&c->glob, c->text + c->offs[i], c->lens[i]);
+    }
+    return hits;
+}
+
+// Every name through the level's matcher against the reference; returns disagreements
+static long mb_check(const MbCase *c, int level, FILE *out) {
+    match_fn fn = match_kernel(level);
+    long bad = 0;
+    for (long i = 0; i < c->count; i++) {
+        const char *s = c->text + c->offs[i];
+        int got = c->shape == MB_LITERAL ? fn(&c->lit, s, c->lens[i]) != 0 : glob_match(&c->glob, s, c->lens[i]);
+        if (got != mb_reference(c, s, c->lens[i])) {
+            if (out && bad < 5) fprintf(out, "%s %s \"%s\" on \"%s\": got %d\n", match_level_names[level], mb_shape_names[c->shape], c->pattern, s, got);
+            bad++;
+        }
+    }
+    return bad;
+}
+
+// Repeats passes until min_ms has elapsed
+static void mb_time(const MbCase *c, int level, int min_ms, MbResult *r) {
+    match_fn fn = match_kernel(level);
+    volatile long sink = mb_pass(c, fn);     // warm-up
+    long passes = 0;
+    uint64_t t0 = bench_now_ns(), c0 = mb_cycles(), t1;
+    do {
+        sink += mb_pass(c, fn);
+        passes++;
+        t1 = bench_now_ns();
+    } while (t1 - t0 < (uint64_t)min_ms * 1000000);
+    uint64_t cycles = mb_cycles() - c0;
+    r->matches = mb_pass(c, fn);
+    r->ns_per_name = (double)(t1 - t0) / ((double)passes * (double)c->count);
+    r->bytes_per_cycle = cycles ? (double)c->bytes * (double)passes / (double)cycles : -1.0;
+    (void)sink;
+}
+
+static int run_match_bench(long names, int min_ms, uint64_t seed, const char *json_file) {
+    static const char needle_chars[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+    int restore = match_active;
+    int levels = match_cpu + 1;
+    FILE *json = NULL;
+    if (json_file && !(json = fopen(json_file, "w"))) { fprintf(stderr, "Cannot write %s\n", json_file); return 1; }
+    if (json) fprintf(json, "{\n  \"cpu\": \"%s\",\n  \"names\": %ld,\n  \"cases\": [", match_level_names[match_cpu], names);
+
+    printf("Matcher benchmark: %ld names per case, %d ms per timing, levels up to %s; ns/name (bytes/cycle)\n", names, min_ms, match_level_names[match_cpu]);
+    printf("%-8s %4s %5s %-6s %8s", "shape", "len", "hit", "names", "matches");
+    for (int l = 0; l < levels; l++) printf(" %18s", match_level_names[l]);
+    printf("\n");
+
+    GenState g;
+    memset(&g, 0, sizeof(g));
+    g.state = seed;
+    long failures = 0;
+    int first = 1;
+    for (int shape = 0; shape < MB_SHAPES; shape++) {
+        for (size_t li = 0; li < sizeof(mb_needle_lens) / sizeof(mb_needle_lens[0]); li++) {
+            char needle[64];
+            int nl = mb_needle_lens[li];
+            for (int k = 0; k < nl; k++) needle[k] = needle_chars[gen_next(&g) % (sizeof(needle_chars) - 1)];
+            needle[nl] = '\0';
+            for (size_t hi = 0; hi < sizeof(mb_hit_rates) / sizeof(mb_hit_rates[0]); hi++) {
+                for (int dist = 0; dist < (int)(sizeof(mb_dists) / sizeof(mb_dists[0])); dist++) {
+                    MbCase *c = (MbCase*)calloc(1, sizeof(MbCase));
+                    if (!c) return 1;
+                    c->shape = shape;
+                    c->needle = needle;
+                    c->needle_len = (size_t)nl;
+                    mb_pattern(c);
+                    match_needle(&c->lit, needle, (size_t)nl);
+                    if (!glob_compile(&c->glob, c->pattern, strlen(c->pattern)) || !mb_names(c, &g, dist, mb_hit_rates[hi], names)) {
+                        fprintf(stderr, "Cannot set up %s \"%s\"\n", mb_shape_names[shape], c->pattern);
+                        mb_free(c);
+                        free(c);
+                        return 1;
+                    }
+
+                    MbResult r[MB_LEVELS] = {{0}};
+                    for (int l = 0; l < levels; l++) {
+                        match_select(l);    // glob_match follows match_find and match_active
+                        failures += mb_check(c, l, stderr);
+                        mb_time(c, l, min_ms, &r[l]);
+                    }
+                    printf("%-8s %4d %4.0f%% %-6s %8ld", mb_shape_names[shape], nl, mb_hit_rates[hi] * 100, mb_dists[dist].name, r[0].matches);
+                    for (int l = 0; l < levels; l++) printf(" %9.2f (%6.2f)", r[l].ns_per_name, r[l].bytes_per_cycle);
+                    printf("\n");
+
+                    if (json) {
+                        fprintf(json, "%s\n    {\"shape\": \"%s\", \"pattern\": ", first ? "" : ",", mb_shape_names[shape]);
+                        json_string(json, c->pattern);
+                        fprintf(json, ", \"needle_len\": %d, \"hit_rate\": %.2f, \"names\": \"%s\", \"bytes\": %llu, \"matches\": %ld, \"levels\": {",
+                                nl, mb_hit_rates[hi], mb_dists[dist].name, (unsigned long long)c->bytes, r[0].matches);
+                        for (int l = 0; l < levels; l++) {
+                            fprintf(json, "%s\"%s\": {\"ns_per_name\": %.3f, \"bytes_per_cycle\": %.3f}", l ? ", " : "",
+                                    match_level_names[l], r[l].ns_per_name, r[l].bytes_per_cycle);
+                        }
+                        fprintf(json, "}}");
+                        first = 0;
+                    }
+                    mb_free(c);
+                    free(c);
+                }
+            }
+        }
+    }
+    match_select(restore);
+    if (json) {
+        fprintf(json, "\n  ],\n  \"failures\": %ld\n}\n", failures);
+        fclose(json);
+    }
+    printf("Differential check against the reference: %s (%ld disagreements)\n", failures ? "FAILED" : "ok", failures);
+    return failures ? 1 : 0;
+}
+
+// ==========================================
+// CHECKS
+// ==========================================
+// Invariants of the engine that callers build on, run against any tree (a --gen
+// tree works). Each prints one line; the return value is the number of failures.
+
+#define CHECK_MAX_DEPTH 64
+
+typedef struct {
+    long depth_jobs[CHECK_MAX_DEPTH];   // jobs seen per depth
+    long reserved;                      // children flagged descend
+    long done;                          // flagged children whose job finished
+} DepthCheck;
+
+static int check_depth_entry(ScanWorker *w, const ScanJob *dir, ScanEntry *e) {
+    (void)dir;
+    // --ordered reserves an output slot for exactly these; each must get a job
+    if (e->descend) {
+        e->tag = 1;
+        scan_inc(&((DepthCheck*)w->ctx->user)->reserved);
+    }
+    return SCAN_CONTINUE;
+}
+
+static void check_depth_done(ScanWorker *w, const ScanJob *dir) {
+    DepthCheck *c = (DepthCheck*)w->ctx->user;
+    if (dir->tag) scan_inc(&c->done);
+    if (dir->depth < CHECK_MAX_DEPTH) scan_inc(&c->depth_jobs[dir->depth]);
+}
+
+static int check_depth_scan(const char *root, uint32_t max_depth, DepthCheck *c) {
+    memset(c, 0, sizeof(*c));
+    ScanCtx *ctx = scan_create(4, c);
+    if (!ctx) return 0;
+    Prune p;
+    prune_init(&p);
+    p.max_depth = max_depth;
+    if (!scan_set_prune(ctx, &p)) { scan_release(ctx); return 0; }
+    ctx->on_entry = check_depth_entry;
+    ctx->on_dir_done = check_depth_done;
+    scan_add_root(ctx, root);
+    scan_start(ctx);
+    scan_wait(ctx);
+    scan_release(ctx);
+    return 1;
+}
+
+// With maxdepth set, every subdirectory flagged descend is scanned and no other is
+static int check_maxdepth(const char *root) {
+    static DepthCheck full, cut;
+    int failures = 0;
+    if (!check_depth_scan(root, 0, &full)) return 1;
+    for (uint32_t d = 1; d <= 4; d++) {
+        if (!check_depth_scan(root, d, &cut)) return failures + 1;
+        long want = 0;
+        for (uint32_t k = 0; k < d && k < CHECK_MAX_DEPTH; k++) want += full.depth_jobs[k];
+        long got = 0;
+        for (int k = 0; k < CHECK_MAX_DEPTH; k++) got += cut.depth_jobs[k];
+        int ok = cut.reserved == cut.done && got == want;
+        printf("maxdepth %u: %-6s %ld directories (want %ld), %ld flagged descend, %ld finished\n",
+               d, ok ? "ok" : "FAILED", got, want, cut.reserved, cut.done);
+        failures += !ok;
+    }
+    return failures;
+}
+
+// Every path under the root as "path|d|size" lines, sorted, for comparing
+// an index against a walk
+typedef struct {
+    scan_lock_t lock;
+    char **items;
+    long count;
+    long cap;
+    int ok;
+} PathList;
+
+static void path_list_add(PathList *l, const char *path, size_t len, int is_dir, uint64_t size) {
+    char *s = (char*)malloc(len + 32);
+    if (!s) { l->ok = 0; return; }
+    snprintf(s, len + 32, "%.*s|%c|%llu", (int)len, path, is_dir ? 'd' : 'f', (unsigned long long)(is_dir ? 0 : size));
+    if (l->count == l->cap) {
+        long cap = l->cap ? l->cap * 2 : 1024;
+        char **items = (char**)realloc(l->items, (size_t)cap * sizeof(char*));
+        if (!items) { free(s); l->ok = 0; return; }
+        l->items = items;
+        l->cap = cap;
+    }
+    l->items[l->count++] = s;
+}
+
+static void path_list_free(PathList *l) {
+    for (long i = 0; i < l->count; i++) free(l->items[i]);
+    free(l->items);
+    memset(l, 0, sizeof(*l));
+}
+
+static int path_list_cmp(const void *a, const void *b) {
+    return strcmp(*(char *const*)a, *(char *const*)b);
+}
+
+static int walk_entry(ScanWorker *w, const ScanJob *dir, ScanEntry *e) {
+    PathList *l = (PathList*)w->ctx->user;
+    char path[SCAN_PATH_MAX + 256];
+    int need_sep = dir->len > 0 && dir->path[dir->len - 1] != '\\' && dir->path[dir->len - 1] != '/';
+    int n = snprintf(path, sizeof(path), "%s%s%.*s", dir->path, need_sep ? (SCAN_SEP == '/' ? "/" : "\\") : "", (int)e->name_len, e->name);
+    uint64_t size = !e->is_dir && scan_entry_stat(e) ? e->size : 0;
+    scan_lock(&l->lock);
+    path_list_add(l, path, (size_t)n, e->is_dir, size);
+    scan_unlock(&l->lock);
+    return SCAN_CONTINUE;
+}
+
+static int walk_paths(const char *root, PathList *l) {
+    memset(l, 0, sizeof(*l));
+    l->ok = 1;
+    ScanCtx *ctx = scan_create(4, l);
+    if (!ctx) return 0;
+    scan_lock_init(&l->lock);
+    ctx->on_entry = walk_entry;
+    scan_add_root(ctx, root);
+    scan_start(ctx);
+    scan_wait(ctx);
+    scan_release(ctx);
+    scan_lock_free(&l->lock);
+    qsort(l->items, (size_t)l->count, sizeof(char*), path_list_cmp);
+    return l->ok;
+}
+
+static int index_paths(const BladeIndex *ix, PathList *l) {
+    memset(l, 0, sizeof(*l));
+    l->ok = 1;
+    char path[SCAN_PATH_MAX];
+    for (uint32_t e = 0; e < ix->hdr->entry_count; e++) {
+        size_t n = index_entry_path(ix, e, path, sizeof(path));
+        if (!n) { l->ok = 0; break; }
+        const IndexEntry *ie = &ix->entries[e];
+        path_list_add(l, path, n, (ie->flags & INDEX_F_DIR) != 0, ie->size);
+    }
+    qsort(l->items, (size_t)l->count, sizeof(char*), path_list_cmp);
+    return l->ok;
+}
+
+// Compares the open index with a fresh walk; prints the first difference
+static int check_index_matches(const char *step, const BladeIndex *ix, const char *root, long changed, int want_changed) {
+    PathList a, b;
+    int ok = index_paths(ix, &a) && walk_paths(root, &b);
+    long i = 0, j = 0;
+    while (ok && (i < a.count || j < b.count)) {
+        int c = i == a.count ? 1 : j == b.count ? -1 : strcmp(a.items[i], b.items[j]);
+        if (c == 0) { i++; j++; continue; }
+        printf("  %s %s\n", c < 0 ? "only in the index:" : "only on disk:   ", c < 0 ? a.items[i] : b.items[j]);
+        ok = 0;
+    }
+    if (want_changed >= 0 && (changed > 0) != want_changed) ok = 0;
+    printf("index %-8s %-6s %ld entries, %ld on disk", step, ok ? "ok" : "FAILED", a.count, b.count);
+    if (want_changed >= 0) printf(", %ld directories re-enumerated", changed);
+    printf("\n");
+    path_list_free(&a);
+    path_list_free(&b);
+    return ok;
+}
+
+static int check_write(const char *path, const char *text) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return 0;
+    fputs(text, f);
+    return fclose(f) == 0;
+}
+
+static int check_rmdir(const char *path) {
+#ifdef _WIN32
+    return RemoveDirectoryA(path) != 0;
+#else
+    return rmdir(path) == 0;
+#endif
+}
+
+// Builds an index of the tree, reopens it, then refreshes it after adding
+// scratch files and folders and again after removing them. Each state must
+// list exactly what a fresh walk sees. The tree is left as it was found.
+static int check_index(const char *root) {
+    char file[SCAN_PATH_MAX], deep[SCAN_PATH_MAX];
+    char a[SCAN_PATH_MAX + 32], d[SCAN_PATH_MAX + 32], f[SCAN_PATH_MAX + 32];
+    char b[SCAN_PATH_MAX + 64], c[SCAN_PATH_MAX + 64], e[SCAN_PATH_MAX + 96];
+    snprintf(file, sizeof(file), "%s.check.idx", root);
+    int failures = 0;
+    BladeIndex ix;
+
+    if (!index_build(root, file, 4) || !index_open(&ix, file)) { printf("index build  FAILED: cannot write or reopen %s\n", file); return 1; }
+    failures += !check_index_matches("build", &ix, root, -1, -1);
+    long changed = index_refresh(&ix, file, 4);
+    failures += !check_index_matches("no-op", &ix, root, changed, 0);
+
+    // A folder one level down gets a file too, so refresh has to find a change below the root
+    deep[0] = '\0';
+    for (uint32_t k = 0; k < ix.hdr->entry_count; k++) {
+        if ((ix.entries[k].flags & INDEX_F_DIR) && ix.entries[k].dir != INDEX_NONE) { index_entry_path(&ix, k, deep, sizeof(deep)); break; }
+    }
+    snprintf(a, sizeof(a), "%s%cblade_check_a.txt", root, SCAN_SEP);
+    snprintf(d, sizeof(d), "%s%cblade_check_dir", root, SCAN_SEP);
+    snprintf(b, sizeof(b), "%s%cb.txt", d, SCAN_SEP);
+    snprintf(c, sizeof(c), "%s%cc", d, SCAN_SEP);
+    snprintf(e, sizeof(e), "%s%cd.txt", c, SCAN_SEP);
+    snprintf(f, sizeof(f), "%s%cblade_check_e.txt", deep, SCAN_SEP);
+
+    // Directory mtimes are coarse on some filesystems; wait so each change moves them
+    bench_sleep_ms(1100);
+    int made = check_write(a, "one") && gen_mkdir(d) && check_write(b, "three") && gen_mkdir(c) && check_write(e, "seven") && (!deep[0] || check_write(f, "x"));
+    changed = made ? index_refresh(&ix, file, 4) : -1;
+    failures += !check_index_matches("create", &ix, root, changed, 1);
+
+    bench_sleep_ms(1100);
+    remove(e);
+    check_rmdir(c);
+    remove(b);
+    check_rmdir(d);
+    remove(a);
+    if (deep[0]) remove(f);
+    changed = index_refresh(&ix, file, 4);
+    failures += !check_index_matches("delete", &ix, root, changed, 1);
+
+    index_close(&ix);
+    remove(file);
+    return failures;
+}
+
+static int run_checks(const char *root) {
+    int failures = check_maxdepth(root);
+    failures += check_index(root);
+    printf("Checks: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
+
+// ==========================================
+// MAIN
+// ==========================================
+static void usage(void) {
+    printf("Usage: blade_bench --gen <dir> [--depth n] [--fanout n] [--files n] [--name-min n] [--name-max n]\n");
+    printf("                   [--name-dist uniform|short] [--plant word] [--hit-rate f] [--seed n]\n");
+    printf("       blade_bench [--threads n] [--batch n] [--runs n] [--cold] [--json file]\n");
+    printf("                   [--baseline file] [--tolerance pct] <dir> <search_term>\n");
+    printf("       blade_bench --check <dir>\n");
+    printf("       blade_bench --match [--names n] [--min-ms n] [--seed n] [--json file]\n");
+}
+
+int main(int argc, char **argv) {
+    match_init();
+    GenOptions gen = { 4, 8, 100000, 4, 24, 0, NULL, 0.01, 1 };
+    RunOptions run = { 16, 64, 5, 0 };
+    const char *gen_root = NULL, *check_root = NULL, *json_file = NULL, *baseline = NULL;
+    double tolerance = 10.0;
+    int micro = 0, min_ms = 10;
+    long names = 16384;
+
+    int argi = 1;
+    for (; argi < argc; argi++) {
+        const char *a = argv[argi];
+        int more = argi + 1 < argc;
+        if (strcmp(a, "--gen") == 0 && more) gen_root = argv[++argi];
+        else if (strcmp(a, "--depth") == 0 && more) gen.depth = atoi(argv[++argi]);
+        else if (strcmp(a, "--fanout") == 0 && more) gen.fanout = atoi(argv[++argi]);
+        else if (strcmp(a, "--files") == 0 && more) gen.files = atol(argv[++argi]);
+        else if (strcmp(a, "--name-min") == 0 && more) gen.name_min = atoi(argv[++argi]);
+        else if (strcmp(a, "--name-max") == 0 && more) gen.name_max = atoi(argv[++argi]);
+        else if (strcmp(a, "--name-dist") == 0 && more) gen.name_short = strcmp(argv[++argi], "short") == 0;
+        else if (strcmp(a, "--plant") == 0 && more) gen.plant = argv[++argi];
+        else if (strcmp(a, "--hit-rate") == 0 && more) gen.hit_rate = atof(argv[++argi]);
+        else if (strcmp(a, "--seed") == 0 && more) gen.seed = strtoull(argv[++argi], NULL, 10);
+        else if (strcmp(a, "--threads") == 0 && more) run.threads = atoi(argv[++argi]);
+        else if (strcmp(a, "--batch") == 0 && more) run.batch = atoi(argv[++argi]);
+        else if (strcmp(a, "--runs") == 0 && more) run.runs = atoi(argv[++argi]);
+        else if (strcmp(a, "--cold") == 0) run.cold = 1;
+        else if (strcmp(a, "--json") == 0 && more) json_file = argv[++argi];
+        else if (strcmp(a, "--baseline") == 0 && more) baseline = argv[++argi];
+        else if (strcmp(a, "--tolerance") == 0 && more) tolerance = atof(argv[++argi]);
+        else if (strcmp(a, "--check") == 0 && more) check_root = argv[++argi];
+        else if (strcmp(a, "--match") == 0) micro = 1;
+        else if (strcmp(a, "--names") == 0 && more) names = atol(argv[++argi]);
+        else if (strcmp(a, "--min-ms") == 0 && more) min_ms = atoi(argv[++argi]);
+        else break;
+    }
+
+    if (check_root) {
+        if (argi != argc) { usage(); return 1; }
+        return run_checks(check_root);
+    }
+    if (micro) {
+        if (argi != argc || names < 1 || names > 1000000 || min_ms < 1) { usage(); return 1; }
+        return run_match_bench(names, min_ms, gen.seed, json_file);
+    }
+    if (gen_root) {
+        if (argi != argc || gen.depth < 0 || gen.fanout < 1 || gen.files < 0 || gen.name_min < 1 ||
+            gen.name_max < gen.name_min || gen.name_max > 200) { usage(); return 1; }
+        return run_generate(gen_root, &gen);
+    }
+    if (argc - argi != 2 || run.threads < 1 || run.threads > SCAN_MAX_THREADS || run.batch < 1 ||
+        run.batch > BENCH_BATCH_MAX || run.runs < 1 || run.runs > BENCH_MAX_RUNS) { usage(); return 1; }
+
+    const char *root = argv[argi];
+    const char *term = argv[argi + 1];
+    Pipeline *p = (Pipeline*)calloc(1, sizeof(Pipeline));
+    if (!p) return 1;
+    if (!query_compile(&p->query, term)) { printf("Search term has too many terms\n"); return 1; }
+    p->batch = run.batch;
+    scan_lock_init(&p->commit_lock);
+
+    printf("blade_bench: %s \"%s\", %d threads, batch %d, %s\n", root, term, run.threads, run.batch, match_level_names[match_active]);
+    printf("%-6s %10s %12s %12s %14s %10s %12s %12s %12s\n", "cache", "seconds", "dirs", "entries", "entries/sec",
+           "matches", "first (ms)", "lock (ms)", "peak RSS KB");
+
+    RunResult cold, warm, runs[BENCH_MAX_RUNS];
+    memset(&cold, 0, sizeof(cold));
+    if (run.cold && bench_drop_caches()) pipe_run(p, root, run.threads, &cold);
+    if (run.cold) print_run("cold", &cold);
+
+    pipe_run(p, root, run.threads, &warm);     // warm-up
+    for (int i = 0; i < run.runs; i++) pipe_run(p, root, run.threads, &runs[i]);
+    qsort(runs, run.runs, sizeof(RunResult), run_cmp);
+    warm = runs[run.runs / 2];
+    warm.peak_rss_kb = bench_peak_rss_kb();
+    print_run("warm", &warm);
+
+    int status = 0;
+    if (json_file && !write_json(json_file, root, term, &run, &cold, &warm)) {
+        fprintf(stderr, "Cannot write %s\n", json_file);
+        status = 1;
+    }
+    if (baseline) status |= compare_baseline(baseline, &warm, tolerance);
+    scan_lock_free(&p->commit_lock);
+    free(p);
+    return status;
+}
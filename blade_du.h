@@ -0,0 +1,335 @@
+// blade_du.h - Parallel recursive directory sizes
+//
+// A du run is an ordinary scan (blade_scan.h) whose jobs carry a DuNode. A
+// node starts with one pending unit for its own enumeration; every child
+// directory queued below it adds one. When a directory has been enumerated its
+// file sizes are added and its unit released, and whichever worker drops a
+// count to zero adds the finished subtree into the parent and releases the
+// parent's unit in turn. Totals therefore flow bottom-up while the scan is
+// still running, with no pass over the tree at the end, and on_done sees every
+// directory as soon as its subtree is complete (children before parents).
+//
+// DuCache remembers finished totals by path hash. An entry is only used while
+// the directory's own mtime matches, so a folder whose entries changed is
+// computed again; changes deeper down that leave its mtime alone are picked up
+// by the next run over it.
+
+#ifndef BLADE_DU_H
+#define BLADE_DU_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "blade_scan.h"
+#include "blade_tree.h"
+
+// ==========================================
+// CONFIGURATION
+// ==========================================
+#define DU_BLOCK_NODES 4096
+#define DU_CACHE_INITIAL 4096
+#define DU_CACHE_MAX (1u << 24)     // 16M directories
+#define DU_HASH_SEED 0xcbf29ce484222325ULL
+
+// ==========================================
+// DATA STRUCTURES
+// ==========================================
+typedef struct DuNode {
+    struct DuNode *parent;
+    uint64_t bytes;         // whole subtree once done
+    uint64_t files;
+    uint64_t dirs;          // directories below this one
+    uint64_t mtime;         // of the directory itself, 0 if unknown
+    uint64_t hash;          // du_hash of its path
+    long pending;           // own enumeration + children not finished yet
+    uint32_t id;            // scan job id, which is its DirTree node
+    uint32_t depth;         // 0 for the root
+} DuNode;
+
+typedef struct DuBlock {
+    struct DuBlock *next;
+    int used;
+    DuNode nodes[DU_BLOCK_NODES];
+} DuBlock;
+
+// Per worker: the directory being enumerated and its file totals so far
+typedef struct DuLocal {
+    DuBlock *blocks;
+    uint64_t bytes;
+    uint64_t files;
+    uint64_t dirs;
+} DuLocal;
+
+struct DuRun;
+typedef void (*DuDoneFn)(struct DuRun *run, const DuNode *node);
+
+typedef struct DuRun {
+    ScanCtx *scan;
+    DirTree *tree;          // paths of every directory (blade_tree.h)
+    DuNode root;
+    DuLocal *locals[SCAN_MAX_THREADS];
+    DuDoneFn on_done;       // called from worker threads
+    void *user;
+    volatile int finished;
+} DuRun;
+
+typedef struct DuCacheSlot {
+    uint64_t hash;          // 0 for an empty slot
+    uint64_t mtime;
+    uint64_t bytes;
+    uint64_t files;
+    uint64_t dirs;
+} DuCacheSlot;
+
+typedef struct DuCache {
+    scan_lock_t lock;
+    DuCacheSlot *slots;
+    uint32_t cap;           // power of two
+    uint32_t count;
+} DuCache;
+
+// ==========================================
+// PATH HASH
+// ==========================================
+// FNV-1a over the path with ASCII case folded, '/' read as '\' and trailing
+// separators dropped, so a child's hash continues from its parent's
+static inline uint64_t du_hash_add(uint64_t h, const char *s, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = (uint8_t)s[i];
+        if (c == '/') c = '\\';
+        if (c >= 'A' && c <= 'Z') c += 32;
+        h = (h ^ c) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// Repeated separators count once, so a drive root joined with "\name" still
+// hashes like the path its children were hashed from
+static inline uint64_t du_hash(const char *path, size_t len) {
+    while (len > 0 && (path[len - 1] == '\\' || path[len - 1] == '/')) len--;
+    uint64_t h = DU_HASH_SEED;
+    for (size_t i = 0; i < len; i++) {
+        int sep = path[i] == '\\' || path[i] == '/';
+        if (sep && i > 0 && (path[i - 1] == '\\' || path[i - 1] == '/')) continue;
+        h = du_hash_add(h, path + i, 1);
+    }
+    return h ? h : 1;
+}
+
+static inline uint64_t du_hash_child(uint64_t parent, const char *name, size_t len) {
+    uint64_t h = du_hash_add(du_hash_add(parent, "\\", 1), name, len);
+    return h ? h : 1;
+}
+
+// ==========================================
+// CACHE
+// ==========================================
+static inline int du_cache_init(DuCache *c) {
+    memset(c, 0, sizeof(*c));
+    c->slots = (DuCacheSlot*)calloc(DU_CACHE_INITIAL, sizeof(DuCacheSlot));
+    if (!c->slots) return 0;
+    c->cap = DU_CACHE_INITIAL;
+    scan_lock_init(&c->lock);
+    return 1;
+}
+
+static inline void du_cache_free(DuCache *c) {
+    if (!c->slots) return;
+    free(c->slots);
+    c->slots = NULL;
+    scan_lock_free(&c->lock);
+}
+
+static inline DuCacheSlot *du_cache_slot(DuCacheSlot *slots, uint32_t cap, uint64_t hash) {
+    for (uint32_t i = (uint32_t)(hash >> 32) & (cap - 1);; i = (i + 1) & (cap - 1)) {
+        if (slots[i].hash == hash || slots[i].hash == 0) return &slots[i];
+    }
+}
+
+// Kept at most half full; stops taking new directories at DU_CACHE_MAX
+static inline void du_cache_put(DuCache *c, const DuNode *n) {
+    scan_lock(&c->lock);
+    if ((c->count + 1) * 2 > c->cap && c->cap < DU_CACHE_MAX) {
+        uint32_t cap = c->cap * 2;
+        DuCacheSlot *grown = (DuCacheSlot*)calloc(cap, sizeof(DuCacheSlot));
+        if (grown) {
+            for (uint32_t i = 0; i < c->cap; i++) {
+                if (c->slots[i].hash) *du_cache_slot(grown, cap, c->slots[i].hash) = c->slots[i];
+            }
+            free(c->slots);
+            c->slots = grown;
+            c->cap = cap;
+        }
+    }
+    DuCacheSlot *s = du_cache_slot(c->slots, c->cap, n->hash);
+    if (s->hash || (c->count + 1) * 2 <= c->cap) {
+        if (!s->hash) c->count++;
+        s->hash = n->hash;
+        s->mtime = n->mtime;
+        s->bytes = n->bytes;
+        s->files = n->files;
+        s->dirs = n->dirs;
+    }
+    scan_unlock(&c->lock);
+}
+
+// Totals of the directory with this path hash, if cached for the same mtime
+static inline int du_cache_get(DuCache *c, uint64_t hash, uint64_t mtime, DuCacheSlot *out) {
+    scan_lock(&c->lock);
+    DuCacheSlot *s = du_cache_slot(c->slots, c->cap, hash);
+    int hit = s->hash == hash && s->mtime == mtime && mtime != 0;
+    if (hit) *out = *s;
+    scan_unlock(&c->lock);
+    return hit;
+}
+
+// ==========================================
+// AGGREGATION
+// ==========================================
+static inline DuNode *du_node_alloc(DuLocal *l) {
+    if (!l->blocks || l->blocks->used == DU_BLOCK_NODES) {
+        DuBlock *b = (DuBlock*)malloc(sizeof(DuBlock));
+        if (!b) return NULL;
+        b->next = l->blocks;
+        b->used = 0;
+        l->blocks = b;
+    }
+    return &l->blocks->nodes[l->blocks->used++];
+}
+
+// Releases one pending unit of n and carries finished subtrees upwards
+static inline void du_release(DuRun *run, DuNode *n) {
+    while (n && scan_dec(&n->pending) == 0) {
+        if (run->on_done) run->on_done(run, n);
+        DuNode *p = n->parent;
+        if (p) {
+            __atomic_add_fetch(&p->bytes, n->bytes, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&p->files, n->files, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&p->dirs, n->dirs, __ATOMIC_RELAXED);
+        }
+        n = p;
+    }
+}
+
+static inline void du_on_start(ScanWorker *w) {
+    DuRun *run = (DuRun*)w->ctx->user;
+    DuLocal *l = (DuLocal*)calloc(1, sizeof(DuLocal));
+    run->locals[w->id] = l;
+    w->local = l;
+}
+
+static inline int du_on_dir(ScanWorker *w, const ScanJob *dir) {
+    DuLocal *l = (DuLocal*)w->local;
+    tree_add_job(((DuRun*)w->ctx->user)->tree, w, dir);
+    if (l) l->bytes = l->files = l->dirs = 0;
+    return SCAN_CONTINUE;
+}
+
+static inline int du_on_entry(ScanWorker *w, const ScanJob *dir, ScanEntry *e) {
+    DuLocal *l = (DuLocal*)w->local;
+    DuNode *parent = (DuNode*)dir->tag;
+    if (!l || !parent) return SCAN_SKIP;
+    if (!e->is_dir || e->is_reparse) {
+        if (scan_entry_stat(e)) l->bytes += e->size;
+        l->files++;
+        return SCAN_CONTINUE;
+    }
+    l->dirs++;
+    // A child the engine cannot queue (path too long) would never finish and hold
+    // its parent open, so it gets no node and counts as an empty folder
+    int need_sep = dir->len > 0 && dir->path[dir->len - 1] != '\\' && dir->path[dir->len - 1] != '/';
+    if (dir->len + need_sep + e->name_len >= SCAN_PATH_MAX) return SCAN_SKIP;
+    DuNode *n = du_node_alloc(l);
+    if (!n) return SCAN_SKIP;
+    memset(n, 0, sizeof(*n));
+    n->parent = parent;
+    n->mtime = scan_entry_stat(e) ? e->mtime : 0;
+    n->hash = du_hash_child(parent->hash, e->name, e->name_len);
+    n->pending = 1;
+    n->depth = parent->depth + 1;       // id is the child job's, set when it is done
+    scan_inc(&parent->pending);
+    e->tag = (uintptr_t)n;
+    return SCAN_CONTINUE;
+}
+
+// Every job taken, enumerated or not, finishes here
+static inline void du_on_dir_done(ScanWorker *w, const ScanJob *dir) {
+    DuLocal *l = (DuLocal*)w->local;
+    DuNode *n = (DuNode*)dir->tag;
+    if (!l || !n) return;
+    n->id = dir->id;
+    __atomic_add_fetch(&n->bytes, l->bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&n->files, l->files, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&n->dirs, l->dirs, __ATOMIC_RELAXED);
+    l->bytes = l->files = l->dirs = 0;
+    du_release((DuRun*)w->ctx->user, n);
+}
+
+static inline void du_on_finish(ScanCtx *ctx) {
+    __atomic_store_n(&((DuRun*)ctx->user)->finished, 1, __ATOMIC_RELEASE);
+}
+
+// ==========================================
+// PUBLIC API
+// ==========================================
+// Starts sizing root in the background. root_mtime is recorded for the root's
+// cache entry (0 if unknown). prune may be NULL; maxdepth must not be set, or
+// the directories below it would never finish.
+static inline DuRun *du_start(const char *root, uint64_t root_mtime, int threads, const Prune *prune, DuDoneFn on_done, void *user) {
+    DuRun *run = (DuRun*)calloc(1, sizeof(DuRun));
+    if (!run) return NULL;
+    run->tree = tree_create();
+    run->scan = scan_create(threads, run);
+    if (!run->tree || !run->scan || (prune && prune->max_depth) || !scan_set_prune(run->scan, prune)) {
+        if (run->scan) scan_release(run->scan);
+        tree_free(run->tree);
+        free(run);
+        return NULL;
+    }
+    run->on_done = on_done;
+    run->user = user;
+    run->root.mtime = root_mtime;
+    run->root.hash = du_hash(root, strlen(root));
+    run->root.pending = 1;
+    ScanCtx *ctx = run->scan;
+    ctx->on_start = du_on_start;
+    ctx->on_dir = du_on_dir;
+    ctx->on_entry = du_on_entry;
+    ctx->on_dir_done = du_on_dir_done;
+    ctx->on_finish = du_on_finish;
+    scan_add_root_tagged(ctx, root, (uintptr_t)&run->root);
+    scan_start(ctx);
+    return run;
+}
+
+static inline void du_cancel(DuRun *run) {
+    if (run) scan_cancel(run->scan);
+}
+
+// Root totals are final once this returns 1
+static inline int du_finished(const DuRun *run) {
+    return __atomic_load_n(&run->finished, __ATOMIC_ACQUIRE);
+}
+
+// Full path of a directory the run has finished
+static inline size_t du_node_path(const DuRun *run, const DuNode *n, char *out, size_t cap) {
+    return tree_path(run->tree, n->id, out, cap);
+}
+
+// Waits for the workers (cancel first to stop early) and frees everything
+static inline void du_free(DuRun *run) {
+    if (!run) return;
+    scan_wait(run->scan);
+    scan_release(run->scan);
+    for (int i = 0; i < SCAN_MAX_THREADS; i++) {
+        DuLocal *l = run->locals[i];
+        if (!l) continue;
+        DuBlock *b = l->blocks;
+        while (b) { DuBlock *next = b->next; free(b); b = next; }
+        free(l);
+    }
+    tree_free(run->tree);
+    free(run);
+}
+
+#endif // BLADE_DU_H
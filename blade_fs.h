@@ -0,0 +1,362 @@
+// blade_fs.h - Directory enumeration backends
+//
+// A backend opens one directory at a time and hands its entries back in
+// batches of (name, type, size, mtime). Names stay valid until the next
+// fs_read on the same FsDir. Backends that learn the type for free (d_type)
+// leave size/mtime unset until fs_stat is called for the entry, so callers
+// that only look at names never pay for a stat.
+//
+// On POSIX a directory can be opened relative to its parent's fd (openat), so
+// the kernel resolves one path component instead of the whole absolute path.
+
+#ifndef BLADE_FS_H
+#define BLADE_FS_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+// ==========================================
+// CONFIGURATION
+// ==========================================
+#define FS_BATCH 128
+#define FS_BUF_SIZE (64 * 1024)
+#define FS_BUF_SLACK 64         // zeroed tail so SIMD matchers may over-read the last name
+#define FS_NO_FD ((intptr_t)-1)
+
+#define FS_TYPE_UNKNOWN 0
+#define FS_TYPE_FILE    1
+#define FS_TYPE_DIR     2
+#define FS_TYPE_LINK    3       // symlink (POSIX); never descended
+#define FS_TYPE_OTHER   4
+
+#define FS_HAVE_STAT 1          // size and mtime are filled in
+#define FS_REPARSE   2          // Windows reparse point (junction, symlink dir)
+
+// ==========================================
+// DATA STRUCTURES
+// ==========================================
+typedef struct FsEntry {
+    const char *name;       // NUL terminated
+    uint32_t name_len;
+    uint8_t type;
+    uint8_t flags;
+    uint64_t size;
+    uint64_t mtime;         // FILETIME ticks (100ns since 1601) on every platform
+} FsEntry;
+
+struct FsBackend;
+
+typedef struct FsDir {
+    const struct FsBackend *be;
+    intptr_t fd;            // directory fd for relative opens, FS_NO_FD if the backend has none
+    void *handle;           // HANDLE / DIR*
+    size_t pos, end;        // unread part of buf (getdents64)
+    int count;
+#ifdef _WIN32
+    int have_first;
+    WIN32_FIND_DATAA wfd;
+#endif
+    FsEntry batch[FS_BATCH];
+    char buf[FS_BUF_SIZE + FS_BUF_SLACK];
+} FsDir;
+
+typedef struct FsBackend {
+    const char *name;
+    int relative;   // open() resolves 'name' against a parent fd
+    // parent is FS_NO_FD or an fd kept from an earlier fs_close(d, 1); name is the leaf of path
+    int  (*open)(FsDir *d, intptr_t parent, const char *path, const char *name);
+    int  (*read)(FsDir *d);                 // refills d->batch: count, 0 at end, -1 on error
+    int  (*stat)(FsDir *d, FsEntry *e);     // fills size/mtime (and type if unknown)
+    void (*close)(FsDir *d, int keep_fd);   // keep_fd: d->fd stays open for fs_close_fd
+} FsBackend;
+
+static inline int fs_is_dots(const char *n) {
+    return n[0] == '.' && (n[1] == '\0' || (n[1] == '.' && n[2] == '\0'));
+}
+
+// ==========================================
+// WIN32 BACKEND (FindFirstFileExA)
+// ==========================================
+#ifdef _WIN32
+static inline int fs_win32_open(FsDir *d, intptr_t parent, const char *path, const char *name) {
+    char spec[4096 + 4];
+    size_t n = strlen(path);
+    if (n + 3 > sizeof(spec)) return 0;
+    memcpy(spec, path, n);
+    if (n > 0 && spec[n - 1] != '\\' && spec[n - 1] != '/') spec[n++] = '\\';
+    spec[n++] = '*';
+    spec[n] = '\0';
+
+    HANDLE h = FindFirstFileExA(spec, FindExInfoBasic, &d->wfd, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if (h == INVALID_HANDLE_VALUE) return 0;
+    d->handle = h;
+    d->fd = FS_NO_FD;
+    d->have_first = 1;
+    return 1;
+}
+
+static inline int fs_win32_read(FsDir *d) {
+    size_t used = 0;
+    d->count = 0;
+    while (d->count < FS_BATCH && used + MAX_PATH + 1 <= FS_BUF_SIZE) {
+        if (!d->have_first && !FindNextFileA((HANDLE)d->handle, &d->wfd)) break;
+        d->have_first = 0;
+        WIN32_FIND_DATAA *f = &d->wfd;
+        if (fs_is_dots(f->cFileName)) continue;
+
+        size_t len = strlen(f->cFileName);
+        FsEntry *e = &d->batch[d->count++];
+        memcpy(d->buf + used, f->cFileName, len + 1);
+        e->name = d->buf + used;
+        e->name_len = (uint32_t)len;
+        used += len + 1;
+        e->type = (f->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? FS_TYPE_DIR : FS_TYPE_FILE;
+        e->flags = FS_HAVE_STAT | ((f->dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) ? FS_REPARSE : 0);
+        e->size = ((uint64_t)f->nFileSizeHigh << 32) | f->nFileSizeLow;
+        e->mtime = ((uint64_t)f->ftLastWriteTime.dwHighDateTime << 32) | f->ftLastWriteTime.dwLowDateTime;
+    }
+    memset(d->buf + used, 0, FS_BUF_SLACK);
+    return d->count;
+}
+
+static inline int fs_win32_stat(FsDir *d, FsEntry *e) {
+    return 1;
+}
+
+static inline void fs_win32_close(FsDir *d, int keep_fd) {
+    FindClose((HANDLE)d->handle);
+    d->handle = NULL;
+}
+
+static const FsBackend fs_win32 = { "win32", 0, fs_win32_open, fs_win32_read, fs_win32_stat, fs_win32_close };
+
+static inline void fs_close_fd(intptr_t fd) { }
+
+#else
+// ==========================================
+// POSIX HELPERS
+// ==========================================
+static inline uint64_t fs_posix_mtime(const struct stat *st) {
+    return (uint64_t)st->st_mtim.tv_sec * 10000000ULL + (uint64_t)st->st_mtim.tv_nsec / 100 + 116444736000000000ULL;
+}
+
+static inline uint8_t fs_posix_type(mode_t m) {
+    if (S_ISDIR(m)) return FS_TYPE_DIR;
+    if (S_ISREG(m)) return FS_TYPE_FILE;
+    if (S_ISLNK(m)) return FS_TYPE_LINK;
+    return FS_TYPE_OTHER;
+}
+
+static inline uint8_t fs_dtype(unsigned char t) {
+    switch (t) {
+        case DT_DIR: return FS_TYPE_DIR;
+        case DT_REG: return FS_TYPE_FILE;
+        case DT_LNK: return FS_TYPE_LINK;
+        case DT_UNKNOWN: return FS_TYPE_UNKNOWN;
+        default: return FS_TYPE_OTHER;
+    }
+}
+
+static inline int fs_posix_stat(FsDir *d, FsEntry *e) {
+    if (e->flags & FS_HAVE_STAT) return 1;
+    struct stat st;
+    if (fstatat((int)d->fd, e->name, &st, AT_SYMLINK_NOFOLLOW) != 0) return 0;
+    e->type = fs_posix_type(st.st_mode);
+    e->size = e->type == FS_TYPE_DIR ? 0 : (uint64_t)st.st_size;
+    e->mtime = fs_posix_mtime(&st);
+    e->flags |= FS_HAVE_STAT;
+    return 1;
+}
+
+// Children are opened with O_NOFOLLOW so a directory swapped for a symlink mid-scan is not followed
+static inline int fs_posix_openfd(intptr_t parent, const char *path, const char *name) {
+    if (parent != FS_NO_FD) return openat((int)parent, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    return open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+static inline void fs_close_fd(intptr_t fd) {
+    if (fd != FS_NO_FD) close((int)fd);
+}
+
+#ifdef __linux__
+// ==========================================
+// LINUX BACKEND (getdents64 + openat + d_type)
+// ==========================================
+typedef struct FsDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} FsDirent64;
+
+static inline int fs_getdents_open(FsDir *d, intptr_t parent, const char *path, const char *name) {
+    int fd = fs_posix_openfd(parent, path, name);
+    if (fd < 0) return 0;
+    d->fd = fd;
+    d->pos = d->end = 0;
+    return 1;
+}
+
+// Entries point straight into the getdents buffer; it is only refilled once the
+// previous batch has been handed out completely.
+static inline int fs_getdents_read(FsDir *d) {
+    d->count = 0;
+    for (;;) {
+        if (d->pos >= d->end) {
+            if (d->count > 0) break;
+            long n = syscall(SYS_getdents64, (int)d->fd, d->buf, FS_BUF_SIZE);
+            if (n <= 0) return n < 0 ? -1 : 0;
+            memset(d->buf + n, 0, FS_BUF_SLACK);
+            d->pos = 0;
+            d->end = (size_t)n;
+        }
+        while (d->pos < d->end && d->count < FS_BATCH) {
+            FsDirent64 *de = (FsDirent64*)(d->buf + d->pos);
+            d->pos += de->d_reclen;
+            if (fs_is_dots(de->d_name)) continue;
+
+            FsEntry *e = &d->batch[d->count++];
+            e->name = de->d_name;
+            e->name_len = (uint32_t)strlen(de->d_name);
+            e->type = fs_dtype(de->d_type);
+            e->flags = 0;
+            e->size = 0;
+            e->mtime = 0;
+            // File systems without d_type: one stat is the only way to know whether to descend
+            if (e->type == FS_TYPE_UNKNOWN && !fs_posix_stat(d, e)) d->count--;
+        }
+        if (d->count == FS_BATCH) break;
+    }
+    return d->count;
+}
+
+static inline void fs_getdents_close(FsDir *d, int keep_fd) {
+    if (!keep_fd) fs_close_fd(d->fd);
+    d->fd = FS_NO_FD;
+}
+
+static const FsBackend fs_getdents = { "getdents64", 1, fs_getdents_open, fs_getdents_read, fs_posix_stat, fs_getdents_close };
+#endif
+
+// ==========================================
+// PORTABLE POSIX BACKEND (readdir)
+// ==========================================
+static inline int fs_readdir_open(FsDir *d, intptr_t parent, const char *path, const char *name) {
+    int fd = fs_posix_openfd(parent, path, name);
+    if (fd < 0) return 0;
+    // The DIR stream owns a duplicate so d->fd stays valid for children after closedir
+    int dfd = dup(fd);
+    DIR *dir = dfd >= 0 ? fdopendir(dfd) : NULL;
+    if (!dir) {
+        if (dfd >= 0) close(dfd);
+        close(fd);
+        return 0;
+    }
+    d->fd = fd;
+    d->handle = dir;
+    return 1;
+}
+
+static inline int fs_readdir_read(FsDir *d) {
+    size_t used = 0;
+    struct dirent *de;
+    d->count = 0;
+    while (d->count < FS_BATCH && used + 256 <= FS_BUF_SIZE && (de = readdir((DIR*)d->handle)) != NULL) {
+        if (fs_is_dots(de->d_name)) continue;
+        size_t len = strlen(de->d_name);
+        if (used + len + 1 > FS_BUF_SIZE) break;
+
+        FsEntry *e = &d->batch[d->count++];
+        memcpy(d->buf + used, de->d_name, len + 1);
+        e->name = d->buf + used;
+        e->name_len = (uint32_t)len;
+        used += len + 1;
+#ifdef DT_UNKNOWN
+        e->type = fs_dtype(de->d_type);
+#else
+        e->type = FS_TYPE_UNKNOWN;
+#endif
+        e->flags = 0;
+        e->size = 0;
+        e->mtime = 0;
+        if (e->type == FS_TYPE_UNKNOWN && !fs_posix_stat(d, e)) d->count--;
+    }
+    memset(d->buf + used, 0, FS_BUF_SLACK);
+    return d->count;
+}
+
+static inline void fs_readdir_close(FsDir *d, int keep_fd) {
+    closedir((DIR*)d->handle);
+    d->handle = NULL;
+    if (!keep_fd) fs_close_fd(d->fd);
+    d->fd = FS_NO_FD;
+}
+
+static const FsBackend fs_readdir = { "readdir", 1, fs_readdir_open, fs_readdir_read, fs_posix_stat, fs_readdir_close };
+#endif
+
+// ==========================================
+// PUBLIC API
+// ==========================================
+static const FsBackend *const fs_backends[] = {
+#ifdef _WIN32
+    &fs_win32,
+#else
+#ifdef __linux__
+    &fs_getdents,
+#endif
+    &fs_readdir,
+#endif
+    NULL
+};
+
+static inline const FsBackend* fs_default_backend(void) {
+    return fs_backends[0];
+}
+
+// NULL if no backend of that name is built in
+static inline const FsBackend* fs_find_backend(const char *name) {
+    for (int i = 0; fs_backends[i]; i++) {
+        if (strcmp(fs_backends[i]->name, name) == 0) return fs_backends[i];
+    }
+    return NULL;
+}
+
+static inline FsDir* fs_dir_alloc(const FsBackend *be) {
+    FsDir *d = (FsDir*)malloc(sizeof(FsDir));
+    if (!d) return NULL;
+    d->be = be ? be : fs_default_backend();
+    d->fd = FS_NO_FD;
+    d->handle = NULL;
+    d->count = 0;
+    return d;
+}
+
+static inline void fs_dir_free(FsDir *d) {
+    free(d);
+}
+
+static inline int fs_open(FsDir *d, intptr_t parent, const char *path, const char *name) {
+    if (!d->be->relative) parent = FS_NO_FD;
+    return d->be->open(d, parent, path, name);
+}
+
+static inline int fs_read(FsDir *d) { return d->be->read(d); }
+static inline int fs_stat(FsDir *d, FsEntry *e) { return d->be->stat(d, e); }
+static inline void fs_close(FsDir *d, int keep_fd) { d->be->close(d, keep_fd); }
+
+#endif // BLADE_FS_H
@@ -0,0 +1,215 @@
+// blade_glob.h - Compiled, linear-time glob matching
+//
+// A pattern is compiled once per query. Common shapes reduce to one compare:
+//
+//   *          everything
+//   *.ext      suffix        (one 16-byte SIMD compare for short suffixes)
+//   prefix*    prefix
+//   *lit*      substring     (blade_match.h kernel)
+//
+// Everything else runs a bit-parallel NFA (Shift-And): bit k of the state
+// means "atoms 0..k matched so far", a '*' after atom k is a self-loop on bit
+// k. One shift, one table lookup and two ANDs per byte, whatever the number
+// of stars, so cost per name is O(len) with no backtracking.
+//
+// Atoms: literal bytes (case-insensitive), '?', and [abc] / [a-z] / [!x] classes.
+// A pattern containing a path separator or '**' is a path glob: there '*' and
+// '?' stop at '\' and '/', '**' crosses them. Plain name globs keep the old
+// behaviour where '*' matches anything.
+
+#ifndef BLADE_GLOB_H
+#define BLADE_GLOB_H
+
+#include <string.h>
+#include <stdint.h>
+#include "blade_match.h"
+
+// ==========================================
+// CONFIGURATION
+// ==========================================
+#define GLOB_MAX_ATOMS 64
+
+#define GLOB_ALL      0
+#define GLOB_PREFIX   1
+#define GLOB_SUFFIX   2
+#define GLOB_CONTAINS 3
+#define GLOB_NFA      4
+
+// ==========================================
+// DATA STRUCTURES
+// ==========================================
+typedef struct GlobProgram {
+    int kind;
+    int lead;               // stars before atom 0: 0 none, 1 '*', 2 '**'
+    uint32_t atoms;
+    uint64_t star;          // atoms followed by a star that may eat a non-separator
+    uint64_t star_any;      // atoms followed by a star that may also eat a separator
+    uint64_t accept[256];   // per folded byte: atoms that accept it
+    MatchNeedle lit;        // PREFIX / SUFFIX / CONTAINS
+    uint8_t tail16[16];     // SUFFIX: literal right-aligned for the SIMD compare
+} GlobProgram;
+
+static inline int glob_is_sep(uint8_t c) {
+    return c == '/' || c == '\\';
+}
+
+// Nonzero if s looks like a glob rather than a literal
+static inline int glob_has_meta(const char *s, size_t len) {
+    if (memchr(s, '*', len) || memchr(s, '?', len)) return 1;
+    const char *open = (const char*)memchr(s, '[', len);
+    return open && memchr(open, ']', len - (size_t)(open - s)) != NULL;
+}
+
+// ==========================================
+// COMPILER
+// ==========================================
+// Parses [..] starting after '['. Returns the number of pattern bytes consumed
+// (including ']'), or 0 if the class is not closed and '[' is a literal.
+static inline size_t glob_class(GlobProgram *g, uint64_t bit, const char *p, size_t left, int path) {
+    size_t i = 0;
+    int negate = 0;
+    uint8_t set[256];
+    if (i < left && (p[i] == '!' || p[i] == '^')) { negate = 1; i++; }
+    size_t start = i;
+    while (i < left && (p[i] != ']' || i == start)) i++;
+    if (i >= left) return 0;
+
+    memset(set, 0, sizeof(set));
+    for (size_t k = start; k < i; k++) {
+        uint8_t lo = match_fold[(uint8_t)p[k]];
+        uint8_t hi = lo;
+        if (k + 2 < i && p[k + 1] == '-') { hi = match_fold[(uint8_t)p[k + 2]]; k += 2; }
+        for (int c = lo; c <= hi; c++) set[c] = 1;
+    }
+    for (int c = 0; c < 256; c++) {
+        if (match_fold[c] != c) continue;       // the table is indexed by folded bytes
+        int in = set[c] != negate;
+        if (negate && path && glob_is_sep((uint8_t)c)) in = 0;
+        if (in) g->accept[c] |= bit;
+    }
+    return i + 1;
+}
+
+// Returns 0 if the pattern has more than GLOB_MAX_ATOMS atoms
+static inline int glob_compile(GlobProgram *g, const char *pattern, size_t len) {
+    memset(g, 0, sizeof(*g));
+    int path = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (glob_is_sep((uint8_t)pattern[i]) || (pattern[i] == '*' && i + 1 < len && pattern[i + 1] == '*')) path = 1;
+    }
+
+    char lit[MATCH_NEEDLE_MAX + 1];
+    size_t lit_len = 0;
+    int plain = 1;          // only literal bytes between the stars
+    int inner_star = 0;     // a star between two atoms
+    int trail = 0;
+    uint32_t m = 0;
+
+    for (size_t i = 0; i < len;) {
+        if (pattern[i] == '*') {
+            int any = !path;
+            size_t run = 0;
+            while (i < len && pattern[i] == '*') { i++; run++; }
+            if (run > 1) any = 1;
+            if (m == 0) {
+                if (g->lead < (any ? 2 : 1)) g->lead = any ? 2 : 1;
+            } else {
+                g->star |= 1ULL << (m - 1);
+                if (any) g->star_any |= 1ULL << (m - 1);
+            }
+            if (i == len) trail = 1;
+            else if (m > 0) inner_star = 1;
+            continue;
+        }
+        if (m == GLOB_MAX_ATOMS) return 0;
+        uint64_t bit = 1ULL << m;
+        uint8_t c = (uint8_t)pattern[i];
+        size_t used;
+        if (c == '?') {
+            for (int k = 0; k < 256; k++) if (match_fold[k] == k && !(path && glob_is_sep((uint8_t)k))) g->accept[k] |= bit;
+            plain = 0;
+            i++;
+        } else if (c == '[' && (used = glob_class(g, bit, pattern + i + 1, len - i - 1, path)) > 0) {
+            i += 1 + used;
+            plain = 0;
+        } else {
+            if (glob_is_sep(c)) {
+                g->accept['/'] |= bit;
+                g->accept['\\'] |= bit;
+            } else {
+                g->accept[match_fold[c]] |= bit;
+            }
+            if (lit_len < MATCH_NEEDLE_MAX) lit[lit_len++] = (char)c;
+            else plain = 0;
+            i++;
+        }
+        m++;
+    }
+    g->atoms = m;
+
+    // Shapes that reduce to one literal compare
+    if (m == 0) { g->kind = GLOB_ALL; return 1; }
+    g->kind = GLOB_NFA;
+    if (!plain || inner_star || path) return 1;
+    if (g->lead && trail) g->kind = GLOB_CONTAINS;
+    else if (g->lead) g->kind = GLOB_SUFFIX;
+    else if (trail) g->kind = GLOB_PREFIX;
+    else return 1;
+    match_needle(&g->lit, lit, lit_len);
+    if (g->kind == GLOB_SUFFIX && lit_len <= 16) memcpy(g->tail16 + 16 - lit_len, g->lit.text, lit_len);
+    return 1;
+}
+
+// ==========================================
+// MATCHER
+// ==========================================
+static inline int glob_equal(const MatchNeedle *n, const char *s) {
+    for (uint32_t k = 0; k < n->len; k++) {
+        if (match_fold[(uint8_t)s[k]] != (uint8_t)n->text[k]) return 0;
+    }
+    return 1;
+}
+
+#ifdef MATCH_X86
+// Last n <= 16 bytes of s (len >= 16) against the right-aligned literal in one compare
+__attribute__((target("sse2")))
+static inline int glob_suffix_sse2(const GlobProgram *g, const char *s, size_t len) {
+    __m128i b = match_lower_sse2(_mm_loadu_si128((const __m128i*)(s + len - 16)));
+    unsigned eq = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(b, _mm_loadu_si128((const __m128i*)g->tail16)));
+    unsigned want = 0xFFFFu & ~((1u << (16 - g->lit.len)) - 1);
+    return (eq & want) == want;
+}
+#endif
+
+static inline int glob_nfa(const GlobProgram *g, const char *s, size_t len) {
+    uint64_t d = 0;
+    uint64_t last = 1ULL << (g->atoms - 1);
+    int lead_alive = g->lead;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = match_fold[(uint8_t)s[i]];
+        uint64_t first = (i == 0 || lead_alive) ? 1 : 0;
+        d = (((d << 1) | first) & g->accept[c]) | (d & (glob_is_sep(c) ? g->star_any : g->star));
+        if (lead_alive == 1 && glob_is_sep(c)) lead_alive = 0;
+        if (!d && !lead_alive) return 0;
+    }
+    return (d & last) != 0;
+}
+
+// s[0..len). Substring patterns use match_find, which may read past the end
+// within the page of s[len - 1], never into the next page.
+static inline int glob_match(const GlobProgram *g, const char *s, size_t len) {
+    switch (g->kind) {
+        case GLOB_ALL: return 1;
+        case GLOB_PREFIX: return len >= g->lit.len && glob_equal(&g->lit, s);
+        case GLOB_SUFFIX:
+            if (len < g->lit.len) return 0;
+#ifdef MATCH_X86
+            if (len >= 16 && g->lit.len <= 16 && match_active >= MATCH_SSE2) return glob_suffix_sse2(g, s, len);
+#endif
+            return glob_equal(&g->lit, s + len - g->lit.len);
+        case GLOB_CONTAINS: return match_find(&g->lit, s, len) != 0;
+        default: return glob_nfa(g, s, len);
+    }
+}
+
+#endif // BLADE_GLOB_H
@@ -1,5 +1,5 @@
 // Compile with: cl blade.c user32.lib gdi32.lib shell32.lib ole32.lib /O2 /arch:AVX2
-// Or MinGW: gcc blade.c -o blade.exe -lgdi32 -luser32 -lshell32 -lole32 -mavx2 -O3
+// Or MinGW: gcc blade.c -o blade.exe -lgdi32 -luser32 -lshell32 -lole32 -O3
 
 #ifndef _WIN32_WINNT
 #define _WIN32_WINNT 0x0600 // Force Vista+
@@ -67,7 +67,7 @@
 #define COL_HOVER    RGB(30, 30, 30)
 #define COL_HELP_BG  RGB(30, 30, 30)
 // Compile with: cl blade.c user32.lib gdi32.lib shell32.lib ole32.lib /O2 /arch:AVX2
-// Or MinGW: gcc blade.c -o blade.exe -lgdi32 -luser32 -lshell32 -lole32 -mavx2 -O3
+// Or MinGW: gcc blade.c -o blade.exe -lgdi32 -luser32 -lshell32 -lole32 -O3
 
 #ifndef _WIN32_WINNT
 #define _WIN32_WINNT 0x0600 // Force Vista+
@@ -92,12 +92,21 @@
 #define FIND_FIRST_EX_LARGE_FETCH 2
 #endif
 
+#include "blade_scan.h"
+#include "blade_prune.h"
+#include "blade_query.h"
+#include "blade_tree.h"
+#include "blade_layout.h"
+#include "blade_du.h"
+#include "blade_watch.h"
+
 // ==========================================
 // CONFIGURATION
 // ==========================================
 #define MAX_RESULTS 200000
-#define INITIAL_CAPACITY 16384
+#define ENTRY_COMMIT_STEP 16384  // entries committed at a time inside the MAX_RESULTS reservation
 #define THREAD_COUNT 16
+#define HUNT_BATCH_SIZE 64
 #define ARENA_BLOCK_SIZE (32 * 1024 * 1024)
 #define FONT_NAME "Segoe UI"
 #define FONT_SIZE 20
@@ -107,11 +116,26 @@
 #define HEADER_HEIGHT 70
 #define GRID_ITEM_WIDTH 120
 #define GRID_ITEM_HEIGHT 100
+#define GROUP_HEADER_HEIGHT 28
 
 // Limits
 #define MAX_PINNED 20
 #define MAX_HISTORY 5
 
+// Sorting
+#define SORT_MAX_THREADS 16
+#define SORT_PARALLEL_MIN 16384     // below this one thread sorts everything
+#define SORT_RUN 32                 // insertion-sorted run length before merging
+
+// Stacks
+#define STACK_EXT_SLOTS 1024            // power of two; filled at most half way
+#define STACK_DAY 864000000000ULL       // one day in FILETIME (100 ns) units
+
+// Timers
+#define TIMER_REPAINT 1
+#define TIMER_RESCAN 2
+#define HUNT_DEBOUNCE_MS 150    // a keystroke that needs a new hunt waits this long for the next one
+
 // Context menu command IDs
 #define CMD_OPEN            1001
 #define CMD_OPEN_EXPLORER   1002
@@ -153,10 +177,13 @@ typedef enum { STACKMODE_NONE=0, STACKMODE_TIME, STACKMODE_TYPE, STACKMODE_CONTE
 
 
 typedef struct {
-    char *path;
+    char *name;         // full path, or the leaf name when dir != TREE_NONE
+    uint32_t dir;       // node of the containing folder in the hunt's DirTree
     int is_dir;
     unsigned long long size;
     FILETIME write_time;
+    int has_total;      // folder size is its recursive total (blade_du.h)
+    uint64_t path_hash; // du_hash of the full path, 0 until a watch batch needs it
     int is_drive;
     int is_recycled;
     SECTION_TYPE section; // Distinct separation
@@ -167,10 +194,51 @@ typedef struct {
 } Entry;
 
 typedef enum { SORT_NAME=0, SORT_SIZE, SORT_DATE } SORT_MODE;
+
+// Each entry gets a packed key: group (section, stack, folders first), the
+// sort value (size or date inverted so larger sorts first, 0 by name) and the
+// first 8 bytes of the lowercased display name. Keys compare as integers; the
+// full _stricmp runs only when all three tie.
+typedef struct {
+    uint64_t group;
+    uint64_t value;
+    uint64_t name;      // big-endian, so integer order is byte order
+    uint32_t index;     // entry the key was made from
+} SortKey;
 // Avoid name clash with Windows headers (e.g., shlobj.h)
 typedef enum { VIEWMODE_LIST=0, VIEWMODE_GRID } VIEW_MODE;
 typedef enum { CTRL_O_WT=0, CTRL_O_CMD, CTRL_O_EXPLORER } CTRL_O_MODE;
 
+// Steps of a search, run in the order parse_query planned
+typedef enum { SEARCH_STEP_SIZE=0, SEARCH_STEP_EXT, SEARCH_STEP_NAME } SEARCH_STEP;
+
+typedef struct SearchQuery {
+    char name[256];     // free text, compiled into prog
+    char ext[16];       // lowercased, with its leading dot
+    int ext_len;
+    unsigned long long min_size;
+    unsigned long long max_size;
+    int valid;          // prog compiled without overflowing its limits
+    Query prog;
+    char prune[256];    // exclude: / maxdepth: terms, applied by the traversal
+    uint8_t plan[3];    // steps that apply, cheapest first
+    int plan_len;
+    struct SearchQuery *retired;    // predicate this one replaced in a running hunt
+} SearchQuery;
+
+// A hunt's directory tree is used by its workers until on_finish and by the
+// entries it produced until clear_data; whichever lets go last frees it.
+// Typing that narrows the query swaps pred while the hunt runs; workers may
+// still hold the old one, so replaced predicates live until the hunt is freed.
+typedef struct Hunt {
+    long gen;
+    long refs;
+    DirTree *tree;
+    SearchQuery *pred;  // written under data_lock
+    Prune *prune;       // the traversal's pruning, reapplied to paths a watch reports
+    volatile long finished;
+} Hunt;
+
 typedef struct ArenaBlock {
     char *data;
     size_t used;
@@ -178,11 +246,26 @@ typedef struct ArenaBlock {
 } ArenaBlock;
 
 // Global Storage
+// entries is reserved once for MAX_RESULTS and committed as it fills, so it
+// never moves. Appends (under data_lock) write past entry_count and then
+// publish it; the UI thread, which does every in-place rewrite (refine,
+// clear) itself, reads entries [0, entry_count) without taking the lock.
 Entry *entries = NULL;
 volatile long entry_count = 0;
-long entry_capacity = 0;
-CRITICAL_SECTION data_lock;
+long entry_committed = 0;
+CRITICAL_SECTION data_lock;     // serializes writers
+
+// Display order, UI thread only: position pos shows entries[view_keys[pos].index].
+// entries stays in arrival order; new entries are merged into the view as they
+// arrive (view_sync), so a running hunt is always shown sorted.
+SortKey *view_keys = NULL;      // MAX_RESULTS, sorted (see SORTING)
+long view_count = 0;            // entries placed in the view
 ArenaBlock *arena_head = NULL; 
+Hunt *entries_hunt = NULL;  // owner of the dir nodes the current entries point at
+
+static inline Entry *view_entry(long pos) {
+    return &entries[view_keys[pos].index];
+}
 
 // Distinct Favorites Lists
 char pinned_dirs[MAX_PINNED][MAX_PATH];
@@ -195,6 +278,7 @@ int history_count = 0;
 volatile int running = 1;
 volatile long active_workers = 0;
 volatile long search_generation = 0;
+ScanCtx *hunt_ctx = NULL;
 SORT_MODE g_sort_mode = SORT_NAME;
 VIEW_MODE g_view_mode = VIEWMODE_LIST;
 STACK_MODE g_stack_mode = STACKMODE_NONE;
@@ -203,19 +287,25 @@ CTRL_O_MODE g_ctrl_o_mode = CTRL_O_WT;
 char root_path[4096] = {0};
 char search_buffer[256] = {0};
 char g_ini_path[MAX_PATH] = {0};
-int is_wildcard = 0;
+Prune g_prune;      // [Search] pruning from blade.ini, extended per hunt by the query
+
+// Folder sizes: one background du run at a time, finished totals kept by path
+DuRun *du_run = NULL;
+DuCache du_cache;
+volatile long du_dirty = 0;     // totals for the listed folders arrived
+
+// Live updates: the listed folder, or the hunt's root, is watched for changes
+Watch *g_watch = NULL;
+WatchBatch watch_batch;
+WatchSet watch_set;
+WatchNodes watch_nodes;     // path hashes of entries_hunt's folders
 int show_help = 0;
 
 // Copy/paste state
 char g_copy_source[4096] = {0};
 int  g_copy_is_dir = 0;
 
-struct {
-    char name[256];
-    char ext[16];
-    unsigned long long min_size;
-    unsigned long long max_size;
-} query;
+SearchQuery query;  // parsed search_buffer
 
 // UI State
 HWND hMainWnd;
@@ -227,6 +317,7 @@ int window_height = 768;
 int max_visible_items = 0;
 int items_per_row = 1; // For Grid
 int is_truncated = 0;
+long layout_version = 0;    // bumped whenever entries are rewritten in place (see LAYOUT)
 
 // GDI Resources
 HDC hdcBack = NULL;
@@ -236,6 +327,14 @@ HFONT hFontSmall = NULL;
 HFONT hFontMono = NULL;
 HFONT hFontStrike = NULL;
 HFONT hFontBold = NULL;
+// Brushes are created once in WM_CREATE; nothing in the paint path allocates GDI objects
+HBRUSH brBg = NULL;
+HBRUSH brHeader = NULL;
+HBRUSH brAccent = NULL;
+HBRUSH brHover = NULL;
+HBRUSH brHelp = NULL;
+HBRUSH brDir = NULL;
+HBRUSH brDim = NULL;
 
 // ==========================================
 // UTILS & PARSING
@@ -263,23 +362,74 @@ unsigned long long parse_size_str(const char *s) {
     return (unsigned long long)val;
 }
 
-void parse_query() {
-    memset(&query, 0, sizeof(query));
-    char raw[256]; strcpy(raw, search_buffer);
+void parse_query(SearchQuery *q, const char *text) {
+    memset(q, 0, sizeof(*q));
+    char raw[256]; lstrcpynA(raw, text, sizeof(raw));
     char *tok = strtok(raw, " ");
     while (tok) {
         if (strncmp(tok, "ext:", 4) == 0) {
-            strncpy(query.ext, tok+4, 15);
-            for(int i=0; query.ext[i]; i++) query.ext[i] = tolower(query.ext[i]);
-        } else if (tok[0] == '>') query.min_size = parse_size_str(tok+1);
-        else if (tok[0] == '<') query.max_size = parse_size_str(tok+1);
+            // ext:png, ext:.png and ext:*.png are the same filter
+            const char *e = tok + 4;
+            while (*e == '*' || *e == '.') e++;
+            q->ext_len = 0;
+            if (*e) q->ext[q->ext_len++] = '.';
+            while (*e && q->ext_len < (int)sizeof(q->ext) - 1) q->ext[q->ext_len++] = (char)tolower((unsigned char)*e++);
+            q->ext[q->ext_len] = '\0';
+        } else if (strncmp(tok, "exclude:", 8) == 0 || strncmp(tok, "maxdepth:", 9) == 0) {
+            if (q->prune[0]) strcat(q->prune, " ");
+            strcat(q->prune, tok);
+        } else if (tok[0] == '>') q->min_size = parse_size_str(tok+1);
+        else if (tok[0] == '<') q->max_size = parse_size_str(tok+1);
         else {
-            if (query.name[0]) strcat(query.name, " ");
-            strcat(query.name, tok);
+            if (q->name[0]) strcat(q->name, " ");
+            strcat(q->name, tok);
         }
         tok = strtok(NULL, " ");
     }
-    for(int i=0; query.name[i]; i++) query.name[i] = tolower(query.name[i]);
+    q->valid = query_compile(&q->prog, q->name);
+
+    // Cheapest first: two integer compares, one suffix compare, then the name program
+    q->plan_len = 0;
+    if (q->min_size || q->max_size) q->plan[q->plan_len++] = SEARCH_STEP_SIZE;
+    if (q->ext_len) q->plan[q->plan_len++] = SEARCH_STEP_EXT;
+    if (q->prog.clause_count) q->plan[q->plan_len++] = SEARCH_STEP_NAME;
+}
+
+int search_match_size(const SearchQuery *q, unsigned long long size) {
+    if (q->min_size && size < q->min_size) return 0;
+    if (q->max_size && size > q->max_size) return 0;
+    return 1;
+}
+
+// Without have_size (the backend stats lazily) the size step is skipped and left
+// to the caller, so only names that pass everything else are stat'ed
+int search_match(const SearchQuery *q, const char *name, size_t len, unsigned long long size, int have_size) {
+    for (int i = 0; i < q->plan_len; i++) {
+        switch (q->plan[i]) {
+            case SEARCH_STEP_SIZE:
+                if (have_size && !search_match_size(q, size)) return 0;
+                break;
+            case SEARCH_STEP_EXT:
+                if (len < (size_t)q->ext_len || _stricmp(name + len - q->ext_len, q->ext) != 0) return 0;
+                break;
+            case SEARCH_STEP_NAME:
+                if (!query_match(&q->prog, name, len)) return 0;
+                break;
+        }
+    }
+    return 1;
+}
+
+// Nonzero if everything n matches is also matched by o (more characters, an
+// added ext: or a tighter size bound), so n can be applied to o's results.
+// The running traversal was pruned for o, so pruning terms must not change.
+int search_narrows(const SearchQuery *n, const SearchQuery *o) {
+    if (!n->valid || !o->valid || !query_narrows(&n->prog, &o->prog)) return 0;
+    if (strcmp(n->prune, o->prune) != 0) return 0;
+    if (o->ext[0] && strcmp(n->ext, o->ext) != 0) return 0;
+    if (o->min_size && n->min_size < o->min_size) return 0;
+    if (o->max_size && (!n->max_size || n->max_size > o->max_size)) return 0;
+    return 1;
 }
 
 // ==========================================
@@ -308,47 +458,137 @@ const char* get_stack_name(STACK_TYPE type) {
     }
 }
 
+// UI thread, or caller holds data_lock
+size_t entry_path(const Entry *e, char *out, size_t cap) {
+    return tree_join(entries_hunt ? entries_hunt->tree : NULL, e->dir, e->name, strlen(e->name), out, cap);
+}
+
+// Copies the selected entry's full path; 0 if nothing is selected
+int selected_path(char *out, size_t cap) {
+    return selected_index >= 0 && selected_index < view_count && entry_path(view_entry(selected_index), out, cap);
+}
+
+// Extensions map to type stacks through an open-addressed table keyed by the
+// lowercased extension packed into 8 bytes: one multiply, usually one probe.
+// Built from the defaults below, then extended from [Stacks] in blade.ini.
+typedef struct {
+    uint64_t key;       // 0 for an empty slot
+    STACK_TYPE stack;
+} StackExt;
+
+StackExt stack_ext[STACK_EXT_SLOTS];
+int stack_ext_count = 0;
+uint64_t stack_now = 0;     // "now" the time buckets are measured from
+
+static const struct { STACK_TYPE stack; const char *exts; } stack_ext_defaults[] = {
+    { STACK_IMAGES,   "png jpg jpeg gif bmp webp" },
+    { STACK_PDFS,     "pdf" },
+    { STACK_ARCHIVES, "zip rar 7z tar gz" },
+    { STACK_DOCS,     "doc docx txt rtf odt" },
+    { STACK_AUDIO,    "mp3 wav flac ogg" },
+    { STACK_VIDEO,    "mp4 mkv avi mov" },
+    { STACK_CODE,     "c h cpp py js html css json" },
+    { STACK_EXEC,     "exe msi bat cmd ps1" },
+};
+
+// Extensions longer than 8 bytes have no key (0) and are never typed
+static uint64_t stack_ext_key(const char *ext, size_t len) {
+    if (len == 0 || len > 8) return 0;
+    uint64_t key = 0;
+    for (size_t i = 0; i < len; i++) key |= (uint64_t)(unsigned char)tolower((unsigned char)ext[i]) << (8 * i);
+    return key;
+}
+
+static uint32_t stack_ext_slot(uint64_t key) {
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 54) & (STACK_EXT_SLOTS - 1);
+}
+
+void stack_ext_add(uint64_t key, STACK_TYPE stack) {
+    if (!key) return;
+    for (uint32_t i = stack_ext_slot(key);; i = (i + 1) & (STACK_EXT_SLOTS - 1)) {
+        if (stack_ext[i].key == key) { stack_ext[i].stack = stack; return; }
+        if (!stack_ext[i].key) {
+            if (stack_ext_count >= STACK_EXT_SLOTS / 2) return;
+            stack_ext[i].key = key;
+            stack_ext[i].stack = stack;
+            stack_ext_count++;
+            return;
+        }
+    }
+}
+
+STACK_TYPE stack_ext_find(uint64_t key) {
+    if (!key) return STACK_OTHER;
+    for (uint32_t i = stack_ext_slot(key);; i = (i + 1) & (STACK_EXT_SLOTS - 1)) {
+        if (stack_ext[i].key == key) return stack_ext[i].stack;
+        if (!stack_ext[i].key) return STACK_OTHER;
+    }
+}
+
+// "png jpg", ".png,.jpg" and "*.png;*.jpg" all work
+void stack_ext_add_list(const char *list, STACK_TYPE stack) {
+    const char *p = list;
+    while (*p) {
+        while (*p == ' ' || *p == ',' || *p == ';' || *p == '\t') p++;
+        while (*p == '*' || *p == '.') p++;
+        const char *start = p;
+        while (*p && *p != ' ' && *p != ',' && *p != ';' && *p != '\t') p++;
+        if (p > start) stack_ext_add(stack_ext_key(start, (size_t)(p - start)), stack);
+    }
+}
+
+// Defaults first, then one key per type stack in [Stacks], e.g. Code=rs go ts
+void stack_ext_load(const char *ini_path) {
+    memset(stack_ext, 0, sizeof(stack_ext));
+    stack_ext_count = 0;
+    for (size_t i = 0; i < sizeof(stack_ext_defaults) / sizeof(stack_ext_defaults[0]); i++) {
+        stack_ext_add_list(stack_ext_defaults[i].exts, stack_ext_defaults[i].stack);
+    }
+    for (int t = STACK_IMAGES; t <= STACK_EXEC; t++) {
+        char buf[1024] = {0};
+        GetPrivateProfileStringA("Stacks", get_stack_name((STACK_TYPE)t), "", buf, sizeof(buf), ini_path);
+        stack_ext_add_list(buf, (STACK_TYPE)t);
+    }
+}
+
+// Taken once per listing, hunt or stack switch rather than once per entry
+void stack_clock_refresh() {
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    stack_now = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+// Branch-free: the bucket is the number of boundaries the age has passed.
+// Files written after stack_now was taken (during a long hunt) count as Today.
+static inline STACK_TYPE stack_time_bucket(const FILETIME *ft) {
+    uint64_t t = ((uint64_t)ft->dwHighDateTime << 32) | ft->dwLowDateTime;
+    uint64_t diff = t >= stack_now ? 0 : stack_now - t;
+    int passed = (diff >= STACK_DAY) + (diff >= STACK_DAY * 2) + (diff >= STACK_DAY * 7) +
+                 (diff >= STACK_DAY * 30) + (diff >= STACK_DAY * 60);   // 30 days is a rough month
+    return (STACK_TYPE)(STACK_TODAY + passed);
+}
+
 STACK_TYPE get_stack_type(const Entry *e, STACK_MODE mode) {
     if (mode == STACKMODE_NONE) return STACK_NONE;
     
     if (mode == STACKMODE_TIME) {
-        SYSTEMTIME st; GetLocalTime(&st);
-        FILETIME ftNow; SystemTimeToFileTime(&st, &ftNow);
-        ULARGE_INTEGER ulNow = {ftNow.dwLowDateTime, ftNow.dwHighDateTime};
-        ULARGE_INTEGER ulFile = {e->write_time.dwLowDateTime, e->write_time.dwHighDateTime};
-        
-        unsigned long long diff = ulNow.QuadPart - ulFile.QuadPart;
-        unsigned long long one_day = 864000000000ULL; // 100ns intervals
-        
-        if (diff < one_day) return STACK_TODAY;
-        if (diff < one_day * 2) return STACK_YESTERDAY;
-        if (diff < one_day * 7) return STACK_THIS_WEEK;
-        if (diff < one_day * 30) return STACK_EARLIER_THIS_MONTH; // Rough approx
-        if (diff < one_day * 60) return STACK_LAST_MONTH;
-        return STACK_OLDER;
+        if (!stack_now) stack_clock_refresh();
+        return stack_time_bucket(&e->write_time);
     }
     
     if (mode == STACKMODE_TYPE) {
         if (e->is_dir) return STACK_OTHER;
-        const char *ext = strrchr(e->path, '.');
+        const char *ext = strrchr(e->name, '.');
         if (!ext) return STACK_OTHER;
-        
-        if (stristr(ext, ".png") || stristr(ext, ".jpg") || stristr(ext, ".jpeg") || stristr(ext, ".gif") || stristr(ext, ".bmp") || stristr(ext, ".webp")) return STACK_IMAGES;
-        if (stristr(ext, ".pdf")) return STACK_PDFS;
-        if (stristr(ext, ".zip") || stristr(ext, ".rar") || stristr(ext, ".7z") || stristr(ext, ".tar") || stristr(ext, ".gz")) return STACK_ARCHIVES;
-        if (stristr(ext, ".doc") || stristr(ext, ".docx") || stristr(ext, ".txt") || stristr(ext, ".rtf") || stristr(ext, ".odt")) return STACK_DOCS;
-        if (stristr(ext, ".mp3") || stristr(ext, ".wav") || stristr(ext, ".flac") || stristr(ext, ".ogg")) return STACK_AUDIO;
-        if (stristr(ext, ".mp4") || stristr(ext, ".mkv") || stristr(ext, ".avi") || stristr(ext, ".mov")) return STACK_VIDEO;
-        if (stristr(ext, ".c") || stristr(ext, ".h") || stristr(ext, ".cpp") || stristr(ext, ".py") || stristr(ext, ".js") || stristr(ext, ".html") || stristr(ext, ".css") || stristr(ext, ".json")) return STACK_CODE;
-        if (stristr(ext, ".exe") || stristr(ext, ".msi") || stristr(ext, ".bat") || stristr(ext, ".cmd") || stristr(ext, ".ps1")) return STACK_EXEC;
-        
-        return STACK_OTHER;
+        return stack_ext_find(stack_ext_key(ext + 1, strlen(ext + 1)));
     }
 
     if (mode == STACKMODE_CONTEXT) {
         // Simple heuristic based on path keywords
-        if (stristr(e->path, "Work") || stristr(e->path, "Project") || stristr(e->path, "Office") || stristr(e->path, "Client")) return STACK_WORK;
-        if (stristr(e->path, "Personal") || stristr(e->path, "Game") || stristr(e->path, "Photo") || stristr(e->path, "Music")) return STACK_PERSONAL;
+        char path[4096];
+        if (!entry_path(e, path, sizeof(path))) return STACK_OTHER;
+        if (stristr(path, "Work") || stristr(path, "Project") || stristr(path, "Office") || stristr(path, "Client")) return STACK_WORK;
+        if (stristr(path, "Personal") || stristr(path, "Game") || stristr(path, "Photo") || stristr(path, "Music")) return STACK_PERSONAL;
         return STACK_OTHER;
     }
 
@@ -473,35 +713,73 @@ void load_settings() {
     if (_stricmp(buf, "cmd") == 0) g_ctrl_o_mode = CTRL_O_CMD;
     else if (_stricmp(buf, "explorer") == 0) g_ctrl_o_mode = CTRL_O_EXPLORER;
     else g_ctrl_o_mode = CTRL_O_WT;
+    stack_ext_load(g_ini_path);
+
+    char list[1024] = {0};
+    prune_init(&g_prune);
+    GetPrivateProfileStringA("Search", "Exclude", "", list, sizeof(list), g_ini_path);
+    prune_add_exclude_list(&g_prune, list);
+    g_prune.ignore_files = GetPrivateProfileIntA("Search", "IgnoreFiles", 0, g_ini_path) != 0;
+    g_prune.same_fs = GetPrivateProfileIntA("Search", "SameFilesystem", 0, g_ini_path) != 0;
 }
 
 // ==========================================
 // DATA MANAGEMENT
 // ==========================================
+Hunt *hunt_create(long gen, const SearchQuery *q) {
+    Hunt *h = (Hunt*)calloc(1, sizeof(Hunt));
+    if (!h) return NULL;
+    h->tree = tree_create();
+    h->pred = (SearchQuery*)malloc(sizeof(SearchQuery));
+    if (!h->tree || !h->pred) { tree_free(h->tree); free(h->pred); free(h); return NULL; }
+    *h->pred = *q;
+    h->pred->retired = NULL;
+    h->gen = gen;
+    h->refs = 1;
+    return h;
+}
+
+void hunt_release(Hunt *h) {
+    if (h && InterlockedDecrement(&h->refs) == 0) {
+        tree_free(h->tree);
+        free(h->prune);
+        while (h->pred) { SearchQuery *next = h->pred->retired; free(h->pred); h->pred = next; }
+        free(h);
+    }
+}
+
 void clear_data() {
     EnterCriticalSection(&data_lock);
     arena_free_all(); 
-    entry_count = 0; selected_index = 0; scroll_offset = 0; is_truncated = 0;
+    hunt_release(entries_hunt);
+    entries_hunt = NULL;
+    watch_nodes_reset(&watch_nodes);
+    entry_count = 0; view_count = 0; selected_index = 0; scroll_offset = 0; is_truncated = 0;
+    stack_clock_refresh();
+    layout_version++;
     LeaveCriticalSection(&data_lock);
 }
 
-void add_entry_ex(const char *full, int dir, unsigned long long sz, const FILETIME *ft, 
+// Caller holds data_lock. text is the full path, or the leaf name inside folder node dir.
+// The entry is complete before entry_count moves past it.
+Entry *add_entry_locked(uint32_t dir_node, const char *text, int dir, int recycled, unsigned long long sz, const FILETIME *ft, 
                  int is_drive, SECTION_TYPE sec, unsigned long long tot, unsigned long long free_b, const char *fs) {
-    if (entry_count >= MAX_RESULTS) { is_truncated = 1; return; }
+    if (entry_count >= MAX_RESULTS) { is_truncated = 1; return NULL; }
 
-    EnterCriticalSection(&data_lock);
-    if (entry_count >= entry_capacity) {
-        long new_cap = entry_capacity ? entry_capacity + (entry_capacity / 2) : INITIAL_CAPACITY;
-        Entry *new_ptr = (Entry*)realloc(entries, new_cap * sizeof(Entry));
-        if (new_ptr) { entries = new_ptr; entry_capacity = new_cap; }
-        else { LeaveCriticalSection(&data_lock); return; }
+    if (entry_count >= entry_committed) {
+        long step = MAX_RESULTS - entry_committed < ENTRY_COMMIT_STEP ? MAX_RESULTS - entry_committed : ENTRY_COMMIT_STEP;
+        if (!VirtualAlloc(entries + entry_committed, step * sizeof(Entry), MEM_COMMIT, PAGE_READWRITE)) return NULL;
+        entry_committed += step;
     }
 
-    Entry *e = &entries[entry_count++];
-    e->path = arena_alloc_str(full);
+    Entry *e = &entries[entry_count];
+    e->name = arena_alloc_str(text);
+    e->dir = dir_node;
     e->is_dir = dir;
     e->size = sz;
-    e->is_recycled = (stristr(full, "$Recycle.Bin") || stristr(full, "\\RECYCLER\\")) ? 1 : 0;
+    e->has_total = 0;
+    e->path_hash = 0;
+    e->is_recycled = (recycled || stristr(text, "$Recycle.Bin") || stristr(text, "\\RECYCLER\\")) ? 1 : 0;
     e->section = sec;
     if (ft) e->write_time = *ft; else memset(&e->write_time, 0, sizeof(FILETIME));
     e->is_drive = is_drive;
@@ -510,85 +788,375 @@ void add_entry_ex(const char *full, int dir, unsigned long long sz, const FILETI
         e->total_bytes = tot; e->free_bytes = free_b;
         strncpy(e->fs_name, fs ? fs : "", 7);
     }
+    __atomic_store_n(&entry_count, entry_count + 1, __ATOMIC_RELEASE);
+    return e;
+}
+
+void add_entry_ex(const char *full, int dir, unsigned long long sz, const FILETIME *ft, 
+                 int is_drive, SECTION_TYPE sec, unsigned long long tot, unsigned long long free_b, const char *fs) {
+    if (entry_count >= MAX_RESULTS) { is_truncated = 1; return; }
+    EnterCriticalSection(&data_lock);
+    add_entry_locked(TREE_NONE, full, dir, 0, sz, ft, is_drive, sec, tot, free_b, fs);
     LeaveCriticalSection(&data_lock);
 }
 
 void update_stacks() {
     EnterCriticalSection(&data_lock);
-    for (int i = 0; i < entry_count; i++) {
+    stack_clock_refresh();
+    for (long i = 0; i < entry_count; i++) {
         entries[i].stack = get_stack_type(&entries[i], g_stack_mode);
     }
+    layout_version++;
     LeaveCriticalSection(&data_lock);
 }
 
 // ==========================================
-// MATCHING & SORTING
+// SORTING
 // ==========================================
-int fast_glob_match(const char *text, const char *pattern) {
-    while (*pattern) {
-        if (*pattern == '*') {
-            while (*pattern == '*') pattern++;
-            if (!*pattern) return 1;
-            while (*text) { if (fast_glob_match(text, pattern)) return 1; text++; }
-            return 0;
+static const char* get_display_name(const char *path) {
+    const char *slash = strrchr(path, '\\');
+    return (slash && slash[1] != '\0') ? slash + 1 : path;
+}
+
+void sort_key_make(SortKey *k, const Entry *e, uint32_t index) {
+    k->group = ((uint64_t)e->section << 40) | ((uint64_t)(g_stack_mode != STACKMODE_NONE ? e->stack : 0) << 8) | (e->is_dir ? 0 : 1);
+    if (g_sort_mode == SORT_SIZE) k->value = ~(uint64_t)e->size;
+    else if (g_sort_mode == SORT_DATE) k->value = ~(((uint64_t)e->write_time.dwHighDateTime << 32) | e->write_time.dwLowDateTime);
+    else k->value = 0;
+    const unsigned char *n = (const unsigned char*)get_display_name(e->name);
+    uint64_t prefix = 0;
+    int i = 0;
+    for (; i < 8 && n[i]; i++) prefix = (prefix << 8) | (unsigned char)tolower(n[i]);
+    k->name = prefix << (8 * (8 - i));
+    k->index = index;
+}
+
+static int sort_key_cmp(const SortKey *a, const SortKey *b) {
+    if (a->group != b->group) return a->group < b->group ? -1 : 1;
+    if (a->value != b->value) return a->value < b->value ? -1 : 1;
+    if (a->name != b->name) return a->name < b->name ? -1 : 1;
+    int c = _stricmp(get_display_name(entries[a->index].name), get_display_name(entries[b->index].name));
+    if (c) return c;
+    return (a->index > b->index) - (a->index < b->index);
+}
+
+static void sort_merge(const SortKey *src, SortKey *dst, long begin, long mid, long end) {
+    long i = begin, j = mid, k = begin;
+    while (i < mid && j < end) dst[k++] = (sort_key_cmp(&src[j], &src[i]) < 0) ? src[j++] : src[i++];
+    while (i < mid) dst[k++] = src[i++];
+    while (j < end) dst[k++] = src[j++];
+}
+
+// Sorts keys[begin, end) using tmp as scratch; the result ends up in keys
+static void sort_run_merge(SortKey *keys, SortKey *tmp, long begin, long end) {
+    for (long r = begin; r < end; r += SORT_RUN) {
+        long stop = r + SORT_RUN < end ? r + SORT_RUN : end;
+        for (long i = r + 1; i < stop; i++) {
+            SortKey k = keys[i];
+            long j = i;
+            while (j > r && sort_key_cmp(&k, &keys[j - 1]) < 0) { keys[j] = keys[j - 1]; j--; }
+            keys[j] = k;
         }
-        if (tolower((unsigned char)*text) != tolower((unsigned char)*pattern) && *pattern != '?') return 0;
-        if (!*text) return 0;
-        text++; pattern++;
-    }
-    return !*text;
-}
-
-__forceinline int avx2_strcasestr(const char *haystack, const char *needle, size_t needle_len) {
-    if (needle_len == 0) return 1;
-    char first_char = tolower(needle[0]);
-    __m256i vec_first = _mm256_set1_epi8(first_char);
-    __m256i vec_case_mask = _mm256_set1_epi8(0x20);
-    for (size_t i = 0; haystack[i]; i += 32) {
-        __m256i block = _mm256_loadu_si256((const __m256i*)(haystack + i));
-        __m256i block_lower = _mm256_or_si256(block, vec_case_mask);
-        unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(vec_first, block_lower));
-        while (mask) {
-            int bit_pos = __builtin_ctz(mask);
-            if (_strnicmp(haystack + i + bit_pos, needle, needle_len) == 0) return 1;
-            mask &= ~(1 << bit_pos);
+    }
+    SortKey *src = keys, *dst = tmp;
+    for (long width = SORT_RUN; width < end - begin; width *= 2) {
+        for (long lo = begin; lo < end; lo += 2 * width) {
+            long mid = lo + width < end ? lo + width : end;
+            long hi = lo + 2 * width < end ? lo + 2 * width : end;
+            sort_merge(src, dst, lo, mid, hi);
         }
+        SortKey *t = src; src = dst; dst = t;
     }
-    return 0;
+    if (src != keys) memcpy(keys + begin, src + begin, (end - begin) * sizeof(SortKey));
 }
 
-static const char* get_display_name(const char *path) {
-    const char *slash = strrchr(path, '\\');
-    return (slash && slash[1] != '\0') ? slash + 1 : path;
+// A task either builds and sorts the keys of [begin, end) (entry base + i for
+// key i) or merges the sorted runs [begin, mid) and [mid, end) of src into dst
+typedef struct {
+    SortKey *src, *dst;
+    long begin, mid, end;
+    long base;
+    int merge;
+} SortTask;
+
+void sort_task_run(SortTask *t) {
+    if (t->merge) { sort_merge(t->src, t->dst, t->begin, t->mid, t->end); return; }
+    for (long i = t->begin; i < t->end; i++) sort_key_make(&t->src[i], &entries[t->base + i], (uint32_t)(t->base + i));
+    sort_run_merge(t->src, t->dst, t->begin, t->end);
 }
 
-int __cdecl entry_cmp(const void *pa, const void *pb) {
-    const Entry *a = (const Entry*)pa;
-    const Entry *b = (const Entry*)pb;
-    
-    // Sort by section first
-    if (a->section != b->section) return a->section - b->section;
+unsigned __stdcall sort_thread(void *arg) {
+    sort_task_run((SortTask*)arg);
+    return 0;
+}
 
-    // Sort by Stack if active
-    if (g_stack_mode != STACKMODE_NONE) {
-        if (a->stack != b->stack) return a->stack - b->stack;
+// Runs tasks[0..n) with tasks[0] on the calling thread
+void sort_run_tasks(SortTask *tasks, int n) {
+    HANDLE threads[SORT_MAX_THREADS];
+    int started = 0;
+    for (int k = 1; k < n; k++) {
+        HANDLE h = (HANDLE)_beginthreadex(NULL, 0, sort_thread, &tasks[k], 0, NULL);
+        if (h) threads[started++] = h;
+        else sort_task_run(&tasks[k]);
     }
+    sort_task_run(&tasks[0]);
+    if (started) WaitForMultipleObjects(started, threads, TRUE, INFINITE);
+    for (int k = 0; k < started; k++) CloseHandle(threads[k]);
+}
 
-    // Folders before files
-    if (a->is_dir != b->is_dir) return b->is_dir - a->is_dir;
+int sort_thread_count() {
+    static int count = 0;
+    if (!count) {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        count = (int)si.dwNumberOfProcessors;
+        if (count < 1) count = 1;
+        if (count > SORT_MAX_THREADS) count = SORT_MAX_THREADS;
+    }
+    return count;
+}
 
-    switch (g_sort_mode) {
-        case SORT_SIZE: if (a->size != b->size) return (b->size > a->size) ? 1 : -1; break;
-        case SORT_DATE: { LONG c = CompareFileTime(&a->write_time, &b->write_time); if (c!=0) return -c; break; }
+// Sorted keys of entries [base, base + n): one run per thread, then rounds of
+// pairwise merges that also run in parallel. Returns keys or tmp, whichever
+// holds the result.
+SortKey *sort_keys(SortKey *keys, SortKey *tmp, long base, long n) {
+    int threads = n >= SORT_PARALLEL_MIN ? sort_thread_count() : 1;
+    long bounds[SORT_MAX_THREADS + 1];
+    SortTask tasks[SORT_MAX_THREADS];
+    long per = (n + threads - 1) / threads;
+    for (int k = 0; k <= threads; k++) bounds[k] = per * k < n ? per * k : n;
+    for (int k = 0; k < threads; k++) {
+        tasks[k] = (SortTask){ keys, tmp, bounds[k], 0, bounds[k + 1], base, 0 };
+    }
+    sort_run_tasks(tasks, threads);
+
+    SortKey *src = keys, *dst = tmp;
+    for (int runs = threads; runs > 1; runs = (runs + 1) / 2) {
+        int n_tasks = 0;
+        for (int k = 0; k < runs; k += 2) {
+            long end = bounds[k + 2 <= runs ? k + 2 : runs];
+            tasks[n_tasks++] = (SortTask){ src, dst, bounds[k], k + 1 < runs ? bounds[k + 1] : end, end, base, 1 };
+            bounds[k / 2] = bounds[k];
+        }
+        bounds[(runs + 1) / 2] = n;
+        sort_run_tasks(tasks, n_tasks);
+        SortKey *t = src; src = dst; dst = t;
     }
-    return _stricmp(get_display_name(a->path), get_display_name(b->path));
+    return src;
 }
 
+// UI thread. Rebuilds the view for the current sort and stack modes. Entries
+// themselves never move, so no lock is needed: hunters only append past
+// entry_count and view_sync picks those up.
 void sort_entries() {
+    long n = entry_count;
+    SortKey *tmp = n > 1 ? (SortKey*)malloc(n * sizeof(SortKey)) : NULL;
+    if (n <= 1 || tmp) {
+        SortKey *sorted = n > 0 ? sort_keys(view_keys, tmp, 0, n) : view_keys;
+        if (sorted != view_keys) memcpy(view_keys, sorted, n * sizeof(SortKey));
+        view_count = n;
+        layout_version++;
+    }
+    free(tmp);
+    InvalidateRect(hMainWnd, NULL, FALSE);
+}
+
+// UI thread. Merges entries that arrived since the last call into the view:
+// the batch is sorted on its own, then merged from the back, each key finding
+// its place with a binary search (O(batch log n) comparisons) and every view
+// key moving at most once. The selection stays on the entry it was on.
+// Returns the first view position that changed, view_count if none did.
+long view_sync() {
+    long n = entry_count;
+    long b = n - view_count;
+    if (b <= 0) return view_count;
+    SortKey *keys = (SortKey*)malloc(b * sizeof(SortKey));
+    SortKey *tmp = keys ? (SortKey*)malloc(b * sizeof(SortKey)) : NULL;
+    if (!tmp) { free(keys); return view_count; }
+    const SortKey *batch = sort_keys(keys, tmp, view_count, b);
+
+    long hi = view_count;
+    long sel = selected_index, sel_shift = 0;
+    for (long k = b - 1; k >= 0; k--) {
+        long lo = 0, top = hi;
+        while (lo < top) { long mid = lo + (top - lo) / 2; if (sort_key_cmp(&view_keys[mid], &batch[k]) <= 0) lo = mid + 1; else top = mid; }
+        memmove(&view_keys[lo + k + 1], &view_keys[lo], (hi - lo) * sizeof(SortKey));
+        view_keys[lo + k] = batch[k];
+        if (lo <= sel) sel_shift++;
+        hi = lo;
+    }
+    if (sel < view_count) selected_index = (int)(sel + sel_shift);
+    view_count = n;
+    free(keys); free(tmp);
+    return hi;
+}
+
+// ==========================================
+// FOLDER SIZES (see blade_du.h)
+// ==========================================
+// UI thread. Gives listed folders their cached recursive size; returns how many changed.
+long du_apply() {
+    long changed = 0;
     EnterCriticalSection(&data_lock);
-    if (entry_count > 1) qsort(entries, entry_count, sizeof(Entry), entry_cmp);
+    for (long i = 0; i < entry_count; i++) {
+        Entry *e = &entries[i];
+        if (!e->is_dir || e->is_drive || e->section != SEC_NONE || e->dir != TREE_NONE) continue;
+        uint64_t mtime = ((uint64_t)e->write_time.dwHighDateTime << 32) | e->write_time.dwLowDateTime;
+        DuCacheSlot c;
+        if (!du_cache_get(&du_cache, du_hash(e->name, strlen(e->name)), mtime, &c)) continue;
+        if (e->has_total && e->size == c.bytes) continue;
+        e->size = c.bytes;
+        e->has_total = 1;
+        changed++;
+    }
     LeaveCriticalSection(&data_lock);
-    InvalidateRect(hMainWnd, NULL, FALSE);
+    return changed;
+}
+
+// Worker threads: every finished folder is cached, so opening any of them later is instant
+void du_done(DuRun *run, const DuNode *n) {
+    du_cache_put(&du_cache, n);
+    if (n->depth <= 1) InterlockedExchange(&du_dirty, 1);
+}
+
+// F8: sizes every folder below the current one and sorts them largest first
+void du_start_current() {
+    if (!root_path[0]) return;
+    if (du_run) { du_cancel(du_run); du_free(du_run); du_run = NULL; }
+    WIN32_FILE_ATTRIBUTE_DATA fa;
+    uint64_t mtime = 0;
+    if (GetFileAttributesExA(root_path, GetFileExInfoStandard, &fa)) mtime = ((uint64_t)fa.ftLastWriteTime.dwHighDateTime << 32) | fa.ftLastWriteTime.dwLowDateTime;
+    g_sort_mode = SORT_SIZE;
+    sort_entries();
+    du_run = du_start(root_path, mtime, THREAD_COUNT, &g_prune, du_done, NULL);
+}
+
+// Timer: folds totals that arrived into the listing
+void du_poll() {
+    if (!InterlockedExchange(&du_dirty, 0) || search_buffer[0]) return;
+    if (du_apply() > 0) {
+        sort_entries();
+        InvalidateRect(hMainWnd, NULL, FALSE);
+    }
+}
+
+// ==========================================
+// LIVE UPDATES (see blade_watch.h)
+// ==========================================
+// Watches path (its whole subtree when recursive), reusing the current watch if
+// it already covers exactly that; NULL stops watching
+void watch_follow(const char *path, int recursive) {
+    if (g_watch && path && strcmp(g_watch->root, path) == 0 && g_watch->recursive == recursive) return;
+    watch_stop(g_watch);
+    g_watch = path && path[0] ? watch_start(path, recursive) : NULL;
+}
+
+// Caller holds data_lock. The entry's path hash, from its folder's memoized hash.
+uint64_t entry_hash(Entry *e) {
+    if (!e->path_hash) {
+        const char *name = e->name;
+        if (e->dir == TREE_NONE) e->path_hash = du_hash(name, strlen(name));
+        else {
+            uint64_t dir = entries_hunt ? watch_node_hash(&watch_nodes, entries_hunt->tree, e->dir) : 0;
+            if (dir) e->path_hash = du_hash_child(dir, name, strlen(name));
+        }
+    }
+    return e->path_hash;
+}
+
+// Nonzero if a component of path past root_len starts with '.'; hunts and
+// listings both leave those out
+int path_hidden(const char *path, size_t root_len) {
+    for (size_t i = root_len; path[i]; i++) {
+        if ((i == root_len || path[i - 1] == '\\' || path[i - 1] == '/') && path[i] == '.') return 1;
+    }
+    return 0;
+}
+
+// Caller holds data_lock. Nonzero if a folder above e is gone in the batch.
+int entry_below_gone(Entry *e) {
+    if (e->dir == TREE_NONE) return watch_path_gone(&watch_set, e->name, strlen(e->name));
+    return entries_hunt && watch_node_gone(&watch_nodes, entries_hunt->tree, &watch_set, e->dir);
+}
+
+// Timer: patches the listing, or the finished hunt's results, with what changed
+// on disk. One pass over the entries drops the ones whose path is gone,
+// refreshes the ones that changed and re-tests them against the query; paths
+// no entry had are then added if the listing or the query takes them. A hunt
+// still running is left alone (it may reach those paths itself) and its
+// changes wait in the queue until it finishes.
+void watch_poll() {
+    if (!g_watch) return;
+    Hunt *h = entries_hunt;
+    if (h && !__atomic_load_n(&h->finished, __ATOMIC_ACQUIRE)) return;
+    if (!watch_take(g_watch, &watch_batch)) return;
+    if (watch_batch.overflow || !watch_set_build(&watch_set, &watch_batch)) {
+        SetTimer(hMainWnd, TIMER_RESCAN, HUNT_DEBOUNCE_MS, NULL);   // changes were lost: list or hunt again
+        return;
+    }
+    const SearchQuery *q = h ? h->pred : NULL;
+
+    long changed = 0, kept = 0;
+    long sel = selected_index >= 0 && selected_index < view_count ? (long)view_keys[selected_index].index : -1;
+    EnterCriticalSection(&data_lock);
+    stack_clock_refresh();
+    watch_nodes_batch(&watch_nodes);
+    for (long i = 0; i < entry_count; i++) {
+        Entry *e = &entries[i];
+        if (e->section != SEC_NONE) { entries[kept++] = *e; continue; }
+        WatchSlot *s = watch_set_find(&watch_set, entry_hash(e));
+        int drop = 0;
+        if (s) {
+            s->seen = 1;
+            if (s->state == WATCH_GONE) drop = 1;
+            else {
+                e->is_dir = s->state == WATCH_DIR;
+                if (!e->has_total || !e->is_dir) e->size = s->size;
+                e->write_time.dwLowDateTime = (DWORD)s->mtime;
+                e->write_time.dwHighDateTime = (DWORD)(s->mtime >> 32);
+                e->stack = get_stack_type(e, g_stack_mode);
+                const char *name = get_display_name(e->name);
+                drop = q && !search_match(q, name, strlen(name), e->size, 1);
+                changed++;
+            }
+        } else if (watch_set.gone && entry_below_gone(e)) drop = 1;
+
+        if (drop) { changed++; if (i == sel) sel = -1; continue; }
+        if (i == sel) sel = kept;
+        if (kept != i) entries[kept] = *e;
+        kept++;
+    }
+    if (kept != entry_count) {
+        entry_count = kept;
+        view_count = 0;     // indices moved; the view is rebuilt below
+    }
+
+    // New paths. A listing only holds its folder's children (the watch is not
+    // recursive); neither it nor a hunt takes dot files or anything below a dot folder.
+    for (uint32_t k = 0; k < watch_set.cap; k++) {
+        WatchSlot *s = &watch_set.slots[k];
+        if (!s->hash || s->seen || s->state == WATCH_GONE) continue;
+        const char *name = get_display_name(s->path);
+        size_t len = strlen(name);
+        if (path_hidden(s->path, g_watch->root_len)) continue;
+        if (h) {
+            if (!search_match(q, name, len, s->size, 1)) continue;
+            if (h->prune && prune_path(h->prune, g_watch->root_len, s->path, s->len, s->state == WATCH_DIR)) continue;
+        }
+        FILETIME ft = { (DWORD)s->mtime, (DWORD)(s->mtime >> 32) };
+        if (!add_entry_locked(TREE_NONE, s->path, s->state == WATCH_DIR, 0, s->size, &ft, 0, SEC_NONE, 0, 0, NULL)) break;
+        changed++;
+    }
+    LeaveCriticalSection(&data_lock);
+    if (!changed) return;
+
+    // Sizes and dates moved too, so the view is sorted again rather than merged
+    if (!h) du_apply();
+    sort_entries();
+    selected_index = 0;
+    for (long pos = 0; sel >= 0 && pos < view_count; pos++) {
+        if ((long)view_keys[pos].index == sel) { selected_index = (int)pos; break; }
+    }
 }
 
 // ==========================================
@@ -596,18 +1164,22 @@ void sort_entries() {
 // ==========================================
 void list_directory(const char *path) {
     clear_data();
-    char spec[4096]; snprintf(spec, 4096, "%s\\*", path);
-    WIN32_FIND_DATAA fd;
-    HANDLE hFind = FindFirstFileExA(spec, FindExInfoBasic, &fd, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
-    if (hFind != INVALID_HANDLE_VALUE) {
-        do {
-            if (fd.cFileName[0] == '.') continue;
-            char full[4096]; snprintf(full, 4096, "%s\\%s", path, fd.cFileName);
-            unsigned long long sz = ((unsigned long long)fd.nFileSizeHigh << 32) | fd.nFileSizeLow;
-            add_entry_ex(full, (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY), sz, &fd.ftLastWriteTime, 0, SEC_NONE, 0, 0, NULL);
-        } while (FindNextFileA(hFind, &fd));
-        FindClose(hFind);
+    FsDir *d = fs_dir_alloc(NULL);
+    if (d && fs_open(d, FS_NO_FD, path, path)) {
+        int n;
+        while ((n = fs_read(d)) > 0) {
+            for (int i = 0; i < n; i++) {
+                FsEntry *e = &d->batch[i];
+                if (e->name[0] == '.' || !fs_stat(d, e)) continue;
+                char full[4096]; snprintf(full, 4096, "%s\\%s", path, e->name);
+                FILETIME ft = { (DWORD)e->mtime, (DWORD)(e->mtime >> 32) };
+                add_entry_ex(full, e->type == FS_TYPE_DIR, e->size, &ft, 0, SEC_NONE, 0, 0, NULL);
+            }
+        }
+        fs_close(d, 0);
     }
+    fs_dir_free(d);
+    du_apply();
     sort_entries();
 }
 
@@ -659,76 +1231,262 @@ void list_home_view() {
     InvalidateRect(hMainWnd, NULL, FALSE);
 }
 
-void scan_recursive(char *path, long gen) {
-    if (gen != search_generation || !running) return;
-    char spec[4096]; snprintf(spec, 4096, "%s\\*", path);
-    WIN32_FIND_DATAA fd;
-    HANDLE hFind = FindFirstFileExA(spec, FindExInfoBasic, &fd, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
-    if (hFind == INVALID_HANDLE_VALUE) return;
-
-    size_t name_len = strlen(query.name);
-    do {
-        if (gen != search_generation) break;
-        if (fd.cFileName[0] == '.') continue;
-        int match = 0;
-        if (name_len == 0) match = 1; 
-        else match = is_wildcard ? fast_glob_match(fd.cFileName, query.name) : avx2_strcasestr(fd.cFileName, query.name, name_len);
-
-        if (match && query.ext[0]) {
-            const char *dot = strrchr(fd.cFileName, '.');
-            if (!dot || _stricmp(dot, query.ext) != 0) match = 0;
-        }
-        unsigned long long sz = ((unsigned long long)fd.nFileSizeHigh << 32) | fd.nFileSizeLow;
-        if (match && query.min_size && sz < query.min_size) match = 0;
-        if (match && query.max_size && sz > query.max_size) match = 0;
+// ==========================================
+// HUNTER MODE (one shared traversal, see blade_scan.h)
+// ==========================================
+// Matches are collected per worker and committed a batch at a time, so a
+// worker takes data_lock once per batch rather than once per match
+typedef struct {
+    const SearchQuery *pred;    // predicate the match was tested with
+    uint32_t dir;
+    uint32_t name;              // offset into HuntBatch.text
+    int is_dir;
+    int recycled;
+    unsigned long long size;
+    FILETIME ft;
+} HuntMatch;
 
-        char full[4096]; snprintf(full, 4096, "%s\\%s", path, fd.cFileName);
-        int is_dir = (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY);
-        if (match) add_entry_ex(full, is_dir, sz, &fd.ftLastWriteTime, 0, SEC_NONE, 0, 0, NULL);
-        if (is_dir && !(fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) scan_recursive(full, gen);
-    } while (FindNextFileA(hFind, &fd));
-    FindClose(hFind);
+typedef struct {
+    char text[HUNT_BATCH_SIZE * 260];   // leaf names, NUL-terminated
+    size_t used;
+    HuntMatch items[HUNT_BATCH_SIZE];
+    int count;
+    int limit;                          // ramps 1 -> 8 -> 64 like the TUI's batches
+} HuntBatch;
+
+void hunter_flush(ScanWorker *w, HuntBatch *b) {
+    Hunt *h = (Hunt*)w->ctx->user;
+    if (b->count == 0) return;
+    // Generation re-checked under the lock so a cancelled hunt can never leak into the next one
+    EnterCriticalSection(&data_lock);
+    if (h->gen == search_generation) {
+        for (int i = 0; i < b->count; i++) {
+            HuntMatch *m = &b->items[i];
+            const char *name = b->text + m->name;
+            // A refinement may have swapped the predicate since the match was tested
+            if (m->pred != h->pred && !search_match(h->pred, name, strlen(name), m->size, 1)) continue;
+            if (!add_entry_locked(m->dir, name, m->is_dir, m->recycled, m->size, &m->ft, 0, SEC_NONE, 0, 0, NULL)) break;
+        }
+    }
+    LeaveCriticalSection(&data_lock);
+    b->count = 0;
+    b->used = 0;
+    if (is_truncated) scan_cancel(w->ctx);
 }
 
-unsigned __stdcall hunter_thread(void *arg) {
-    long gen = (long)(intptr_t)arg;
+void hunter_start(ScanWorker *w) {
+    HuntBatch *b = (HuntBatch*)calloc(1, sizeof(HuntBatch));
+    if (b) b->limit = 1;
+    w->local = b;
     InterlockedIncrement(&active_workers);
+}
+
+void hunter_idle(ScanWorker *w) {
+    HuntBatch *b = (HuntBatch*)w->local;
+    if (!b) return;
+    hunter_flush(w, b);
+    b->limit = 1;
+}
+
+void hunter_stop(ScanWorker *w) {
+    HuntBatch *b = (HuntBatch*)w->local;
+    if (b) hunter_flush(w, b);
+    free(b);
+    w->local = NULL;
+    InterlockedDecrement(&active_workers);
+}
+
+void hunter_finish(ScanCtx *ctx) {
+    Hunt *h = (Hunt*)ctx->user;
+    __atomic_store_n(&h->finished, 1, __ATOMIC_RELEASE);
+    hunt_release(h);
+    InvalidateRect(hMainWnd, NULL, FALSE);
+}
+
+int hunter_dir(ScanWorker *w, const ScanJob *dir) {
+    tree_add_job(((Hunt*)w->ctx->user)->tree, w, dir);
+    return SCAN_CONTINUE;
+}
+
+static int is_recycled_dir(const ScanJob *dir) {
+    if (stristr(dir->path, "$Recycle.Bin") || stristr(dir->path, "\\RECYCLER\\")) return 1;
+    return dir->len >= 9 && _stricmp(dir->path + dir->len - 9, "\\RECYCLER") == 0;
+}
+
+int hunter_entry(ScanWorker *w, const ScanJob *dir, ScanEntry *ent) {
+    Hunt *h = (Hunt*)w->ctx->user;
+    HuntBatch *b = (HuntBatch*)w->local;
+    if (h->gen != search_generation || !running || !b) { scan_cancel(w->ctx); return SCAN_SKIP; }
+    if (ent->name[0] == '.') return SCAN_SKIP;     // dot files and folders stay hidden, as in listings
+
+    const SearchQuery *q = __atomic_load_n(&h->pred, __ATOMIC_ACQUIRE);
+    int have_size = (ent->fs->flags & FS_HAVE_STAT) != 0;
+    if (!search_match(q, ent->name, ent->name_len, ent->size, have_size)) return SCAN_CONTINUE;
+    if (!scan_entry_stat(ent) || (!have_size && !search_match_size(q, ent->size))) return SCAN_CONTINUE;
+    if (ent->name_len >= 260) return SCAN_CONTINUE;
+
+    // Only the leaf name is stored; the folder is this job's node in the hunt's tree
+    HuntMatch *m = &b->items[b->count++];
+    m->pred = q;
+    m->dir = dir->id;
+    m->name = (uint32_t)b->used;
+    m->is_dir = ent->is_dir;
+    m->recycled = is_recycled_dir(dir);
+    m->size = ent->size;
+    m->ft.dwLowDateTime = (DWORD)ent->mtime;
+    m->ft.dwHighDateTime = (DWORD)(ent->mtime >> 32);
+    memcpy(b->text + b->used, ent->name, ent->name_len + 1);
+    b->used += ent->name_len + 1;
+
+    if (b->count >= b->limit) {
+        hunter_flush(w, b);
+        if (b->limit < HUNT_BATCH_SIZE) b->limit *= 8;
+        if (b->limit > HUNT_BATCH_SIZE) b->limit = HUNT_BATCH_SIZE;
+    }
+    return SCAN_CONTINUE;
+}
+
+void cancel_hunt() {
+    if (!hunt_ctx) return;
+    scan_cancel(hunt_ctx);
+    scan_release(hunt_ctx);
+    hunt_ctx = NULL;
+}
+
+// Teardown: also waits for the workers, so none commits a batch or touches the
+// window after the entries, the arena and data_lock are gone
+void stop_hunt() {
+    InterlockedIncrement(&search_generation);
+    if (!hunt_ctx) return;
+    scan_cancel(hunt_ctx);
+    scan_wait(hunt_ctx);
+    scan_release(hunt_ctx);
+    hunt_ctx = NULL;
+}
+
+// Call right after clear_data: the new entries take the hunt's second reference
+void start_hunt(long gen) {
+    Hunt *h = hunt_create(gen, &query);
+    if (!h) return;
+    hunt_ctx = scan_create(THREAD_COUNT, h);
+    if (!hunt_ctx) { hunt_release(h); return; }
+    Prune *p = (Prune*)malloc(sizeof(Prune));
+    if (p) {
+        char rest[256];
+        *p = g_prune;
+        prune_parse_query(p, query.prune, rest, sizeof(rest));
+        scan_set_prune(hunt_ctx, p);
+        h->prune = p;
+    }
+    EnterCriticalSection(&data_lock);
+    h->refs++;
+    entries_hunt = h;
+    LeaveCriticalSection(&data_lock);
+    hunt_ctx->on_start = hunter_start;
+    hunt_ctx->on_dir = hunter_dir;
+    hunt_ctx->on_entry = hunter_entry;
+    hunt_ctx->on_idle = hunter_idle;
+    hunt_ctx->on_stop = hunter_stop;
+    hunt_ctx->on_finish = hunter_finish;
     if (strlen(root_path) == 0) {
         DWORD drives = GetLogicalDrives();
         char d[] = "A:\\";
         for (int i = 0; i < 26; i++) {
-            if (gen != search_generation) break;
-            if (drives & (1 << i)) { d[0] = 'A' + i; scan_recursive(d, gen); }
+            if (drives & (1 << i)) { d[0] = 'A' + i; scan_add_root(hunt_ctx, d); }
         }
-    } else scan_recursive(root_path, gen);
-    InterlockedDecrement(&active_workers);
-    InvalidateRect(hMainWnd, NULL, FALSE);
-    return 0;
+    } else scan_add_root(hunt_ctx, root_path);
+    scan_start(hunt_ctx);
 }
 
-void refresh_state() {
-    InterlockedIncrement(&search_generation);
-    parse_query();
-    char target_path[4096] = {0};
+// Folder the search text names (absolute, or relative to root_path); 0 if it is not one
+int search_target_dir(char *target_path, size_t cap) {
+    target_path[0] = 0;
     int is_absolute = (search_buffer[1] == ':' || (search_buffer[0] == '\\' && search_buffer[1] == '\\'));
-    if (is_absolute) lstrcpynA(target_path, search_buffer, 4096);
-    else if (strlen(root_path) > 0) snprintf(target_path, 4096, "%s\\%s", root_path, search_buffer);
+    if (is_absolute) lstrcpynA(target_path, search_buffer, cap);
+    else if (strlen(root_path) > 0) snprintf(target_path, cap, "%s\\%s", root_path, search_buffer);
     
     DWORD attr = (target_path[0]) ? GetFileAttributesA(target_path) : INVALID_FILE_ATTRIBUTES;
-    int is_valid_dir = (attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY));
+    return (attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY));
+}
 
+void refresh_state() {
+    KillTimer(hMainWnd, TIMER_RESCAN);
+    InterlockedIncrement(&search_generation);
+    cancel_hunt();
+    parse_query(&query, search_buffer);
+    char target_path[4096];
+    int is_valid_dir = search_target_dir(target_path, sizeof(target_path));
+
+    // The watch starts first so nothing that changes during the listing is missed
     if (strlen(search_buffer) == 0) {
+        watch_follow(root_path, 0);
         if (strlen(root_path) == 0) list_home_view();
         else list_directory(root_path);
-    } else if (is_valid_dir) list_directory(target_path);
-    else {
+    } else if (is_valid_dir) {
+        watch_follow(target_path, 0);
+        list_directory(target_path);
+    } else {
+        watch_follow(root_path, 1);
         clear_data();
-        is_wildcard = (strchr(query.name, '*') || strchr(query.name, '?'));
-        for (int i = 0; i < THREAD_COUNT; i++) _beginthreadex(NULL, 0, hunter_thread, (void*)(intptr_t)search_generation, 0, NULL);
+        start_hunt(search_generation);
     }
     InvalidateRect(hMainWnd, NULL, FALSE);
 }
 
+// Caller holds data_lock. Keeps the entries q still matches and hands the hunt q
+// as its predicate, so the running traversal carries on with the narrower query.
+void refine_hunt(Hunt *h, SearchQuery *q) {
+    long kept = 0;
+    for (long i = 0; i < entry_count; i++) {
+        const Entry *e = &entries[i];
+        const char *name = get_display_name(e->name);
+        if (search_match(q, name, strlen(name), e->size, 1)) entries[kept++] = *e;
+    }
+    entry_count = kept;
+    view_count = 0;     // indices moved; the view is rebuilt by view_sync
+    selected_index = 0; scroll_offset = 0;
+    layout_version++;
+    q->retired = h->pred;
+    __atomic_store_n(&h->pred, q, __ATOMIC_RELEASE);
+}
+
+void view_invalidate();
+
+// Search text edited by typing. Narrowing the current hunt's query under the
+// same root costs no traversal; a change that needs a new hunt stops the old one
+// now but only starts the new one once typing pauses for HUNT_DEBOUNCE_MS.
+void search_changed() {
+    char target_path[4096];
+    if (strlen(search_buffer) == 0 || search_target_dir(target_path, sizeof(target_path))) { refresh_state(); return; }
+
+    SearchQuery *q = (SearchQuery*)malloc(sizeof(SearchQuery));
+    if (!q) { refresh_state(); return; }
+    parse_query(q, search_buffer);
+
+    int refined = 0;
+    EnterCriticalSection(&data_lock);
+    Hunt *h = entries_hunt;
+    // A truncated hunt stopped early, so its entries are not the full match set
+    if (h && h->gen == search_generation && !is_truncated && search_narrows(q, h->pred)) {
+        refine_hunt(h, q);
+        refined = 1;
+    }
+    LeaveCriticalSection(&data_lock);
+
+    if (refined) {
+        query = *q;
+        query.retired = NULL;
+    } else {
+        free(q);
+        InterlockedIncrement(&search_generation);
+        cancel_hunt();
+        SetTimer(hMainWnd, TIMER_RESCAN, HUNT_DEBOUNCE_MS, NULL);
+    }
+    // A refine emptied the view; rebuild it now, or this frame would paint no rows
+    if (refined) view_invalidate();
+    else InvalidateRect(hMainWnd, NULL, FALSE);
+}
+
 // ==========================================
 // NAVIGATION & ACTIONS
 // ==========================================
@@ -762,32 +1520,28 @@ void copy_to_clipboard(const char *s) {
 }
 
 void navigate_down() {
-    EnterCriticalSection(&data_lock);
-    if (entry_count > 0 && selected_index >= 0 && selected_index < entry_count) {
-        Entry *e = &entries[selected_index];
+    if (selected_index >= 0 && selected_index < view_count) {
+        Entry *e = view_entry(selected_index);
+        char p[4096];
+        if (!entry_path(e, p, sizeof(p))) return;
         if (e->is_dir) {
-            strcpy(root_path, e->path);
+            strcpy(root_path, p);
             search_buffer[0] = 0;
-            if(!e->is_drive) add_to_history(e->path); 
-            LeaveCriticalSection(&data_lock);
+            if(!e->is_drive) add_to_history(p); 
             refresh_state();
         } else {
-            char p[4096]; strcpy(p, e->path);
-            LeaveCriticalSection(&data_lock);
             open_path(p);
         }
-    } else LeaveCriticalSection(&data_lock);
+    }
 }
 
 void handle_ctrl_o() {
     char target[4096] = {0};
-    EnterCriticalSection(&data_lock);
-    if (entry_count > 0 && selected_index >= 0 && selected_index < entry_count) {
-        Entry *e = &entries[selected_index];
-        strcpy(target, e->path);
+    if (selected_index >= 0 && selected_index < view_count) {
+        Entry *e = view_entry(selected_index);
+        entry_path(e, target, sizeof(target));
         if (!e->is_dir) { char *s = strrchr(target, '\\'); if(s) *s=0; }
     }
-    LeaveCriticalSection(&data_lock);
     if (!target[0] && root_path[0]) strcpy(target, root_path);
     if (!target[0]) return;
 
@@ -827,12 +1581,10 @@ int InputBox(HWND owner, const char *title, char *buffer) {
 
 void rename_entry() {
     char path[4096]; 
-    EnterCriticalSection(&data_lock);
-    if(entry_count>0 && selected_index < entry_count) {
-        if (entries[selected_index].is_drive) { LeaveCriticalSection(&data_lock); return; }
-        strcpy(path, entries[selected_index].path);
+    if(selected_index >= 0 && selected_index < view_count) {
+        if (view_entry(selected_index)->is_drive) return;
+        entry_path(view_entry(selected_index), path, sizeof(path));
     }
-    LeaveCriticalSection(&data_lock);
     char name[MAX_PATH]; strcpy(name, get_display_name(path));
     if (InputBox(hMainWnd, "Rename", name)) {
         char new_p[4096]; strcpy(new_p, path);
@@ -856,7 +1608,7 @@ void DrawHelp(HDC hdc) {
     if (!show_help) return;
     
     RECT rc = {0, 0, window_width, window_height};
-    FillRect(hdc, &rc, CreateSolidBrush(COL_HELP_BG)); // Dark overlay
+    FillRect(hdc, &rc, brHelp); // Dark overlay
     
     SetTextColor(hdc, COL_ACCENT);
     SelectObject(hdc, hFontBold);
@@ -877,6 +1629,7 @@ void DrawHelp(HDC hdc) {
         "  F3 / F4 / F5   : Sort by Name / Size / Date",
         "  F6             : Toggle Grid / List View",
         "  F7             : Cycle Stacks (Time, Type, Context)",
+        "  F8             : Folder Sizes (largest first)",
         "  Del            : Delete item",
         "  Ctrl + O       : Open Terminal Here",
         "  Ctrl + H       : Toggle this Help",
@@ -890,262 +1643,228 @@ void DrawHelp(HDC hdc) {
     }
 }
 
-void Render(HDC hdcDest) {
-    if (!hdcBack) return;
-    RECT rc = {0, 0, window_width, window_height};
-    FillRect(hdcBack, &rc, CreateSolidBrush(COL_BG));
-    RECT rcHead = {0, 0, window_width, HEADER_HEIGHT};
-    FillRect(hdcBack, &rcHead, CreateSolidBrush(COL_HEADER));
-    SetBkMode(hdcBack, TRANSPARENT);
+// ==========================================
+// LAYOUT (rows and dirty tracking live in blade_layout.h)
+// ==========================================
+// Entries only change under a running hunt by being appended, so the layout is
+// extended from its last row; anything that rewrites entries in place (sort,
+// stacks, refine, clear) bumps layout_version and it is rebuilt, as it is when
+// the view mode, width or grouping change.
+Layout layout = {0};
+long layout_built_version = -1;
+int layout_sections = 0;
+LayoutFrame painted = { -1, 0, 0, -1, -1, 0, 0 };   // what the window was last asked to show
+
+// Header shown above e when it starts a group, or NULL for none
+const char *layout_header_text(const Entry *e, int sections) {
+    if (sections) {
+        const char* sec_names[] = {"", "Core Folders", "Favorites", "Recent", "Drives"};
+        if (e->section >= 5) return "Other";
+        return sec_names[e->section][0] ? sec_names[e->section] : NULL;
+    }
+    return g_stack_mode != STACKMODE_NONE ? get_stack_name(e->stack) : NULL;
+}
 
-    SelectObject(hdcBack, hFontBold);
-    SetTextColor(hdcBack, COL_ACCENT);
-    TextOutA(hdcBack, 10, 5, strlen(root_path) ? root_path : "Home", strlen(root_path) ? strlen(root_path) : 4);
+static int layout_group(void *ctx, long i) {
+    int sections = *(int*)ctx;
+    const Entry *e = view_entry(i);
+    if (i > 0 && (sections ? view_entry(i - 1)->section == e->section : view_entry(i - 1)->stack == e->stack)) return LAYOUT_SAME;
+    return layout_header_text(e, sections) ? LAYOUT_HEADER : LAYOUT_GROUP;
+}
 
-    SetTextColor(hdcBack, COL_TEXT);
-    char prompt[300];
-    if (strlen(search_buffer) > 0) snprintf(prompt, 300, "Query: %s", search_buffer);
-    else strcpy(prompt, "Type to hunt... (Ctrl+H for Help)");
-    SelectObject(hdcBack, hFontSmall);
-    TextOutA(hdcBack, 10, 35, prompt, strlen(prompt));
+// UI thread. Lays out view positions [0, count).
+void layout_update(long count) {
+    // Priority: Sections (Home View) > Stacks
+    int sections = (strlen(root_path) == 0 && g_stack_mode == STACKMODE_NONE);
+    LayoutGeom g = {0};
+    g.per_row = 1;
+    g.row_height = ROW_HEIGHT;
+    g.header_height = GROUP_HEADER_HEIGHT;
+    g.left = 10;
+    g.top = HEADER_HEIGHT + 5;
+    if (g_view_mode == VIEWMODE_GRID) {
+        g.per_row = window_width / GRID_ITEM_WIDTH;
+        if (g.per_row < 1) g.per_row = 1;
+        g.row_height = GRID_ITEM_HEIGHT;
+        g.item_width = GRID_ITEM_WIDTH;
+    }
+    items_per_row = g.per_row;
 
-    char stats[128];
-    const char* stack_modes[] = {"None", "Time", "Type", "Context"};
-    snprintf(stats, 128, "%ld items [%s] %s", entry_count, stack_modes[g_stack_mode], g_view_mode==VIEWMODE_GRID ? "[GRID]" : "[LIST]");
-    SIZE sz; GetTextExtentPoint32A(hdcBack, stats, strlen(stats), &sz);
-    TextOutA(hdcBack, window_width - sz.cx - 10, 10, stats, strlen(stats));
+    if (layout_built_version != layout_version || layout_sections != sections || count < layout.entries ||
+        memcmp(&layout.geom, &g, sizeof(g)) != 0) {
+        layout_built_version = layout_version;
+        layout_sections = sections;
+        layout_reset(&layout, &g);
+    }
+    layout_extend(&layout, count, layout_group, &sections);
+}
 
-    EnterCriticalSection(&data_lock);
-    
-    if (g_view_mode == VIEWMODE_LIST) {
-        items_per_row = 1;
+// Merges new hunt results into the view, then invalidates only what changed
+// since the last call: the rows of the old and new selection and hover, rows
+// from the first new entry down, and the header line when the item count
+// moved. Scrolling, resizing and relayouts repaint everything.
+void view_invalidate() {
+    long changed = view_sync();
+    layout_rewind(&layout, changed);
+    long count = view_count;
+    layout_update(count);
+    LayoutFrame now = { layout.builds, count, scroll_offset, selected_index, hover_index, window_width, window_height };
+    LayoutRect dirty[LAYOUT_MAX_DIRTY];
+    int n = layout_dirty(&layout, &painted, &now, changed, dirty, LAYOUT_MAX_DIRTY);
+    if (n < 0) {
+        InvalidateRect(hMainWnd, NULL, FALSE);
     } else {
-        items_per_row = window_width / GRID_ITEM_WIDTH;
-        if (items_per_row < 1) items_per_row = 1;
+        for (int i = 0; i < n; i++) {
+            RECT rc = { dirty[i].left, dirty[i].top, dirty[i].right, dirty[i].bottom };
+            InvalidateRect(hMainWnd, &rc, FALSE);
+        }
+        if (now.count != painted.count) {
+            RECT rcHead = {0, 0, window_width, HEADER_HEIGHT};
+            InvalidateRect(hMainWnd, &rcHead, FALSE);
+        }
+    }
+    painted = now;
+}
+
+// Redraws the dirty rectangle of the back buffer and copies just that to the
+// window. The back buffer keeps everything else from earlier frames.
+void Render(HDC hdcDest, const RECT *dirty) {
+    if (!hdcBack) return;
+    RECT rc = {0, 0, window_width, window_height};
+    if (dirty && !IntersectRect(&rc, &rc, dirty)) return;
+    IntersectClipRect(hdcBack, rc.left, rc.top, rc.right, rc.bottom);
+
+    FillRect(hdcBack, &rc, brBg);
+    SetBkMode(hdcBack, TRANSPARENT);
+
+    if (rc.top < HEADER_HEIGHT) {
+        RECT rcHead = {0, 0, window_width, HEADER_HEIGHT};
+        FillRect(hdcBack, &rcHead, brHeader);
+
+        SelectObject(hdcBack, hFontBold);
+        SetTextColor(hdcBack, COL_ACCENT);
+        TextOutA(hdcBack, 10, 5, strlen(root_path) ? root_path : "Home", strlen(root_path) ? strlen(root_path) : 4);
+
+        SetTextColor(hdcBack, COL_TEXT);
+        char prompt[300];
+        if (strlen(search_buffer) > 0) snprintf(prompt, 300, "Query: %s", search_buffer);
+        else strcpy(prompt, "Type to hunt... (Ctrl+H for Help)");
+        SelectObject(hdcBack, hFontSmall);
+        TextOutA(hdcBack, 10, 35, prompt, strlen(prompt));
+
+        // Right-aligned by GDI, so the text is never measured
+        char stats[128];
+        const char* stack_modes[] = {"None", "Time", "Type", "Context"};
+        snprintf(stats, 128, "%ld items [%s] %s", view_count, stack_modes[g_stack_mode], g_view_mode==VIEWMODE_GRID ? "[GRID]" : "[LIST]");
+        SetTextAlign(hdcBack, TA_RIGHT);
+        TextOutA(hdcBack, window_width - 10, 10, stats, strlen(stats));
+        SetTextAlign(hdcBack, TA_LEFT);
     }
 
-    if (selected_index >= entry_count) selected_index = entry_count - 1;
+    long count = view_count;
+    layout_update(count);
+
+    if (selected_index >= count) selected_index = count - 1;
     if (selected_index < 0) selected_index = 0;
     
     // Ensure scroll_offset is valid
-    if (scroll_offset >= entry_count) scroll_offset = entry_count - 1;
+    if (scroll_offset >= count) scroll_offset = count - 1;
     if (scroll_offset < 0) scroll_offset = 0;
 
-    int y = HEADER_HEIGHT + 5;
-    
-    // State tracking for headers
-    STACK_TYPE current_stack = STACK_NONE;
-    SECTION_TYPE current_section = SEC_NONE;
-    
-    // Initialize state based on previous item if scrolling
-    if (scroll_offset > 0 && entry_count > 0) {
-        current_stack = entries[scroll_offset-1].stack;
-        current_section = entries[scroll_offset-1].section;
-    }
-
-    for (int i = scroll_offset; i < entry_count; i++) {
-        if (y > window_height) break;
-        
-        Entry *e = &entries[i];
-        
-        // Determine if we need a header
-        int draw_header = 0;
-        char header_text[128] = {0};
-        
-        // Priority: Sections (Home View) > Stacks
-        int use_sections = (strlen(root_path) == 0 && g_stack_mode == STACKMODE_NONE);
-        
-        if (use_sections) {
-            if (i == 0 || e->section != current_section) {
-                draw_header = 1;
-                current_section = e->section;
-                const char* sec_names[] = {"", "Core Folders", "Favorites", "Recent", "Drives"};
-                if (e->section < 5) strcpy(header_text, sec_names[e->section]);
-                else strcpy(header_text, "Other");
-            }
-        } else {
-            if (i == 0 || e->stack != current_stack) {
-                draw_header = 1;
-                current_stack = e->stack;
-                if (g_stack_mode != STACKMODE_NONE) strcpy(header_text, get_stack_name(e->stack));
-                else draw_header = 0; // No headers in flat mode
-            }
-        }
+    // Only the rows from scroll_offset down to the bottom of the dirty rectangle are visited
+    int origin;
+    long r = layout_row_of(&layout, scroll_offset, &origin);
+    for (; r >= 0 && r < layout.row_count; r++) {
+        const LayoutRow *row = &layout.rows[r];
+        int y = layout_row_view_y(&layout, r, origin);
+        if (y - (row->header ? GROUP_HEADER_HEIGHT : 0) > rc.bottom) break;
+        if (y + layout.geom.row_height <= rc.top) continue;
 
         // Draw Header
-        if (draw_header && header_text[0]) {
-            RECT rcH = {0, y, window_width, y + 24};
-            FillRect(hdcBack, &rcH, CreateSolidBrush(COL_HOVER));
+        const char *header_text = row->header && row->first >= scroll_offset ? layout_header_text(view_entry(row->first), layout_sections) : NULL;
+        if (header_text) {
+            int hy = y - GROUP_HEADER_HEIGHT;
+            RECT rcH = {0, hy, window_width, hy + 24};
+            FillRect(hdcBack, &rcH, brHover);
             SetTextColor(hdcBack, COL_SECTION);
             SelectObject(hdcBack, hFontBold);
-            TextOutA(hdcBack, 10, y + 2, header_text, strlen(header_text));
-            y += 28;
-        }
-
-        // Calculate Item Position
-        // Find start of current group (stack or section) to calculate grid position relative to group start
-        int start_of_group = i;
-        if (use_sections) {
-            while (start_of_group > 0 && entries[start_of_group-1].section == e->section) start_of_group--;
-        } else {
-            while (start_of_group > 0 && entries[start_of_group-1].stack == e->stack) start_of_group--;
+            TextOutA(hdcBack, 10, hy + 2, header_text, strlen(header_text));
         }
-        int group_item_index = i - start_of_group;
 
-        int x, w, h;
-        if (g_view_mode == VIEWMODE_LIST) {
-            x = 10; 
-            w = window_width - 20; h = ROW_HEIGHT;
-        } else {
-            int col = group_item_index % items_per_row;
-            x = 10 + (col * GRID_ITEM_WIDTH);
-            w = GRID_ITEM_WIDTH - 5; h = GRID_ITEM_HEIGHT - 5;
-        }
+        long end = layout_row_end(&layout, r, count);
+        for (long i = row->first > scroll_offset ? row->first : scroll_offset; i < end; i++) {
+            Entry *e = view_entry(i);
 
-        RECT rcItem = {x, y, x + w, y + h};
+            int x, w, h;
+            if (g_view_mode == VIEWMODE_LIST) {
+                x = 10; 
+                w = window_width - 20; h = ROW_HEIGHT;
+            } else {
+                x = 10 + (int)(i - row->first) * GRID_ITEM_WIDTH;
+                w = GRID_ITEM_WIDTH - 5; h = GRID_ITEM_HEIGHT - 5;
+                if (x >= rc.right || x + GRID_ITEM_WIDTH <= rc.left) continue;
+            }
 
-        // Draw selection/hover
-        if (i == selected_index) {
-            FillRect(hdcBack, &rcItem, CreateSolidBrush(COL_ACCENT));
-            SetTextColor(hdcBack, COL_SEL_TEXT);
-        } else {
-            if (i == hover_index) FillRect(hdcBack, &rcItem, CreateSolidBrush(COL_HOVER));
-            SetTextColor(hdcBack, e->is_recycled ? COL_RECYCLED : (e->is_dir ? COL_DIR : COL_TEXT));
-        }
+            RECT rcItem = {x, y, x + w, y + h};
 
-        SelectObject(hdcBack, e->is_recycled ? hFontStrike : hFont);
-        char disp[MAX_PATH];
-        strcpy(disp, get_display_name(e->path));
-
-        if (g_view_mode == VIEWMODE_LIST) {
-            TextOutA(hdcBack, x + 5, y, disp, strlen(disp));
-            SelectObject(hdcBack, hFontSmall);
-            char meta[128] = {0};
-            if (e->is_drive) {
-                char f[32], t[32]; format_size(e->free_bytes, f); format_size(e->total_bytes, t);
-                snprintf(meta, 128, "[%s] %s free of %s", e->fs_name, f, t);
-            } else if (!e->is_dir) format_size(e->size, meta);
-            
-            if (meta[0]) {
-                SIZE sz; GetTextExtentPoint32A(hdcBack, meta, strlen(meta), &sz);
-                TextOutA(hdcBack, window_width - sz.cx - 20, y, meta, strlen(meta));
-            }
-            y += ROW_HEIGHT;
-        } else {
-            // Grid View
-            RECT rcIcon = {x + (w-40)/2, y + 10, x + (w-40)/2 + 40, y + 50};
-            HBRUSH hIcon = CreateSolidBrush(e->is_dir ? COL_DIR : COL_DIM);
-            FrameRect(hdcBack, &rcIcon, hIcon);
-            DeleteObject(hIcon);
-
-            SelectObject(hdcBack, hFontSmall);
-            RECT rcText = {x, y + 60, x + w, y + h};
-            DrawTextA(hdcBack, disp, -1, &rcText, DT_CENTER | DT_WORDBREAK | DT_NOPREFIX | DT_END_ELLIPSIS);
-            
-            // Increment Y only if end of row or next is new group or end of list
-            int next_is_new = 0;
-            if (i + 1 < entry_count) {
-                if (use_sections) next_is_new = (entries[i+1].section != current_section);
-                else next_is_new = (entries[i+1].stack != current_stack);
+            // Draw selection/hover
+            if (i == selected_index) {
+                FillRect(hdcBack, &rcItem, brAccent);
+                SetTextColor(hdcBack, COL_SEL_TEXT);
+            } else {
+                if (i == hover_index) FillRect(hdcBack, &rcItem, brHover);
+                SetTextColor(hdcBack, e->is_recycled ? COL_RECYCLED : (e->is_dir ? COL_DIR : COL_TEXT));
             }
-            
-            if ((group_item_index % items_per_row) == items_per_row - 1 || next_is_new || i == entry_count - 1) {
-                y += GRID_ITEM_HEIGHT;
+
+            SelectObject(hdcBack, e->is_recycled ? hFontStrike : hFont);
+            const char *disp = get_display_name(e->name);
+
+            if (g_view_mode == VIEWMODE_LIST) {
+                TextOutA(hdcBack, x + 5, y, disp, strlen(disp));
+                SelectObject(hdcBack, hFontSmall);
+                char meta[128] = {0};
+                if (e->is_drive) {
+                    char f[32], t[32]; format_size(e->free_bytes, f); format_size(e->total_bytes, t);
+                    snprintf(meta, 128, "[%s] %s free of %s", e->fs_name, f, t);
+                } else if (!e->is_dir || e->has_total) format_size(e->size, meta);
+                
+                if (meta[0]) {
+                    SetTextAlign(hdcBack, TA_RIGHT);
+                    TextOutA(hdcBack, window_width - 20, y, meta, strlen(meta));
+                    SetTextAlign(hdcBack, TA_LEFT);
+                }
+            } else {
+                // Grid View
+                RECT rcIcon = {x + (w-40)/2, y + 10, x + (w-40)/2 + 40, y + 50};
+                FrameRect(hdcBack, &rcIcon, e->is_dir ? brDir : brDim);
+
+                SelectObject(hdcBack, hFontSmall);
+                RECT rcText = {x, y + 60, x + w, y + h};
+                DrawTextA(hdcBack, disp, -1, &rcText, DT_CENTER | DT_WORDBREAK | DT_NOPREFIX | DT_END_ELLIPSIS);
             }
         }
     }
-    LeaveCriticalSection(&data_lock);
     
     if (show_help) DrawHelp(hdcBack);
+    SelectClipRgn(hdcBack, NULL);
     
-    BitBlt(hdcDest, 0, 0, window_width, window_height, hdcBack, 0, 0, SRCCOPY);
+    BitBlt(hdcDest, rc.left, rc.top, rc.right - rc.left, rc.bottom - rc.top, hdcBack, rc.left, rc.top, SRCCOPY);
 }
 
 int hit_test_index(int x, int y) {
     if (show_help) return -1; // No clicks when help is open
-    if (y < HEADER_HEIGHT + 5) return -1;
-    
-    EnterCriticalSection(&data_lock);
-    int cur_y = HEADER_HEIGHT + 5;
-    
-    STACK_TYPE current_stack = STACK_NONE;
-    SECTION_TYPE current_section = SEC_NONE;
-    
-    if (scroll_offset > 0 && entry_count > 0) {
-        current_stack = entries[scroll_offset-1].stack;
-        current_section = entries[scroll_offset-1].section;
-    }
-
-    for (int i = scroll_offset; i < entry_count; i++) {
-        if (cur_y > window_height) break;
-        Entry *e = &entries[i];
-        
-        int draw_header = 0;
-        int use_sections = (strlen(root_path) == 0 && g_stack_mode == STACKMODE_NONE);
-        
-        if (use_sections) {
-            if (i == 0 || e->section != current_section) {
-                draw_header = 1;
-                current_section = e->section;
-            }
-        } else {
-            if (i == 0 || e->stack != current_stack) {
-                draw_header = 1;
-                current_stack = e->stack;
-                if (g_stack_mode == STACKMODE_NONE) draw_header = 0;
-            }
-        }
-
-        if (draw_header) cur_y += 28;
-
-        int start_of_group = i;
-        if (use_sections) {
-            while (start_of_group > 0 && entries[start_of_group-1].section == e->section) start_of_group--;
-        } else {
-            while (start_of_group > 0 && entries[start_of_group-1].stack == e->stack) start_of_group--;
-        }
-        int group_item_index = i - start_of_group;
-
-        int h = (g_view_mode == VIEWMODE_LIST) ? ROW_HEIGHT : GRID_ITEM_HEIGHT;
-        int w = (g_view_mode == VIEWMODE_LIST) ? window_width : GRID_ITEM_WIDTH;
-        int item_x = (g_view_mode == VIEWMODE_LIST) ? 0 : 10 + ((group_item_index % items_per_row) * GRID_ITEM_WIDTH);
-        
-        // Check hit
-        if (y >= cur_y && y < cur_y + h) {
-            if (g_view_mode == VIEWMODE_LIST) {
-                LeaveCriticalSection(&data_lock);
-                return i;
-            } else {
-                if (x >= item_x && x < item_x + w) {
-                    LeaveCriticalSection(&data_lock);
-                    return i;
-                }
-            }
-        }
-
-        if (g_view_mode == VIEWMODE_LIST) {
-            cur_y += ROW_HEIGHT;
-        } else {
-            int next_is_new = 0;
-            if (i + 1 < entry_count) {
-                if (use_sections) next_is_new = (entries[i+1].section != current_section);
-                else next_is_new = (entries[i+1].stack != current_stack);
-            }
-            if ((group_item_index % items_per_row) == items_per_row - 1 || next_is_new || i == entry_count - 1) {
-                cur_y += GRID_ITEM_HEIGHT;
-            }
-        }
-    }
-    LeaveCriticalSection(&data_lock);
-    return -1;
+    long count = view_count;
+    layout_update(count);
+    return (int)layout_hit(&layout, scroll_offset, count, x, y);
 }
 
 void show_context_menu(int x, int y) {
     POINT pt = {x,y}; ClientToScreen(hMainWnd, &pt);
     HMENU hMenu = CreatePopupMenu();
     
-    int valid_sel = (selected_index >= 0 && selected_index < entry_count);
-    Entry *e = valid_sel ? &entries[selected_index] : NULL;
+    int valid_sel = (selected_index >= 0 && selected_index < view_count);
+    Entry *e = valid_sel ? view_entry(selected_index) : NULL;
+    char sel_path[4096];
 
     AppendMenuA(hMenu, MF_STRING, CMD_OPEN, "Open");
     AppendMenuA(hMenu, MF_STRING, CMD_OPEN_EXPLORER, "Open in Explorer");
@@ -1154,7 +1873,7 @@ void show_context_menu(int x, int y) {
     // Favorites Logic
     if (e && e->is_dir) {
         if (e->section == SEC_PINNED) AppendMenuA(hMenu, MF_STRING, CMD_REMOVE_FAV, "Remove from Favorites");
-        else if (!is_pinned(e->path)) AppendMenuA(hMenu, MF_STRING, CMD_ADD_FAV, "Add to Favorites");
+        else if (!selected_path(sel_path, sizeof(sel_path)) || !is_pinned(sel_path)) AppendMenuA(hMenu, MF_STRING, CMD_ADD_FAV, "Add to Favorites");
     }
 
     AppendMenuA(hMenu, MF_SEPARATOR, 0, NULL);
@@ -1178,20 +1897,27 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
             hFontBold = CreateFontA(22, 0, 0, 0, FW_BOLD, 0,0,0, ANSI_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, DEFAULT_PITCH, FONT_NAME);
             hFontSmall = CreateFontA(16, 0, 0, 0, FW_NORMAL, 0,0,0, ANSI_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, DEFAULT_PITCH, FONT_NAME);
             hFontStrike = CreateFontA(20, 0, 0, 0, FW_NORMAL, 0,0,1, ANSI_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, DEFAULT_PITCH, FONT_NAME);
+            brBg = CreateSolidBrush(COL_BG); brHeader = CreateSolidBrush(COL_HEADER); brAccent = CreateSolidBrush(COL_ACCENT);
+            brHover = CreateSolidBrush(COL_HOVER); brHelp = CreateSolidBrush(COL_HELP_BG);
+            brDir = CreateSolidBrush(COL_DIR); brDim = CreateSolidBrush(COL_DIM);
             CoInitialize(NULL);
             load_settings(); load_data();
             refresh_state();
-            SetTimer(hwnd, 1, 100, NULL);
+            SetTimer(hwnd, TIMER_REPAINT, 100, NULL);
             return 0;
         
         case WM_SIZE:
             window_width = LOWORD(lParam); window_height = HIWORD(lParam);
-            if (hdcBack) DeleteDC(hdcBack); 
+            if (hdcBack) { DeleteDC(hdcBack); DeleteObject(hbmBack); }
             { HDC h = GetDC(hwnd); hdcBack = CreateCompatibleDC(h); hbmBack = CreateCompatibleBitmap(h, window_width, window_height); SelectObject(hdcBack, hbmBack); ReleaseDC(hwnd, h); }
+            InvalidateRect(hwnd, NULL, FALSE);  // the new back buffer is blank
             break;
 
-        case WM_PAINT: { PAINTSTRUCT ps; HDC h = BeginPaint(hwnd, &ps); Render(h); EndPaint(hwnd, &ps); return 0; }
-        case WM_TIMER: if (active_workers > 0) InvalidateRect(hwnd, NULL, FALSE); return 0;
+        case WM_PAINT: { PAINTSTRUCT ps; HDC h = BeginPaint(hwnd, &ps); Render(h, &ps.rcPaint); EndPaint(hwnd, &ps); return 0; }
+        case WM_TIMER:
+            if (wParam == TIMER_RESCAN) refresh_state();
+            else { du_poll(); watch_poll(); view_invalidate(); }     // no-op unless results arrived
+            return 0;
         
         case WM_MOUSEWHEEL: 
             scroll_offset += ((short)HIWORD(wParam) > 0) ? -3 : 3;
@@ -1200,13 +1926,13 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
 
         case WM_MOUSEMOVE: {
             int idx = hit_test_index(GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
-            if (idx != hover_index) { hover_index = idx; InvalidateRect(hwnd, NULL, FALSE); }
+            if (idx != hover_index) { hover_index = idx; view_invalidate(); }
             return 0;
         }
         case WM_LBUTTONDOWN: {
             SetFocus(hwnd);
             int idx = hit_test_index(GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
-            if (idx >= 0) { selected_index = idx; InvalidateRect(hwnd, NULL, FALSE); }
+            if (idx >= 0) { selected_index = idx; view_invalidate(); }
             return 0;
         }
         case WM_LBUTTONDBLCLK: navigate_down(); return 0;
@@ -1221,16 +1947,17 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
         case WM_COMMAND:
             switch (LOWORD(wParam)) {
                 case CMD_OPEN: navigate_down(); break;
-                case CMD_OPEN_EXPLORER: if (entry_count) open_in_explorer(entries[selected_index].path); break;
+                case CMD_OPEN_EXPLORER: { char p[4096]; if (selected_path(p, sizeof(p))) open_in_explorer(p); break; }
                 case CMD_NEW_FOLDER: if(root_path[0]) CreateDirectoryA("New Folder", NULL); refresh_state(); break;
-                case CMD_COPY_ENTRY: if (entry_count) copy_to_clipboard(entries[selected_index].path); break;
+                case CMD_COPY_ENTRY: { char p[4096]; if (selected_path(p, sizeof(p))) copy_to_clipboard(p); break; }
                 case CMD_RENAME_ENTRY: rename_entry(); break;
-                case CMD_ADD_FAV: if (entry_count) pin_favorite(entries[selected_index].path); refresh_state(); break;
-                case CMD_REMOVE_FAV: if (entry_count) remove_favorite(entries[selected_index].path); refresh_state(); break;
+                case CMD_ADD_FAV: { char p[4096]; if (selected_path(p, sizeof(p))) pin_favorite(p); refresh_state(); break; }
+                case CMD_REMOVE_FAV: { char p[4096]; if (selected_path(p, sizeof(p))) remove_favorite(p); refresh_state(); break; }
                 case CMD_TOGGLE_VIEW: g_view_mode = !g_view_mode; InvalidateRect(hwnd, NULL, FALSE); break;
                 case CMD_DELETE_ENTRY: {
-                    if (entries[selected_index].is_drive) break;
-                    char p[MAX_PATH]; strcpy(p, entries[selected_index].path);
+                    if (selected_index < 0 || selected_index >= view_count || view_entry(selected_index)->is_drive) break;
+                    char p[MAX_PATH + 1];
+                    if (!selected_path(p, MAX_PATH)) break;
                     p[strlen(p)+1]=0; // double null
                     SHFILEOPSTRUCTA op={0}; op.hwnd=hwnd; op.wFunc=FO_DELETE; op.pFrom=p; op.fFlags=FOF_ALLOWUNDO|FOF_NOCONFIRMATION;
                     SHFileOperationA(&op); refresh_state(); break;
@@ -1244,7 +1971,7 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                 case VK_DOWN: selected_index += items_per_row; break;
                 case VK_LEFT: if (g_view_mode==VIEWMODE_GRID) selected_index--; break;
                 case VK_RIGHT: if (g_view_mode==VIEWMODE_GRID) selected_index++; break;
-                case VK_RETURN: if (GetKeyState(VK_CONTROL)&0x8000) open_in_explorer(entries[selected_index].path); else navigate_down(); break;
+                case VK_RETURN: if (GetKeyState(VK_CONTROL)&0x8000) { char p[4096]; if (selected_path(p, sizeof(p))) open_in_explorer(p); } else navigate_down(); break;
                 case VK_F2: rename_entry(); break;
                 case VK_F3: g_sort_mode=SORT_NAME; sort_entries(); break;
                 case VK_F4: g_sort_mode=SORT_SIZE; sort_entries(); break;
@@ -1255,11 +1982,12 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                     update_stacks(); 
                     sort_entries(); 
                     break;
+                case VK_F8: if (!search_buffer[0]) du_start_current(); break;
                 case VK_DELETE: SendMessage(hwnd, WM_COMMAND, CMD_DELETE_ENTRY, 0); break;
                 case 'O': if (GetKeyState(VK_CONTROL)&0x8000) handle_ctrl_o(); break;
                 case 'H': if (GetKeyState(VK_CONTROL)&0x8000) { show_help = !show_help; InvalidateRect(hwnd, NULL, FALSE); } break;
             }
-            InvalidateRect(hwnd, NULL, FALSE);
+            view_invalidate();
             return 0;
 
         case WM_CHAR:
@@ -1268,12 +1996,16 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                 else if (strlen(search_buffer)) { search_buffer[0]=0; refresh_state(); } 
                 else PostQuitMessage(0); 
             }
-            else if (wParam == VK_BACK) { int l=strlen(search_buffer); if (l) search_buffer[l-1]=0; else navigate_up(); refresh_state(); }
-            else if (wParam >= 32 && wParam < 127) { int l=strlen(search_buffer); search_buffer[l]=wParam; search_buffer[l+1]=0; refresh_state(); }
+            else if (wParam == VK_BACK) { int l=strlen(search_buffer); if (l) { search_buffer[l-1]=0; search_changed(); } else navigate_up(); }
+            else if (wParam >= 32 && wParam < 127) { int l=strlen(search_buffer); if (l < (int)sizeof(search_buffer) - 1) { search_buffer[l]=wParam; search_buffer[l+1]=0; search_changed(); } }
             return 0;
 
         case WM_DESTROY: 
-            running=0; KillTimer(hwnd, 1); clear_data(); free(entries);
+            running=0; KillTimer(hwnd, TIMER_REPAINT); KillTimer(hwnd, TIMER_RESCAN); stop_hunt(); clear_data();
+            if (du_run) { du_cancel(du_run); du_free(du_run); du_run = NULL; }
+            watch_stop(g_watch); g_watch = NULL; watch_batch_free(&watch_batch); watch_set_free(&watch_set); watch_nodes_free(&watch_nodes);
+            du_cache_free(&du_cache); VirtualFree(entries, 0, MEM_RELEASE); layout_free(&layout);
+            DeleteObject(brBg); DeleteObject(brHeader); DeleteObject(brAccent); DeleteObject(brHover); DeleteObject(brHelp); DeleteObject(brDir); DeleteObject(brDim);
             DeleteCriticalSection(&data_lock); CoUninitialize(); PostQuitMessage(0); return 0;
     }
     return DefWindowProc(hwnd, msg, wParam, lParam);
@@ -1281,8 +2013,10 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
 
 int WINAPI WinMain(HINSTANCE h, HINSTANCE p, LPSTR c, int s) {
     CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
-    entries = (Entry*)malloc(INITIAL_CAPACITY * sizeof(Entry));
-    entry_capacity = INITIAL_CAPACITY;
+    match_init();
+    entries = (Entry*)VirtualAlloc(NULL, MAX_RESULTS * sizeof(Entry), MEM_RESERVE, PAGE_READWRITE);
+    view_keys = (SortKey*)malloc(MAX_RESULTS * sizeof(SortKey));
+    if (!entries || !view_keys || !du_cache_init(&du_cache)) return 1;
     InitializeCriticalSection(&data_lock);
     WNDCLASSA wc = {0}; wc.style = CS_DBLCLKS; wc.lpfnWndProc = WndProc; wc.hInstance = h; wc.lpszClassName = "Blade"; wc.hCursor = LoadCursor(NULL, IDC_ARROW);
     RegisterClassA(&wc);
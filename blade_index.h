@@ -0,0 +1,694 @@
+// blade_index.h - Persistent memory-mapped filename index
+//
+// An index is built by the same parallel traversal as a live scan (blade_scan.h)
+// and written as fixed-layout arrays, so opening one is a single map call with no
+// parsing. Refreshing walks the old index and only re-enumerates directories whose
+// mtime changed; every other directory costs one attribute query and its children
+// are copied straight from the old index. Sizes and mtimes of files inside an
+// unchanged directory are therefore as fresh as that directory's last enumeration.
+//
+// File layout (little endian, sections 8-byte aligned):
+//   IndexHeader
+//   IndexDir[dir_count]       breadth-first, dir 0 is the root
+//   IndexEntry[entry_count]   children of each directory are contiguous and sorted by name
+//   names[names_size]         front-coded: [shared][suffix_len][suffix bytes] per entry,
+//                             shared is 0 for a directory's first child and every INDEX_RESTART'th
+//   root path                 NUL terminated
+
+#ifndef BLADE_INDEX_H
+#define BLADE_INDEX_H
+
+#include "blade_scan.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+// ==========================================
+// FORMAT
+// ==========================================
+#define INDEX_MAGIC "BLADEIX1"
+#define INDEX_VERSION 1
+#define INDEX_RESTART 16
+#define INDEX_NONE 0xFFFFFFFFu
+#define INDEX_NAME_MAX 255
+
+#define INDEX_F_DIR     1
+#define INDEX_F_REPARSE 2
+
+typedef struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dir_count;
+    uint32_t entry_count;
+    uint32_t root_len;
+    uint64_t dirs_off;
+    uint64_t entries_off;
+    uint64_t names_off;
+    uint64_t names_size;
+    uint64_t root_off;
+    uint64_t file_size;
+} IndexHeader;
+
+typedef struct IndexDir {
+    uint32_t entry;        // entry id of this directory, INDEX_NONE for the root
+    uint32_t parent;       // parent dir id, INDEX_NONE for the root
+    uint32_t first_child;
+    uint32_t child_count;
+    uint64_t mtime;        // directory mtime sampled before its children were enumerated
+} IndexDir;
+
+typedef struct IndexEntry {
+    uint32_t parent;       // dir id
+    uint32_t dir;          // dir id when this entry was descended into, else INDEX_NONE
+    uint32_t name_off;     // front-coded record in names[]
+    uint32_t flags;
+    uint64_t size;
+    uint64_t mtime;
+} IndexEntry;
+
+typedef struct BladeIndex {
+    const IndexHeader *hdr;
+    const IndexDir *dirs;
+    const IndexEntry *entries;
+    const uint8_t *names;
+    const char *root;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE map;
+#else
+    int fd;
+#endif
+    const void *base;
+} BladeIndex;
+
+// ==========================================
+// PLATFORM
+// ==========================================
+// Relative to the pinned parent fd when the engine has one
+static inline int index_stat_dir(const ScanJob *dir, uint64_t *mtime) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA fa;
+    if (!GetFileAttributesExA(dir->path, GetFileExInfoStandard, &fa)) return 0;
+    if (!(fa.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) return 0;
+    *mtime = ((uint64_t)fa.ftLastWriteTime.dwHighDateTime << 32) | fa.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat st;
+    int r = dir->parent ? fstatat((int)dir->parent->fd, dir->path + dir->name_off, &st, AT_SYMLINK_NOFOLLOW) : stat(dir->path, &st);
+    if (r != 0 || !S_ISDIR(st.st_mode)) return 0;
+    *mtime = fs_posix_mtime(&st);
+#endif
+    return 1;
+}
+
+static inline int index_replace_file(const char *tmp, const char *file) {
+#ifdef _WIN32
+    return MoveFileExA(tmp, file, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(tmp, file) == 0;
+#endif
+}
+
+// %LOCALAPPDATA%\BladeExplorer\index\<hash>.idx, or $XDG_CACHE_HOME/blade/<hash>.idx
+static inline void index_default_path(const char *root, char *out, size_t cap) {
+    uint64_t h = 1469598103934665603ULL;
+    for (const char *p = root; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+#ifdef _WIN32
+        if (c >= 'A' && c <= 'Z') c += 32;
+#endif
+        h = (h ^ c) * 1099511628211ULL;
+    }
+#ifdef _WIN32
+    const char *base = getenv("LOCALAPPDATA");
+    char dir[SCAN_PATH_MAX];
+    if (base) {
+        snprintf(dir, sizeof(dir), "%s\\BladeExplorer", base);
+        CreateDirectoryA(dir, NULL);
+        strncat(dir, "\\index", sizeof(dir) - strlen(dir) - 1);
+        CreateDirectoryA(dir, NULL);
+    } else strcpy(dir, ".");
+    snprintf(out, cap, "%s\\%016llx.idx", dir, (unsigned long long)h);
+#else
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char dir[SCAN_PATH_MAX];
+    if (xdg && *xdg) snprintf(dir, sizeof(dir), "%s/blade", xdg);
+    else if (home) {
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+        mkdir(dir, 0755);
+        strncat(dir, "/blade", sizeof(dir) - strlen(dir) - 1);
+    } else strcpy(dir, ".");
+    mkdir(dir, 0755);
+    snprintf(out, cap, "%s/%016llx.idx", dir, (unsigned long long)h);
+#endif
+}
+
+// ==========================================
+// OPEN / CLOSE
+// ==========================================
+static inline void index_close(BladeIndex *ix) {
+    if (!ix->base) return;
+#ifdef _WIN32
+    UnmapViewOfFile(ix->base);
+    CloseHandle(ix->map);
+    CloseHandle(ix->file);
+#else
+    munmap((void*)ix->base, ix->size);
+    close(ix->fd);
+#endif
+    memset(ix, 0, sizeof(*ix));
+}
+
+static inline int index_validate(BladeIndex *ix) {
+    const IndexHeader *h = (const IndexHeader*)ix->base;
+    if (ix->size < sizeof(IndexHeader)) return 0;
+    if (memcmp(h->magic, INDEX_MAGIC, 8) != 0 || h->version != INDEX_VERSION) return 0;
+    if (h->file_size != ix->size || h->dir_count == 0) return 0;
+    if (h->dirs_off + (uint64_t)h->dir_count * sizeof(IndexDir) > ix->size) return 0;
+    if (h->entries_off + (uint64_t)h->entry_count * sizeof(IndexEntry) > ix->size) return 0;
+    if (h->names_off + h->names_size > ix->size) return 0;
+    if (h->root_off + h->root_len + 1 > ix->size) return 0;
+
+    ix->hdr = h;
+    ix->dirs = (const IndexDir*)((const char*)ix->base + h->dirs_off);
+    ix->entries = (const IndexEntry*)((const char*)ix->base + h->entries_off);
+    ix->names = (const uint8_t*)ix->base + h->names_off;
+    ix->root = (const char*)ix->base + h->root_off;
+    return ix->root[h->root_len] == '\0';
+}
+
+static inline int index_open(BladeIndex *ix, const char *file) {
+    memset(ix, 0, sizeof(*ix));
+#ifdef _WIN32
+    ix->file = CreateFileA(file, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (ix->file == INVALID_HANDLE_VALUE) return 0;
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(ix->file, &sz) || sz.QuadPart == 0) { CloseHandle(ix->file); return 0; }
+    ix->size = (size_t)sz.QuadPart;
+    ix->map = CreateFileMappingA(ix->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!ix->map) { CloseHandle(ix->file); return 0; }
+    ix->base = MapViewOfFile(ix->map, FILE_MAP_READ, 0, 0, 0);
+    if (!ix->base) { CloseHandle(ix->map); CloseHandle(ix->file); return 0; }
+#else
+    ix->fd = open(file, O_RDONLY);
+    if (ix->fd < 0) return 0;
+    struct stat st;
+    if (fstat(ix->fd, &st) != 0 || st.st_size == 0) { close(ix->fd); return 0; }
+    ix->size = (size_t)st.st_size;
+    void *p = mmap(NULL, ix->size, PROT_READ, MAP_SHARED, ix->fd, 0);
+    if (p == MAP_FAILED) { close(ix->fd); return 0; }
+    ix->base = p;
+#endif
+    if (!index_validate(ix)) { index_close(ix); return 0; }
+    return 1;
+}
+
+// ==========================================
+// QUERIES
+// ==========================================
+static inline size_t index_decode(const BladeIndex *ix, uint32_t e, char *name) {
+    const uint8_t *p = ix->names + ix->entries[e].name_off;
+    memcpy(name + p[0], p + 2, p[1]);
+    size_t len = (size_t)p[0] + p[1];
+    name[len] = '\0';
+    return len;
+}
+
+// name must hold INDEX_NAME_MAX + 1 bytes
+static inline size_t index_entry_name(const BladeIndex *ix, uint32_t e, char *name) {
+    const IndexDir *d = &ix->dirs[ix->entries[e].parent];
+    uint32_t k = e - d->first_child;
+    uint32_t i = e - (k % INDEX_RESTART);
+    size_t len = 0;
+    for (; i <= e; i++) len = index_decode(ix, i, name);
+    return len;
+}
+
+// Full path of an entry rebuilt from its parent chain. Returns 0 if it does not fit.
+static inline size_t index_entry_path(const BladeIndex *ix, uint32_t e, char *out, size_t cap) {
+    uint32_t chain[SCAN_PATH_MAX / 2];
+    int depth = 0;
+    for (uint32_t cur = e; cur != INDEX_NONE && depth < (int)(sizeof(chain) / sizeof(chain[0])); depth++) {
+        chain[depth] = cur;
+        cur = ix->dirs[ix->entries[cur].parent].entry;
+    }
+
+    size_t len = ix->hdr->root_len;
+    if (len + 1 > cap) return 0;
+    memcpy(out, ix->root, len);
+    char name[INDEX_NAME_MAX + 1];
+    while (depth-- > 0) {
+        size_t n = index_entry_name(ix, chain[depth], name);
+        int need_sep = (len > 0 && out[len - 1] != '\\' && out[len - 1] != '/');
+        if (len + need_sep + n + 1 > cap) return 0;
+        if (need_sep) out[len++] = SCAN_SEP;
+        memcpy(out + len, name, n);
+        len += n;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+// Visits every entry in storage order, decoding front-coded names incrementally.
+// Returning nonzero from fn stops the walk.
+typedef int (*index_visit_fn)(void *user, const BladeIndex *ix, uint32_t entry, const char *name, size_t len);
+
+static inline void index_foreach(const BladeIndex *ix, index_visit_fn fn, void *user) {
+    char name[INDEX_NAME_MAX + 1 + 32]; // slack for SIMD matchers that over-read
+    memset(name, 0, sizeof(name));
+    uint32_t n = ix->hdr->entry_count;
+    for (uint32_t e = 0; e < n; e++) {
+        size_t len = index_decode(ix, e, name);
+        if (fn(user, ix, e, name, len)) break;
+    }
+}
+
+static inline int index_name_cmp(const char *a, size_t alen, const char *b, size_t blen) {
+    int c = memcmp(a, b, alen < blen ? alen : blen);
+    if (c) return c;
+    return (alen > blen) - (alen < blen);
+}
+
+// Binary search over the restart points of a directory, then a short linear decode
+static inline uint32_t index_find_child(const BladeIndex *ix, uint32_t dir, const char *name, size_t len) {
+    const IndexDir *d = &ix->dirs[dir];
+    if (d->child_count == 0) return INDEX_NONE;
+    uint32_t blocks = (d->child_count + INDEX_RESTART - 1) / INDEX_RESTART;
+    uint32_t lo = 0, hi = blocks;
+    char buf[INDEX_NAME_MAX + 1];
+    while (hi - lo > 1) {
+        uint32_t mid = (lo + hi) / 2;
+        size_t n = index_decode(ix, d->first_child + mid * INDEX_RESTART, buf);
+        if (index_name_cmp(buf, n, name, len) <= 0) lo = mid; else hi = mid;
+    }
+    uint32_t first = d->first_child + lo * INDEX_RESTART;
+    uint32_t last = d->first_child + d->child_count;
+    if (last > first + INDEX_RESTART) last = first + INDEX_RESTART;
+    for (uint32_t e = first; e < last; e++) {
+        size_t n = index_decode(ix, e, buf);
+        int c = index_name_cmp(buf, n, name, len);
+        if (c == 0) return e;
+        if (c > 0) break;
+    }
+    return INDEX_NONE;
+}
+
+// ==========================================
+// BUILD / REFRESH
+// ==========================================
+typedef struct IndexRec IndexRec;
+
+typedef struct IndexChild {
+    const char *name;
+    uint32_t name_len;
+    uint32_t flags;
+    uint64_t size;
+    uint64_t mtime;
+    IndexRec *rec;          // this child's own directory record, set while linking
+} IndexChild;
+
+// One directory's children, either freshly enumerated or carried over from the old index
+struct IndexRec {
+    IndexRec *next;
+    uint32_t id;
+    uint32_t parent_id;
+    uint64_t mtime;
+    const char *name;
+    uint32_t name_len;
+    uint32_t child_count;
+    IndexChild *children;
+    uint32_t out_entry;     // filled in by index_write
+    uint32_t out_parent;
+};
+
+typedef struct IndexArena {
+    struct IndexArena *next;
+    size_t used;
+    size_t cap;
+    char data[];
+} IndexArena;
+
+typedef struct IndexBuilder {
+    IndexArena *arena;
+    IndexRec *recs;
+    IndexChild *tmp;
+    size_t tmp_count;
+    size_t tmp_cap;
+    uint64_t cur_mtime;
+} IndexBuilder;
+
+typedef struct IndexBuild {
+    const BladeIndex *old;  // NULL for a full build
+    long changed;           // directories that had to be enumerated
+    IndexBuilder *builders[SCAN_MAX_THREADS];
+} IndexBuild;
+
+static inline void* index_arena_alloc(IndexBuilder *b, size_t n) {
+    n = (n + 7) & ~(size_t)7;
+    if (!b->arena || b->arena->used + n > b->arena->cap) {
+        size_t cap = n > (1 << 20) ? n : (1 << 20);
+        IndexArena *a = (IndexArena*)malloc(sizeof(IndexArena) + cap);
+        if (!a) return NULL;
+        a->next = b->arena;
+        a->used = 0;
+        a->cap = cap;
+        b->arena = a;
+    }
+    void *p = b->arena->data + b->arena->used;
+    b->arena->used += n;
+    return p;
+}
+
+static inline int index_child_cmp(const void *pa, const void *pb) {
+    const IndexChild *a = (const IndexChild*)pa;
+    const IndexChild *b = (const IndexChild*)pb;
+    return index_name_cmp(a->name, a->name_len, b->name, b->name_len);
+}
+
+static inline IndexRec* index_new_rec(IndexBuilder *b, const ScanJob *dir, uint64_t mtime, size_t child_count) {
+    IndexRec *r = (IndexRec*)index_arena_alloc(b, sizeof(IndexRec));
+    IndexChild *c = child_count ? (IndexChild*)index_arena_alloc(b, child_count * sizeof(IndexChild)) : NULL;
+    if (!r || (child_count && !c)) return NULL;
+    r->id = dir->id;
+    r->parent_id = dir->parent_id;
+    r->mtime = mtime;
+    r->name = dir->path + dir->name_off;
+    r->name_len = dir->len - dir->name_off;
+    r->child_count = (uint32_t)child_count;
+    r->children = c;
+    // The job's path lives in a recycled scan chunk: keep our own copy of the leaf name
+    char *name = (char*)index_arena_alloc(b, r->name_len + 1);
+    if (!name) return NULL;
+    memcpy(name, r->name, r->name_len);
+    name[r->name_len] = '\0';
+    r->name = name;
+    r->next = b->recs;
+    b->recs = r;
+    return r;
+}
+
+static inline void index_on_start(ScanWorker *w) {
+    IndexBuilder *b = (IndexBuilder*)calloc(1, sizeof(IndexBuilder));
+    ((IndexBuild*)w->ctx->user)->builders[w->id] = b;
+    w->local = b;
+}
+
+static inline int index_on_dir(ScanWorker *w, const ScanJob *dir) {
+    IndexBuilder *b = (IndexBuilder*)w->local;
+    IndexBuild *build = (IndexBuild*)w->ctx->user;
+    if (!b) return SCAN_SKIP;
+
+    uint64_t mtime;
+    if (!index_stat_dir(dir, &mtime)) return SCAN_SKIP;
+
+    const BladeIndex *old = build->old;
+    if (old && dir->tag) {
+        const IndexDir *od = &old->dirs[dir->tag - 1];
+        if (od->mtime != 0 && od->mtime == mtime) {
+            // Unchanged: carry the children over and descend into the old subdirectories
+            IndexRec *r = index_new_rec(b, dir, mtime, od->child_count);
+            if (!r) return SCAN_SKIP;
+            char name[INDEX_NAME_MAX + 1];
+            for (uint32_t i = 0; i < od->child_count; i++) {
+                uint32_t e = od->first_child + i;
+                const IndexEntry *oe = &old->entries[e];
+                size_t n = index_decode(old, e, name);
+                char *copy = (char*)index_arena_alloc(b, n + 1);
+                if (!copy) return SCAN_SKIP;
+                memcpy(copy, name, n + 1);
+                IndexChild *c = &r->children[i];
+                c->name = copy;
+                c->name_len = (uint32_t)n;
+                c->flags = oe->flags;
+                c->size = oe->size;
+                c->mtime = oe->mtime;
+                c->rec = NULL;
+                // Directories that could not be enumerated last time (no dir id) are retried from scratch
+                if ((oe->flags & INDEX_F_DIR) && !(oe->flags & INDEX_F_REPARSE))
+                    scan_push_child(w, dir, copy, n, oe->dir != INDEX_NONE ? oe->dir + 1 : 0);
+            }
+            return SCAN_SKIP;
+        }
+    }
+
+    scan_inc(&build->changed);
+    b->cur_mtime = mtime;
+    b->tmp_count = 0;
+    return SCAN_CONTINUE;
+}
+
+static inline int index_on_entry(ScanWorker *w, const ScanJob *dir, ScanEntry *e) {
+    IndexBuilder *b = (IndexBuilder*)w->local;
+    IndexBuild *build = (IndexBuild*)w->ctx->user;
+    if (e->name_len > INDEX_NAME_MAX) return SCAN_SKIP;
+    if (!scan_entry_stat(e)) return SCAN_SKIP;
+
+    if (b->tmp_count == b->tmp_cap) {
+        size_t cap = b->tmp_cap ? b->tmp_cap * 2 : 1024;
+        IndexChild *t = (IndexChild*)realloc(b->tmp, cap * sizeof(IndexChild));
+        if (!t) return SCAN_SKIP;
+        b->tmp = t;
+        b->tmp_cap = cap;
+    }
+    char *copy = (char*)index_arena_alloc(b, e->name_len + 1);
+    if (!copy) return SCAN_SKIP;
+    memcpy(copy, e->name, e->name_len + 1);
+
+    IndexChild *c = &b->tmp[b->tmp_count++];
+    c->name = copy;
+    c->name_len = (uint32_t)e->name_len;
+    c->flags = (e->is_dir ? INDEX_F_DIR : 0) | (e->is_reparse ? INDEX_F_REPARSE : 0);
+    c->size = e->size;
+    c->mtime = e->mtime;
+    c->rec = NULL;
+
+    // A changed directory can still contain unchanged subdirectories
+    if (e->is_dir && build->old && dir->tag) {
+        uint32_t oe = index_find_child(build->old, dir->tag - 1, e->name, e->name_len);
+        if (oe != INDEX_NONE && build->old->entries[oe].dir != INDEX_NONE) e->tag = build->old->entries[oe].dir + 1;
+    }
+    return SCAN_CONTINUE;
+}
+
+static inline void index_on_dir_end(ScanWorker *w, const ScanJob *dir) {
+    IndexBuilder *b = (IndexBuilder*)w->local;
+    IndexRec *r = index_new_rec(b, dir, b->cur_mtime, b->tmp_count);
+    if (!r) return;
+    if (b->tmp_count) {
+        qsort(b->tmp, b->tmp_count, sizeof(IndexChild), index_child_cmp);
+        memcpy(r->children, b->tmp, b->tmp_count * sizeof(IndexChild));
+    }
+}
+
+static inline void index_builders_free(IndexBuild *build) {
+    for (int i = 0; i < SCAN_MAX_THREADS; i++) {
+        IndexBuilder *b = build->builders[i];
+        if (!b) continue;
+        IndexArena *a = b->arena;
+        while (a) { IndexArena *next = a->next; free(a); a = next; }
+        free(b->tmp);
+        free(b);
+        build->builders[i] = NULL;
+    }
+}
+
+typedef struct IndexWriter {
+    FILE *f;
+    uint64_t off;
+    int ok;
+} IndexWriter;
+
+static inline void index_put(IndexWriter *wr, const void *p, size_t n) {
+    if (wr->ok && n && fwrite(p, 1, n, wr->f) != n) wr->ok = 0;
+    wr->off += n;
+}
+
+static inline void index_align(IndexWriter *wr) {
+    static const char zero[8] = {0};
+    if (wr->off & 7) index_put(wr, zero, 8 - (size_t)(wr->off & 7));
+}
+
+// Front coding: bytes shared with the previous sibling, 0 at restart points
+static inline uint32_t index_shared(const IndexRec *r, uint32_t i) {
+    if (i % INDEX_RESTART == 0) return 0;
+    const IndexChild *p = &r->children[i - 1];
+    const IndexChild *c = &r->children[i];
+    uint32_t m = p->name_len < c->name_len ? p->name_len : c->name_len;
+    uint32_t shared = 0;
+    while (shared < m && p->name[shared] == c->name[shared]) shared++;
+    return shared;
+}
+
+// Links the per-worker records into one tree and writes it breadth-first
+static inline int index_write(IndexBuild *build, uint32_t max_id, const char *root, const char *file) {
+    IndexRec **by_id = (IndexRec**)calloc((size_t)max_id + 1, sizeof(IndexRec*));
+    if (!by_id) return 0;
+    IndexRec *root_rec = NULL;
+    for (int i = 0; i < SCAN_MAX_THREADS; i++) {
+        if (!build->builders[i]) continue;
+        for (IndexRec *r = build->builders[i]->recs; r; r = r->next) {
+            if (r->id <= max_id) by_id[r->id] = r;
+            if (r->parent_id == 0) root_rec = r;
+        }
+    }
+    if (!root_rec) { free(by_id); return 0; }
+
+    uint64_t dir_count = 0, entry_count = 0;
+    for (uint32_t id = 1; id <= max_id; id++) {
+        IndexRec *r = by_id[id];
+        if (!r) continue;
+        if (r->parent_id) {
+            IndexRec *p = r->parent_id <= max_id ? by_id[r->parent_id] : NULL;
+            if (!p) continue;
+            IndexChild key = { r->name, r->name_len, 0, 0, 0, NULL };
+            IndexChild *c = (IndexChild*)bsearch(&key, p->children, p->child_count, sizeof(IndexChild), index_child_cmp);
+            if (c) c->rec = r;
+        }
+    }
+
+    // Breadth-first order: dirs[] doubles as the queue
+    IndexRec **queue = (IndexRec**)malloc(((size_t)max_id + 1) * sizeof(IndexRec*));
+    if (!queue) { free(by_id); return 0; }
+    size_t qn = 0;
+    queue[qn++] = root_rec;
+    for (size_t qi = 0; qi < qn; qi++) {
+        IndexRec *r = queue[qi];
+        entry_count += r->child_count;
+        for (uint32_t i = 0; i < r->child_count; i++) {
+            if (r->children[i].rec && qn <= max_id) queue[qn++] = r->children[i].rec;
+        }
+    }
+    dir_count = qn;
+    if (entry_count >= INDEX_NONE || dir_count >= INDEX_NONE) { free(queue); free(by_id); return 0; }
+
+    char tmp[SCAN_PATH_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+    IndexWriter wr = { fopen(tmp, "wb"), 0, 1 };
+    if (!wr.f) { free(queue); free(by_id); return 0; }
+
+    IndexHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, INDEX_MAGIC, 8);
+    h.version = INDEX_VERSION;
+    h.dir_count = (uint32_t)dir_count;
+    h.entry_count = (uint32_t)entry_count;
+    h.root_len = (uint32_t)strlen(root);
+    h.dirs_off = sizeof(IndexHeader);
+    h.entries_off = h.dirs_off + dir_count * sizeof(IndexDir);
+    h.names_off = h.entries_off + entry_count * sizeof(IndexEntry);
+    index_put(&wr, &h, sizeof(h));
+
+    // Directory table: dir ids follow queue order, entry ids follow the same order
+    uint32_t next_entry = 0;
+    for (size_t qi = 0; qi < qn; qi++) {
+        IndexRec *r = queue[qi];
+        IndexDir d;
+        d.entry = qi ? r->out_entry : INDEX_NONE;
+        d.parent = qi ? r->out_parent : INDEX_NONE;
+        d.first_child = next_entry;
+        d.child_count = r->child_count;
+        d.mtime = r->mtime;
+        index_put(&wr, &d, sizeof(d));
+        for (uint32_t i = 0; i < r->child_count; i++) {
+            IndexRec *c = r->children[i].rec;
+            if (c) { c->out_entry = next_entry + i; c->out_parent = (uint32_t)qi; }
+        }
+        next_entry += r->child_count;
+    }
+
+    // Entry table. Child directories were queued in exactly this order.
+    uint32_t name_off = 0, child_dir = 1;
+    for (size_t qi = 0; qi < qn; qi++) {
+        IndexRec *r = queue[qi];
+        for (uint32_t i = 0; i < r->child_count; i++) {
+            IndexChild *c = &r->children[i];
+            IndexEntry e;
+            e.parent = (uint32_t)qi;
+            e.dir = c->rec ? child_dir++ : INDEX_NONE;
+            e.name_off = name_off;
+            e.flags = c->flags;
+            e.size = c->size;
+            e.mtime = c->mtime;
+            index_put(&wr, &e, sizeof(e));
+            name_off += 2 + (c->name_len - index_shared(r, i));
+        }
+    }
+
+    // Names
+    for (size_t qi = 0; qi < qn; qi++) {
+        IndexRec *r = queue[qi];
+        for (uint32_t i = 0; i < r->child_count; i++) {
+            IndexChild *c = &r->children[i];
+            uint32_t shared = index_shared(r, i);
+            uint8_t hdr[2] = { (uint8_t)shared, (uint8_t)(c->name_len - shared) };
+            index_put(&wr, hdr, 2);
+            index_put(&wr, c->name + shared, c->name_len - shared);
+        }
+    }
+    h.names_size = name_off;
+    index_align(&wr);
+    h.root_off = wr.off;
+    index_put(&wr, root, h.root_len + 1);
+    index_align(&wr);
+    h.file_size = wr.off;
+
+    if (wr.ok && fseek(wr.f, 0, SEEK_SET) == 0) index_put(&wr, &h, sizeof(h));
+    if (fclose(wr.f) != 0) wr.ok = 0;
+    free(queue);
+    free(by_id);
+    if (!wr.ok) { remove(tmp); return 0; }
+    return 1;
+}
+
+// Full build (old == NULL) or incremental refresh of 'old'. On success the new index is
+// left in <file>.tmp and 1 is returned; 0 means nothing changed, -1 an error.
+static inline int index_collect(const char *root, const char *file, const BladeIndex *old, int threads, long *changed) {
+    IndexBuild build;
+    memset(&build, 0, sizeof(build));
+    build.old = old;
+
+    ScanCtx *ctx = scan_create(threads, &build);
+    if (!ctx) return -1;
+    ctx->on_start = index_on_start;
+    ctx->on_dir = index_on_dir;
+    ctx->on_entry = index_on_entry;
+    ctx->on_dir_end = index_on_dir_end;
+    scan_add_root_tagged(ctx, root, old ? 1 : 0);
+    scan_start(ctx);
+    scan_wait(ctx);
+    uint32_t max_id = ctx->next_id;
+    scan_release(ctx);
+
+    if (changed) *changed = build.changed;
+    int r = 0;
+    if (!old || build.changed > 0) r = index_write(&build, max_id, root, file) ? 1 : -1;
+    index_builders_free(&build);
+    return r;
+}
+
+static inline int index_build(const char *root, const char *file, int threads) {
+    char tmp[SCAN_PATH_MAX + 8];
+    if (index_collect(root, file, NULL, threads, NULL) != 1) return 0;
+    snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+    return index_replace_file(tmp, file);
+}
+
+// Re-enumerates only directories whose mtime changed and swaps the new index in place.
+// Returns the number of directories that were re-enumerated, or -1 on error.
+static inline long index_refresh(BladeIndex *ix, const char *file, int threads) {
+    char root[SCAN_PATH_MAX];
+    char tmp[SCAN_PATH_MAX + 8];
+    long changed = 0;
+    snprintf(root, sizeof(root), "%s", ix->root);
+    int r = index_collect(root, file, ix, threads, &changed);
+    if (r < 0) return -1;
+    if (r == 0) return 0;
+    index_close(ix);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+    if (!index_replace_file(tmp, file)) return -1;
+    return index_open(ix, file) ? changed : -1;
+}
+
+#endif // BLADE_INDEX_H
@@ -0,0 +1,269 @@
+// blade_layout.h - Row layout and dirty tracking for the GUI list and grid views
+//
+// One row per list item or grid row: its first entry, its y offset from the
+// top of the list, and whether it opens a group with a header band above it.
+// Rows are appended as entries arrive, and an insertion only lays out again
+// from the row it lands in; the caller resets the layout whenever entries are
+// reordered or the geometry changes. Drawing then visits only the visible rows and hit
+// testing is a binary search.
+//
+// layout_dirty compares the frame last handed to the window with the current
+// one and returns the view rectangles that changed (selection, hover, rows
+// from the first inserted or appended entry down), so the GUI can repaint
+// those instead of the whole window.
+//
+// Nothing here touches GDI: view coordinates are plain ints, so the layout can
+// be built and measured outside Windows.
+
+#ifndef BLADE_LAYOUT_H
+#define BLADE_LAYOUT_H
+
+#include <stdlib.h>
+#include <string.h>
+
+// ==========================================
+// CONFIGURATION
+// ==========================================
+#define LAYOUT_SAME   0     // entry continues the previous entry's group
+#define LAYOUT_GROUP  1     // entry opens a group without a header
+#define LAYOUT_HEADER 2     // entry opens a group with a header band
+
+#define LAYOUT_MAX_DIRTY 8
+
+// ==========================================
+// DATA STRUCTURES
+// ==========================================
+typedef struct {
+    int per_row;        // items per row (1 in list view)
+    int row_height;
+    int header_height;  // group header band above a row
+    int item_width;     // grid column width; 0 means an item spans the whole row
+    int left;           // x of column 0
+    int top;            // view y of the first row drawn
+} LayoutGeom;
+
+typedef struct {
+    long first;     // first entry in the row
+    int y;          // top of the row's items
+    int header;     // the row opens a group and has a header band above it
+} LayoutRow;
+
+typedef struct {
+    LayoutGeom geom;
+    LayoutRow *rows;
+    long row_count;
+    long row_capacity;
+    long entries;       // entries laid out so far
+    int next_y;         // top of the row after the last one
+    long builds;        // bumped by every reset
+} Layout;
+
+typedef struct {
+    int left, top, right, bottom;
+} LayoutRect;
+
+// What a painted frame showed; two frames are compared by layout_dirty
+typedef struct {
+    long builds;
+    long count;
+    long scroll;
+    long selected;
+    long hover;
+    int width;
+    int height;
+} LayoutFrame;
+
+// Says whether entry i opens a group (LAYOUT_SAME / LAYOUT_GROUP / LAYOUT_HEADER).
+// Entry 0 always opens one, so only the header choice matters there.
+typedef int (*LayoutGroupFn)(void *ctx, long i);
+
+// ==========================================
+// BUILDING
+// ==========================================
+static inline void layout_reset(Layout *l, const LayoutGeom *g) {
+    l->geom = *g;
+    if (l->geom.per_row < 1) l->geom.per_row = 1;
+    l->row_count = 0;
+    l->entries = 0;
+    l->next_y = 0;
+    l->builds++;
+}
+
+static inline void layout_free(Layout *l) {
+    free(l->rows);
+    l->rows = NULL;
+    l->row_count = l->row_capacity = 0;
+    l->entries = 0;
+}
+
+// Lays out entries [l->entries, count). Returns 0 if rows could not grow.
+static inline int layout_extend(Layout *l, long count, LayoutGroupFn group, void *ctx) {
+    if (count <= l->entries) return 1;
+
+    // The last row may have been partial, so it is laid out again
+    long i = l->entries;
+    int y = l->next_y;
+    if (l->row_count > 0) {
+        LayoutRow *last = &l->rows[--l->row_count];
+        i = last->first;
+        y = last->y - (last->header ? l->geom.header_height : 0);
+    }
+
+    int ok = 1;
+    for (; i < count; i++) {
+        int g = group(ctx, i);
+        if (i == 0 && g == LAYOUT_SAME) g = LAYOUT_GROUP;
+        if (g == LAYOUT_SAME && l->row_count > 0 && i - l->rows[l->row_count - 1].first < l->geom.per_row) continue;
+
+        if (l->row_count == l->row_capacity) {
+            long cap = l->row_capacity ? l->row_capacity * 2 : 1024;
+            LayoutRow *grown = (LayoutRow*)realloc(l->rows, cap * sizeof(LayoutRow));
+            if (!grown) { ok = 0; break; }
+            l->rows = grown;
+            l->row_capacity = cap;
+        }
+        LayoutRow *row = &l->rows[l->row_count++];
+        row->first = i;
+        row->header = (g == LAYOUT_HEADER);
+        row->y = y + (row->header ? l->geom.header_height : 0);
+        y = row->y + l->geom.row_height;
+    }
+    l->entries = i;
+    l->next_y = y;
+    return ok;
+}
+
+// Forgets the layout from the row holding entry i on, so the next
+// layout_extend lays out entries [i, count) again (after an insertion at i)
+static inline void layout_rewind(Layout *l, long i) {
+    if (i >= l->entries) return;
+    long lo = 0, hi = l->row_count;
+    while (lo < hi) { long mid = lo + (hi - lo) / 2; if (l->rows[mid].first <= i) lo = mid + 1; else hi = mid; }
+    if (lo == 0) {
+        l->row_count = 0;
+        l->entries = 0;
+        l->next_y = 0;
+        return;
+    }
+    l->row_count = lo;      // the row holding i is reopened by layout_extend
+    l->entries = l->rows[lo - 1].first;
+}
+
+// ==========================================
+// QUERIES
+// ==========================================
+// One past the last entry of row r
+static inline long layout_row_end(const Layout *l, long r, long count) {
+    long end = r + 1 < l->row_count ? l->rows[r + 1].first : l->entries;
+    return end < count ? end : count;
+}
+
+// Row holding entry i, or -1. *origin is the layout y drawn at geom.top when
+// scrolled to i: a row's header is only shown if i opens the row.
+static inline long layout_row_of(const Layout *l, long i, int *origin) {
+    long lo = 0, hi = l->row_count;
+    while (lo < hi) { long mid = lo + (hi - lo) / 2; if (l->rows[mid].first <= i) lo = mid + 1; else hi = mid; }
+    *origin = 0;
+    if (lo == 0) return -1;
+    const LayoutRow *row = &l->rows[lo - 1];
+    *origin = row->y - (row->first == i && row->header ? l->geom.header_height : 0);
+    return lo - 1;
+}
+
+// View y of row r, for the origin layout_row_of gave the scroll position
+static inline int layout_row_view_y(const Layout *l, long r, int origin) {
+    return l->geom.top + l->rows[r].y - origin;
+}
+
+// Entry under view point (x, y) when scrolled to entry scroll, or -1
+static inline long layout_hit(const Layout *l, long scroll, long count, int x, int y) {
+    int origin;
+    if (y < l->geom.top || scroll >= count || layout_row_of(l, scroll, &origin) < 0) return -1;
+    int ly = y - l->geom.top + origin;
+
+    // Last row starting at or above ly
+    long lo = 0, hi = l->row_count;
+    while (lo < hi) { long mid = lo + (hi - lo) / 2; if (l->rows[mid].y <= ly) lo = mid + 1; else hi = mid; }
+    if (lo == 0) return -1;
+    const LayoutRow *row = &l->rows[lo - 1];
+    if (ly >= row->y + l->geom.row_height) return -1;   // group header band
+
+    long i = row->first;
+    if (l->geom.item_width > 0) {
+        if (x < l->geom.left) return -1;
+        i += (x - l->geom.left) / l->geom.item_width;
+        if (i >= layout_row_end(l, lo - 1, count)) return -1;
+    }
+    return i >= scroll ? i : -1;
+}
+
+// View rectangle of entry i in a view width wide. Returns 0 if i is above the
+// scroll position or not laid out.
+static inline int layout_item_rect(const Layout *l, long i, long scroll, int width, LayoutRect *out) {
+    int origin, unused;
+    if (i < scroll || i >= l->entries || layout_row_of(l, scroll, &origin) < 0) return 0;
+    long r = layout_row_of(l, i, &unused);
+    if (r < 0) return 0;
+    out->top = layout_row_view_y(l, r, origin);
+    out->bottom = out->top + l->geom.row_height;
+    if (l->geom.item_width > 0) {
+        out->left = l->geom.left + (int)(i - l->rows[r].first) * l->geom.item_width;
+        out->right = out->left + l->geom.item_width;
+    } else {
+        out->left = 0;
+        out->right = width;
+    }
+    return 1;
+}
+
+// ==========================================
+// DIRTY TRACKING
+// ==========================================
+static inline int layout_dirty_add(LayoutRect *out, int cap, int *n, const LayoutRect *r, const LayoutFrame *f) {
+    if (r->top >= f->height || r->bottom <= 0) return 1;   // off screen
+    if (*n == cap) return 0;
+    out[(*n)++] = *r;
+    return 1;
+}
+
+static inline int layout_dirty_item(const Layout *l, long i, const LayoutFrame *f, LayoutRect *out, int cap, int *n) {
+    LayoutRect r;
+    if (i < 0 || i >= f->count || !layout_item_rect(l, i, f->scroll, f->width, &r)) return 1;
+    return layout_dirty_add(out, cap, n, &r, f);
+}
+
+// Rectangles that differ between frame was and frame now (both taken against
+// layout l, now being current). changed is the first entry inserted since was,
+// or now->count if entries were only appended. Returns how many rectangles
+// were written to out, or -1 when the whole view has to be repainted.
+static inline int layout_dirty(const Layout *l, const LayoutFrame *was, const LayoutFrame *now, long changed, LayoutRect *out, int cap) {
+    if (was->builds != now->builds || was->scroll != now->scroll || was->width != now->width ||
+        was->height != now->height || now->count < was->count) return -1;
+
+    int n = 0;
+    if (was->selected != now->selected) {
+        if (!layout_dirty_item(l, was->selected, now, out, cap, &n) || !layout_dirty_item(l, now->selected, now, out, cap, &n)) return -1;
+    }
+    if (was->hover != now->hover) {
+        if (!layout_dirty_item(l, was->hover, now, out, cap, &n) || !layout_dirty_item(l, now->hover, now, out, cap, &n)) return -1;
+    }
+
+    // New entries: from the row that received the first of them down
+    if (changed > was->count) changed = was->count;
+    if (changed < now->count) {
+        int origin, unused;
+        if (layout_row_of(l, now->scroll, &origin) < 0) return -1;
+        long row = layout_row_of(l, changed, &unused);
+        if (row < 0) return -1;
+        LayoutRect r;
+        r.top = layout_row_view_y(l, row, origin) - (l->rows[row].header ? l->geom.header_height : 0);
+        if (r.top < l->geom.top) r.top = l->geom.top;
+        r.bottom = now->height;
+        r.left = 0;
+        r.right = now->width;
+        if (!layout_dirty_add(out, cap, &n, &r, now)) return -1;
+    }
+    return n;
+}
+
+#endif // BLADE_LAYOUT_H
@@ -0,0 +1,365 @@
+// blade_match.h - Case-insensitive substring kernels with runtime CPU dispatch
+//
+// One binary, no -mavx2: every SIMD kernel is compiled with a target attribute
+// and match_init picks the widest one the CPU (and OS, via XGETBV) supports.
+// Kernels compare the needle's first and last byte at every position of a
+// block and verify only where both hit. Full blocks stop where the last-byte
+// load would cross the end. The tail is a masked load (AVX-512BW) or, for SSE2
+// and AVX2, a plain load that may read up to 15 / 31 bytes past s[len - 1]
+// while those stay in the page of the last byte, and a copy into a padded stack
+// buffer otherwise. So a kernel may read past the end within the page of the
+// last byte, never into the next page; bytes past the end never affect results.
+//
+// BLADE_SIMD=scalar|sse2|avx2|avx512 caps the level for diagnosis.
+
+#ifndef BLADE_MATCH_H
+#define BLADE_MATCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MATCH_X86 1
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+// ==========================================
+// CONFIGURATION
+// ==========================================
+#define MATCH_NEEDLE_MAX 255
+
+#define MATCH_SCALAR 0
+#define MATCH_SSE2   1
+#define MATCH_AVX2   2
+#define MATCH_AVX512 3
+
+#ifndef bit_AVX512F
+#define bit_AVX512F (1 << 16)
+#endif
+#ifndef bit_AVX512BW
+#define bit_AVX512BW (1 << 30)
+#endif
+
+// ==========================================
+// DATA STRUCTURES
+// ==========================================
+typedef struct MatchNeedle {
+    char text[MATCH_NEEDLE_MAX + 1];    // ASCII lowercased
+    uint32_t len;
+    uint8_t first, last;
+} MatchNeedle;
+
+// 1 + offset of the first occurrence of the needle in s[0..len), 0 if there is none.
+// s need not be NUL terminated; see the header for what past s[len - 1] may be read.
+typedef size_t (*match_fn)(const MatchNeedle *n, const char *s, size_t len);
+
+static const char *const match_level_names[] = { "scalar", "sse2", "avx2", "avx512" };
+static uint8_t match_fold[256];
+static int match_cpu = -1;          // detected level
+static int match_active = MATCH_SCALAR;
+static match_fn match_find;
+
+static inline void match_needle(MatchNeedle *n, const char *s, size_t len) {
+    if (len > MATCH_NEEDLE_MAX) len = MATCH_NEEDLE_MAX;
+    for (size_t i = 0; i < len; i++) n->text[i] = (char)match_fold[(uint8_t)s[i]];
+    n->text[len] = '\0';
+    n->len = (uint32_t)len;
+    n->first = len ? (uint8_t)n->text[0] : 0;
+    n->last = len ? (uint8_t)n->text[len - 1] : 0;
+}
+
+// Middle bytes only; the kernels have already matched first and last
+static inline int match_verify(const MatchNeedle *n, const char *s) {
+    for (uint32_t k = 1; k + 1 < n->len; k++) {
+        if (match_fold[(uint8_t)s[k]] != (uint8_t)n->text[k]) return 0;
+    }
+    return 1;
+}
+
+// ==========================================
+// SCALAR
+// ==========================================
+static inline size_t match_scalar(const MatchNeedle *n, const char *s, size_t len) {
+    if (n->len == 0) return 1;
+    if (len < n->len) return 0;
+    size_t last = len - n->len;
+    for (size_t i = 0; i <= last; i++) {
+        if (match_fold[(uint8_t)s[i]] == n->first && match_fold[(uint8_t)s[i + n->len - 1]] == n->last && match_verify(n, s + i)) return i + 1;
+    }
+    return 0;
+}
+
+#ifdef MATCH_X86
+// Tail loads may run past the name but never into the next page, where they could
+// fault. Such reads are deliberate, so address sanitizers are told to skip them.
+#define MATCH_PAGE 4096
+#define MATCH_NO_ASAN __attribute__((no_sanitize_address))
+
+static inline int match_same_page(const char *last, const char *end) {
+    return ((uintptr_t)last / MATCH_PAGE) == ((uintptr_t)end / MATCH_PAGE);
+}
+
+// ==========================================
+// SSE2
+// ==========================================
+__attribute__((target("sse2")))
+static inline __m128i match_lower_sse2(__m128i b) {
+    __m128i upper = _mm_cmplt_epi8(_mm_add_epi8(b, _mm_set1_epi8((char)(128 - 'A'))), _mm_set1_epi8(-128 + 26));
+    return _mm_add_epi8(b, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+__attribute__((target("sse2"))) MATCH_NO_ASAN
+static inline unsigned match_block_sse2(const MatchNeedle *n, const char *p, __m128i vf, __m128i vl) {
+    __m128i a = match_lower_sse2(_mm_loadu_si128((const __m128i*)p));
+    __m128i b = match_lower_sse2(_mm_loadu_si128((const __m128i*)(p + n->len - 1)));
+    return (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, vf), _mm_cmpeq_epi8(b, vl)));
+}
+
+__attribute__((target("sse2"))) MATCH_NO_ASAN
+static inline size_t match_sse2(const MatchNeedle *n, const char *s, size_t len) {
+    if (n->len == 0) return 1;
+    if (len < n->len) return 0;
+    size_t starts = len - n->len + 1;
+    __m128i vf = _mm_set1_epi8((char)n->first);
+    __m128i vl = _mm_set1_epi8((char)n->last);
+    size_t i = 0;
+    for (; i + 16 <= starts; i += 16) {
+        unsigned m = match_block_sse2(n, s + i, vf, vl);
+        while (m) {
+            int j = __builtin_ctz(m);
+            if (match_verify(n, s + i + j)) return i + j + 1;
+            m &= m - 1;
+        }
+    }
+    if (i < starts) {
+        // Lanes past the last start are masked off; verify only reads kept lanes,
+        // which lie inside the name. The loads end 15 bytes past the last start.
+        char tmp[16 + MATCH_NEEDLE_MAX + 16];
+        const char *p = s + i;
+        if (!match_same_page(s + len - 1, s + i + n->len - 1 + 15)) {
+            size_t rem = len - i;
+            memcpy(tmp, p, rem);
+            memset(tmp + rem, 0, 16);
+            p = tmp;
+        }
+        unsigned m = match_block_sse2(n, p, vf, vl) & ((1u << (starts - i)) - 1);
+        while (m) {
+            int j = __builtin_ctz(m);
+            if (match_verify(n, p + j)) return i + j + 1;
+            m &= m - 1;
+        }
+    }
+    return 0;
+}
+
+// ==========================================
+// AVX2
+// ==========================================
+__attribute__((target("avx2")))
+static inline __m256i match_lower_avx2(__m256i b) {
+    __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(-128 + 26), _mm256_add_epi8(b, _mm256_set1_epi8((char)(128 - 'A'))));
+    return _mm256_add_epi8(b, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2"))) MATCH_NO_ASAN
+static inline unsigned match_block_avx2(const MatchNeedle *n, const char *p, __m256i vf, __m256i vl) {
+    __m256i a = match_lower_avx2(_mm256_loadu_si256((const __m256i*)p));
+    __m256i b = match_lower_avx2(_mm256_loadu_si256((const __m256i*)(p + n->len - 1)));
+    return (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, vf), _mm256_cmpeq_epi8(b, vl)));
+}
+
+__attribute__((target("avx2"))) MATCH_NO_ASAN
+static inline size_t match_avx2(const MatchNeedle *n, const char *s, size_t len) {
+    if (n->len == 0) return 1;
+    if (len < n->len) return 0;
+    size_t starts = len - n->len + 1;
+    __m256i vf = _mm256_set1_epi8((char)n->first);
+    __m256i vl = _mm256_set1_epi8((char)n->last);
+    size_t i = 0;
+    for (; i + 32 <= starts; i += 32) {
+        unsigned m = match_block_avx2(n, s + i, vf, vl);
+        while (m) {
+            int j = __builtin_ctz(m);
+            if (match_verify(n, s + i + j)) return i + j + 1;
+            m &= m - 1;
+        }
+    }
+    if (i < starts) {
+        // Lanes past the last start are masked off; verify only reads kept lanes,
+        // which lie inside the name. The loads end 31 bytes past the last start.
+        char tmp[32 + MATCH_NEEDLE_MAX + 32];
+        const char *p = s + i;
+        if (!match_same_page(s + len - 1, s + i + n->len - 1 + 31)) {
+            size_t rem = len - i;
+            memcpy(tmp, p, rem);
+            memset(tmp + rem, 0, 32);
+            p = tmp;
+        }
+        unsigned m = match_block_avx2(n, p, vf, vl) & ((1u << (starts - i)) - 1);
+        while (m) {
+            int j = __builtin_ctz(m);
+            if (match_verify(n, p + j)) return i + j + 1;
+            m &= m - 1;
+        }
+    }
+    return 0;
+}
+
+// ==========================================
+// AVX-512BW
+// ==========================================
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i match_lower_avx512(__m512i b) {
+    __mmask64 upper = _mm512_cmplt_epu8_mask(_mm512_sub_epi8(b, _mm512_set1_epi8('A')), _mm512_set1_epi8(26));
+    return _mm512_mask_add_epi8(b, upper, b, _mm512_set1_epi8(0x20));
+}
+
+// Masked-out lanes are never loaded, so the tail needs no copy
+__attribute__((target("avx512f,avx512bw")))
+static inline size_t match_avx512(const MatchNeedle *n, const char *s, size_t len) {
+    if (n->len == 0) return 1;
+    if (len < n->len) return 0;
+    size_t starts = len - n->len + 1;
+    __m512i vf = _mm512_set1_epi8((char)n->first);
+    __m512i vl = _mm512_set1_epi8((char)n->last);
+    for (size_t i = 0; i < starts; i += 64) {
+        __mmask64 k = starts - i >= 64 ? ~(__mmask64)0 : (((__mmask64)1 << (starts - i)) - 1);
+        __m512i a = match_lower_avx512(_mm512_maskz_loadu_epi8(k, s + i));
+        __m512i b = match_lower_avx512(_mm512_maskz_loadu_epi8(k, s + i + n->len - 1));
+        uint64_t m = _mm512_mask_cmpeq_epi8_mask(_mm512_cmpeq_epi8_mask(a, vf), b, vl);
+        while (m) {
+            int j = __builtin_ctzll(m);
+            if (match_verify(n, s + i + j)) return i + j + 1;
+            m &= m - 1;
+        }
+    }
+    return 0;
+}
+
+static inline uint64_t match_xgetbv(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+}
+#endif
+
+// ==========================================
+// DISPATCH
+// ==========================================
+static inline int match_detect(void) {
+    int level = MATCH_SCALAR;
+#ifdef MATCH_X86
+    unsigned a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d)) return level;
+    if (d & bit_SSE2) level = MATCH_SSE2;
+    // AVX state must be enabled by the OS, not just present in the CPU
+    if (!(c & bit_OSXSAVE) || !(c & bit_AVX)) return level;
+    uint64_t xcr0 = match_xgetbv();
+    if ((xcr0 & 0x6) != 0x6 || __get_cpuid_max(0, NULL) < 7) return level;
+    __cpuid_count(7, 0, a, b, c, d);
+    if (b & bit_AVX2) level = MATCH_AVX2;
+    if ((b & bit_AVX512F) && (b & bit_AVX512BW) && (xcr0 & 0xE6) == 0xE6) level = MATCH_AVX512;
+#endif
+    return level;
+}
+
+static inline match_fn match_kernel(int level) {
+#ifdef MATCH_X86
+    switch (level) {
+        case MATCH_AVX512: return match_avx512;
+        case MATCH_AVX2: return match_avx2;
+        case MATCH_SSE2: return match_sse2;
+    }
+#endif
+    return match_scalar;
+}
+
+// Caps the active level; returns the level actually used
+static inline int match_select(int level) {
+    if (level > match_cpu) level = match_cpu;
+    if (level < MATCH_SCALAR) level = MATCH_SCALAR;
+    match_active = level;
+    match_find = match_kernel(level);
+    return level;
+}
+
+// Call once from the main thread before any matching
+static inline void match_init(void) {
+    if (match_cpu >= 0) return;
+    for (int i = 0; i < 256; i++) match_fold[i] = (uint8_t)((i >= 'A' && i <= 'Z') ? i + 32 : i);
+    match_cpu = match_detect();
+    int level = match_cpu;
+    const char *env = getenv("BLADE_SIMD");
+    if (env) {
+        for (int i = MATCH_SCALAR; i <= MATCH_AVX512; i++) {
+            if (strcmp(env, match_level_names[i]) == 0) level = i;
+        }
+    }
+    match_select(level);
+}
+
+// ==========================================
+// SELF CHECK
+// ==========================================
+// Plain double loop, the definition every kernel must agree with
+static inline size_t match_reference(const char *needle, const char *s, size_t len) {
+    size_t nl = strlen(needle);
+    for (size_t i = 0; i + nl <= len; i++) {
+        size_t k = 0;
+        while (k < nl && match_fold[(uint8_t)s[i + k]] == match_fold[(uint8_t)needle[k]]) k++;
+        if (k == nl) return i + 1;
+    }
+    return 0;
+}
+
+// Random haystacks (each in an exactly sized allocation, so bounds checkers see any
+// over-read outside the page-safe tail loads) against random needles, for every
+// kernel this CPU can run.
+// Returns the number of disagreements; prints the first few to out.
+static inline long match_selfcheck(long iterations, FILE *out) {
+    static const char alphabet[] = "abcxyzABCXYZ09._-@[`{ \xC0\xE0";
+    uint32_t rng = 12345;
+    long failures = 0;
+    match_init();
+    for (int level = MATCH_SCALAR; level <= match_cpu; level++) {
+        match_fn fn = match_kernel(level);
+        long bad = 0;
+        for (long it = 0; it < iterations; it++) {
+            char needle[MATCH_NEEDLE_MAX + 1];
+            rng = rng * 1664525u + 1013904223u;
+            size_t nl = 1 + (rng >> 8) % ((rng & 0x100) ? 4 : 40);
+            for (size_t k = 0; k < nl; k++) { rng = rng * 1664525u + 1013904223u; needle[k] = alphabet[(rng >> 8) % (sizeof(alphabet) - 1)]; }
+            needle[nl] = '\0';
+
+            rng = rng * 1664525u + 1013904223u;
+            size_t len = (rng >> 8) % 200;
+            char *s = (char*)malloc(len + 1);
+            if (!s) break;
+            for (size_t k = 0; k < len; k++) { rng = rng * 1664525u + 1013904223u; s[k] = alphabet[(rng >> 8) % (sizeof(alphabet) - 1)]; }
+            // Plant the needle (in random case) half of the time
+            if ((rng & 0x200) && len >= nl) {
+                size_t at = (rng >> 12) % (len - nl + 1);
+                for (size_t k = 0; k < nl; k++) s[at + k] = (k & 1) && needle[k] >= 'a' && needle[k] <= 'z' ? needle[k] - 32 : needle[k];
+            }
+            s[len] = '\0';
+
+            MatchNeedle n;
+            match_needle(&n, needle, nl);
+            size_t want = match_reference(needle, s, len);
+            size_t got = fn(&n, s, len);
+            if (got != want) {
+                if (out && bad < 5) fprintf(out, "%s: needle \"%s\" in \"%s\": got %lu, want %lu\n", match_level_names[level], needle, s, (unsigned long)got, (unsigned long)want);
+                bad++;
+            }
+            free(s);
+        }
+        if (out) fprintf(out, "%-7s %s (%ld cases)\n", match_level_names[level], bad ? "FAILED" : "ok", iterations);
+        failures += bad;
+    }
+    return failures;
+}
+
+#endif // BLADE_MATCH_H
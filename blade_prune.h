@@ -0,0 +1,315 @@
+// blade_prune.h - Subtree pruning rules for the scan engine
+//
+// Rules are checked as a directory is enumerated, before a child is queued,
+// so a pruned subtree is never opened:
+//
+//   exclude globs    "node_modules", ".git", "*.tmp" test the leaf name; globs
+//                    with a separator ("build/out", "**/gen/*") the full path
+//   ignore files     .gitignore / .ignore in a directory are compiled once when
+//                    the directory is opened and apply to everything below it
+//   maxdepth         entries deeper than N levels below the root are not listed
+//   same filesystem  directories on another device than their root are not
+//                    entered (on Windows mounted volumes are reparse points,
+//                    which the engine never descends anyway)
+//
+// Excluded and ignored entries are not handed to on_entry either, so files
+// matching an exclude glob are dropped as well.
+
+#ifndef BLADE_PRUNE_H
+#define BLADE_PRUNE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "blade_glob.h"
+#include "blade_fs.h"
+
+// ==========================================
+// CONFIGURATION
+// ==========================================
+#define PRUNE_MAX_EXCLUDES 16
+#define PRUNE_MAX_RULES 128         // rules kept per ignore file
+#define PRUNE_FILE_MAX (64 * 1024)  // longer ignore files are read up to here
+#define PRUNE_PATH_MAX 4096
+
+// ==========================================
+// DATA STRUCTURES
+// ==========================================
+typedef struct Prune {
+    GlobProgram exclude[PRUNE_MAX_EXCLUDES];
+    uint8_t exclude_path[PRUNE_MAX_EXCLUDES];   // matched against the full path, not the leaf
+    int exclude_count;
+    int any_path;           // some exclude needs the full path
+    uint32_t max_depth;     // 0 for no limit
+    int same_fs;
+    int ignore_files;       // honour .gitignore / .ignore
+} Prune;
+
+typedef struct PruneRule {
+    GlobProgram glob;
+    uint8_t negate;         // "!pattern" re-includes
+    uint8_t dir_only;       // "pattern/" only matches directories
+    uint8_t anchored;       // matched against the path below the ignore file's directory
+} PruneRule;
+
+// One directory's ignore files. Directories below it point here until a deeper
+// ignore file takes over; a rule set is never changed once published.
+typedef struct PruneIgnore {
+    const struct PruneIgnore *parent;   // rules of the enclosing ignore file
+    struct PruneIgnore *next_all;       // every set of a scan, for freeing
+    uint32_t base_len;                  // anchored rules see the path past this many bytes
+    int count;
+    PruneRule rules[];
+} PruneIgnore;
+
+static inline void prune_init(Prune *p) {
+    memset(p, 0, sizeof(*p));
+}
+
+static inline int prune_active(const Prune *p) {
+    return p->exclude_count || p->max_depth || p->same_fs || p->ignore_files;
+}
+
+// ==========================================
+// EXCLUDE GLOBS
+// ==========================================
+// Returns 0 if the table is full or the glob has too many atoms
+static inline int prune_add_exclude(Prune *p, const char *glob, size_t len) {
+    char buf[PRUNE_PATH_MAX];
+    while (len > 0 && glob_is_sep((uint8_t)glob[len - 1])) len--;
+    if (len == 0) return 1;
+    if (p->exclude_count == PRUNE_MAX_EXCLUDES || len + 3 >= sizeof(buf)) return 0;
+
+    int path = 0;
+    for (size_t i = 0; i < len; i++) if (glob_is_sep((uint8_t)glob[i])) path = 1;
+    size_t n = 0;
+    // A relative path glob may match at any depth, so "build/out" acts as "**/build/out"
+    if (path && !glob_is_sep((uint8_t)glob[0]) && !(len > 1 && glob[1] == ':')) { memcpy(buf, "**/", 3); n = 3; }
+    memcpy(buf + n, glob, len);
+    n += len;
+
+    if (!glob_compile(&p->exclude[p->exclude_count], buf, n)) return 0;
+    p->exclude_path[p->exclude_count++] = (uint8_t)path;
+    if (path) p->any_path = 1;
+    return 1;
+}
+
+// "node_modules;.git, build" - ini lists
+static inline int prune_add_exclude_list(Prune *p, const char *list) {
+    int ok = 1;
+    while (*list) {
+        while (*list == ';' || *list == ',' || *list == ' ' || *list == '\t') list++;
+        const char *start = list;
+        while (*list && *list != ';' && *list != ',') list++;
+        const char *end = list;
+        while (end > start && (end[-1] == ' ' || end[-1] == '\t')) end--;
+        if (end > start && !prune_add_exclude(p, start, (size_t)(end - start))) ok = 0;
+    }
+    return ok;
+}
+
+// Takes the pruning tokens (exclude:GLOB, maxdepth:N) out of a query and copies
+// the rest to out. Returns 0 if an exclude did not fit.
+static inline int prune_parse_query(Prune *p, const char *text, char *out, size_t cap) {
+    int ok = 1;
+    size_t used = 0;
+    if (cap == 0) return 0;
+    while (*text) {
+        while (*text == ' ' || *text == '\t') text++;
+        if (!*text) break;
+        const char *start = text;
+        // Quoted phrases are query terms, whatever they contain
+        if (*text == '"' || (*text == '-' && text[1] == '"')) {
+            text = strchr(text + (*text == '-' ? 2 : 1), '"');
+            text = text ? text + 1 : start + strlen(start);
+        }
+        while (*text && *text != ' ' && *text != '\t') text++;
+        size_t len = (size_t)(text - start);
+
+        if (len > 8 && strncmp(start, "exclude:", 8) == 0) {
+            if (!prune_add_exclude(p, start + 8, len - 8)) ok = 0;
+        } else if (len > 9 && strncmp(start, "maxdepth:", 9) == 0) {
+            p->max_depth = (uint32_t)strtoul(start + 9, NULL, 10);
+        } else if (used + len + 2 <= cap) {
+            if (used) out[used++] = ' ';
+            memcpy(out + used, start, len);
+            used += len;
+        }
+    }
+    out[used] = '\0';
+    return ok;
+}
+
+// ==========================================
+// IGNORE FILES
+// ==========================================
+// Appends one line of an ignore file. Blank lines, comments and rules beyond
+// PRUNE_MAX_RULES are skipped.
+static inline void prune_ignore_line(PruneIgnore *ig, const char *line, size_t len) {
+    while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t' || line[len - 1] == '\r')) len--;
+    if (len == 0 || line[0] == '#' || ig->count == PRUNE_MAX_RULES) return;
+
+    PruneRule *r = &ig->rules[ig->count];
+    r->negate = 0;
+    r->dir_only = 0;
+    r->anchored = 0;
+    if (line[0] == '!') { r->negate = 1; line++; len--; }
+    else if (line[0] == '\\' && len > 1 && (line[1] == '#' || line[1] == '!')) { line++; len--; }
+    if (len > 0 && line[len - 1] == '/') { r->dir_only = 1; len--; }
+    // "**/name" is just name at any depth
+    if (len > 3 && memcmp(line, "**/", 3) == 0 && !memchr(line + 3, '/', len - 3)) { line += 3; len -= 3; }
+    if (memchr(line, '/', len)) r->anchored = 1;
+    if (len > 0 && line[0] == '/') { line++; len--; }
+    if (len == 0 || !glob_compile(&r->glob, line, len)) return;
+    ig->count++;
+}
+
+// Reads name inside the open directory d (path[0..len)) into buf; returns bytes read
+static inline size_t prune_read_file(FsDir *d, const char *path, size_t len, const char *name, char *buf, size_t cap) {
+    size_t got = 0;
+#ifdef _WIN32
+    char file[PRUNE_PATH_MAX];
+    int need_sep = len > 0 && path[len - 1] != '\\' && path[len - 1] != '/';
+    if (len + need_sep + strlen(name) + 1 > sizeof(file)) return 0;
+    memcpy(file, path, len);
+    if (need_sep) file[len++] = '\\';
+    strcpy(file + len, name);
+    HANDLE h = CreateFileA(file, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (h == INVALID_HANDLE_VALUE) return 0;
+    DWORD n;
+    while (got < cap && ReadFile(h, buf + got, (DWORD)(cap - got), &n, NULL) && n > 0) got += n;
+    CloseHandle(h);
+#else
+    int fd;
+    if (d->fd != FS_NO_FD) {
+        fd = openat((int)d->fd, name, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    } else {
+        char file[PRUNE_PATH_MAX];
+        if (len + 1 + strlen(name) + 1 > sizeof(file)) return 0;
+        memcpy(file, path, len);
+        file[len] = '/';
+        strcpy(file + len + 1, name);
+        fd = open(file, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    }
+    if (fd < 0) return 0;
+    ssize_t n;
+    while (got < cap && (n = read(fd, buf + got, cap - got)) > 0) got += (size_t)n;
+    close(fd);
+#endif
+    return got;
+}
+
+// Rules from the ignore files of the open directory d, chained to parent, or
+// NULL if it has none (or none with a rule)
+static inline PruneIgnore *prune_load_ignore(FsDir *d, const char *path, size_t len, const PruneIgnore *parent) {
+    static const char *const files[] = { ".gitignore", ".ignore" };
+    PruneIgnore *ig = NULL;
+    char *buf = NULL;
+    for (int f = 0; f < 2; f++) {
+        if (!buf && !(buf = (char*)malloc(PRUNE_FILE_MAX))) break;
+        size_t n = prune_read_file(d, path, len, files[f], buf, PRUNE_FILE_MAX);
+        if (n == 0) continue;
+        if (!ig) {
+            ig = (PruneIgnore*)malloc(sizeof(PruneIgnore) + PRUNE_MAX_RULES * sizeof(PruneRule));
+            if (!ig) break;
+            ig->parent = parent;
+            ig->next_all = NULL;
+            ig->base_len = (uint32_t)len;
+            ig->count = 0;
+        }
+        for (size_t i = 0; i < n;) {
+            const char *line = buf + i;
+            const char *nl = (const char*)memchr(line, '\n', n - i);
+            size_t line_len = nl ? (size_t)(nl - line) : n - i;
+            prune_ignore_line(ig, line, line_len);
+            i += line_len + 1;
+        }
+    }
+    free(buf);
+    if (ig && ig->count == 0) { free(ig); return NULL; }
+    // Only the rules that were kept are needed
+    if (ig) {
+        PruneIgnore *fit = (PruneIgnore*)realloc(ig, sizeof(PruneIgnore) + (size_t)ig->count * sizeof(PruneRule));
+        if (fit) ig = fit;
+    }
+    return ig;
+}
+
+// Deepest ignore file first; within a file the last matching rule wins
+static inline int prune_ignored(const PruneIgnore *ig, const char *full, size_t full_len, size_t name_off, int is_dir) {
+    for (; ig; ig = ig->parent) {
+        const char *rel = full + ig->base_len;
+        size_t rel_len = full_len - ig->base_len;
+        if (ig->base_len > 0 && rel_len > 0 && glob_is_sep((uint8_t)rel[0]) && !glob_is_sep((uint8_t)full[ig->base_len - 1])) { rel++; rel_len--; }
+        for (int i = ig->count - 1; i >= 0; i--) {
+            const PruneRule *r = &ig->rules[i];
+            if (r->dir_only && !is_dir) continue;
+            int hit = r->anchored ? glob_match(&r->glob, rel, rel_len) : glob_match(&r->glob, full + name_off, full_len - name_off);
+            if (hit) return !r->negate;
+        }
+    }
+    return 0;
+}
+
+// ==========================================
+// CHECKS
+// ==========================================
+// Device of the open directory d; 0 where the backend cannot tell
+static inline uint64_t prune_device(FsDir *d) {
+#ifdef _WIN32
+    return 0;
+#else
+    struct stat st;
+    if (d->fd == FS_NO_FD || fstat((int)d->fd, &st) != 0) return 0;
+    return (uint64_t)st.st_dev;
+#endif
+}
+
+// Nonzero if an entry of directory dir_path[0..dir_len) must be skipped: not
+// reported and, for a directory, not queued. ig is the directory's ignore rules.
+static inline int prune_entry(const Prune *p, const PruneIgnore *ig, const char *dir_path, size_t dir_len,
+                       const char *name, size_t name_len, int is_dir) {
+    for (int i = 0; i < p->exclude_count; i++) {
+        if (!p->exclude_path[i] && glob_match(&p->exclude[i], name, name_len)) return 1;
+    }
+    if (!p->any_path && !ig) return 0;
+
+    // The full path is only built when a path glob or an ignore file needs it
+    char full[PRUNE_PATH_MAX];
+    int need_sep = dir_len > 0 && !glob_is_sep((uint8_t)dir_path[dir_len - 1]);
+    size_t len = dir_len + need_sep + name_len;
+    if (len >= sizeof(full)) return 0;
+    memcpy(full, dir_path, dir_len);
+    if (need_sep) full[dir_len] = '/';
+    memcpy(full + dir_len + need_sep, name, name_len);
+    full[len] = '\0';
+
+    if (p->any_path) {
+        for (int i = 0; i < p->exclude_count; i++) {
+            if (p->exclude_path[i] && glob_match(&p->exclude[i], full, len)) return 1;
+        }
+    }
+    return ig && prune_ignored(ig, full, len, dir_len + need_sep, is_dir);
+}
+
+// Whether path, found below a root of root_len bytes without a traversal (a
+// change notification), lies where the traversal would not have gone: every
+// component is checked against maxdepth and the exclude globs. Ignore files
+// and same_fs need the directories themselves and are not applied.
+static inline int prune_path(const Prune *p, size_t root_len, const char *path, size_t len, int is_dir) {
+    uint32_t depth = 0;
+    size_t i = root_len;
+    while (i < len) {
+        while (i < len && glob_is_sep((uint8_t)path[i])) i++;
+        size_t j = i;
+        while (j < len && !glob_is_sep((uint8_t)path[j])) j++;
+        if (j == i) break;
+        if (p->max_depth && ++depth > p->max_depth) return 1;
+        if (prune_entry(p, NULL, path, i, path + i, j - i, j < len || is_dir)) return 1;
+        i = j;
+    }
+    return 0;
+}
+
+#endif // BLADE_PRUNE_H
@@ -0,0 +1,433 @@
+// blade_query.h - Boolean multi-literal query engine
+//
+// A query string compiles into a predicate program in conjunctive form:
+//
+//   driver intel -old     driver AND intel AND NOT old
+//   a|b c                 (a OR b) AND c       ("a | b" and "a OR b" also work)
+//   *.sys -"test data"    glob AND NOT phrase
+//
+// Every distinct literal gets one bit. A single pass over the name finds all
+// literals at once: a Teddy-style prefilter looks up the first two (case
+// folded) bytes of every position in nibble tables, which yields a bucket mask
+// of literals that may start there, and only those are verified. Clauses are
+// then plain mask tests, so adding terms adds verification work only where a
+// fingerprint actually hits, not another pass over the name. A query with a
+// single literal skips the buckets and uses the blade_match.h kernel directly.
+//
+// query_match runs the clauses cheapest first: clauses that only need prefix or
+// suffix globs are decided before the literal scan, and substring / NFA globs
+// run last, so a name rejected by "*.sys" never pays for the scan.
+
+#ifndef BLADE_QUERY_H
+#define BLADE_QUERY_H
+
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include "blade_match.h"
+#include "blade_glob.h"
+
+// ==========================================
+// CONFIGURATION
+// ==========================================
+#define QUERY_MAX_TERMS 64      // distinct literals + globs, one bit each
+#define QUERY_MAX_CLAUSES 32
+#define QUERY_POOL_SIZE 1024
+#define QUERY_BUCKETS 8
+#define QUERY_MAX_GLOBS 8
+
+// Evaluation stages, cheapest first
+#define QUERY_COST_FIXED 0      // prefix / suffix globs: one compare
+#define QUERY_COST_SCAN 1       // literals: one shared pass over the name
+#define QUERY_COST_GLOB 2       // substring and NFA globs: a pass each
+#define QUERY_STAGES 3
+
+// ==========================================
+// DATA STRUCTURES
+// ==========================================
+typedef struct QueryTerm {
+    uint32_t off;       // lowercased, NUL terminated text at pool + off
+    uint32_t len;
+    int glob;           // index into Query.globs, -1 for literals
+} QueryTerm;
+
+typedef struct QueryClause {
+    uint64_t pos;       // satisfied if any of these terms is present
+    uint64_t neg;       // ... or any of these is absent
+} QueryClause;
+
+typedef struct Query {
+    QueryTerm terms[QUERY_MAX_TERMS];
+    QueryClause clauses[QUERY_MAX_CLAUSES];
+    int term_count;
+    int clause_count;
+    uint64_t lit_mask;      // terms found by the literal scan
+    uint64_t glob_mask;     // terms evaluated with glob_match
+    uint64_t sep_mask;      // literals containing a path separator
+
+    // Prefilter: bucket masks for the first and second byte of a literal
+    uint8_t fp0[256];
+    uint8_t fp1[256];
+    uint8_t lo0[16], hi0[16], lo1[16], hi1[16];
+    uint64_t bucket_terms[QUERY_BUCKETS];
+    int single;             // term id when lit_mask has exactly one bit, else -1
+    MatchNeedle needle;
+
+    GlobProgram globs[QUERY_MAX_GLOBS];
+    int glob_count;
+
+    // Plan: terms first computed at each stage and clauses decided after it
+    uint64_t stage_terms[QUERY_STAGES];
+    uint32_t stage_clauses[QUERY_STAGES];
+
+    char pool[QUERY_POOL_SIZE];
+    size_t pool_used;
+} Query;
+
+// ==========================================
+// COMPILER
+// ==========================================
+static inline int query_add_term(Query *q, const char *s, size_t len, int glob) {
+    for (int i = 0; i < q->term_count; i++) {
+        if ((q->terms[i].glob >= 0) == glob && q->terms[i].len == len && memcmp(q->pool + q->terms[i].off, s, len) == 0) return i;
+    }
+    if (q->term_count == QUERY_MAX_TERMS || q->pool_used + len + 1 > QUERY_POOL_SIZE) return -1;
+    if (glob && (q->glob_count == QUERY_MAX_GLOBS || !glob_compile(&q->globs[q->glob_count], s, len))) return -1;
+    char *dst = q->pool + q->pool_used;
+    memcpy(dst, s, len);
+    dst[len] = '\0';
+    q->pool_used += len + 1;
+
+    QueryTerm *t = &q->terms[q->term_count];
+    t->off = (uint32_t)(dst - q->pool);
+    t->len = (uint32_t)len;
+    t->glob = glob ? q->glob_count++ : -1;
+    if (!glob && (memchr(s, '\\', len) || memchr(s, '/', len))) q->sep_mask |= 1ULL << q->term_count;
+    return q->term_count++;
+}
+
+// Literal bytes are folded with |0x20, the same cheap fold the SIMD scan applies to
+// the name. It is exact for letters and consistent for everything else, so it only
+// ever adds candidates; verification decides.
+static inline void query_build_prefilter(Query *q) {
+    memset(q->lo0, 0, 16); memset(q->hi0, 0, 16);
+    memset(q->lo1, 0, 16); memset(q->hi1, 0, 16);
+    memset(q->bucket_terms, 0, sizeof(q->bucket_terms));
+    int n = 0;
+    for (int i = 0; i < q->term_count; i++) {
+        if (!(q->lit_mask & (1ULL << i))) continue;
+        const char *text = q->pool + q->terms[i].off;
+        int b = n++ % QUERY_BUCKETS;
+        uint8_t bit = (uint8_t)(1u << b);
+        q->bucket_terms[b] |= 1ULL << i;
+
+        uint8_t c0 = (uint8_t)text[0] | 0x20;
+        q->lo0[c0 & 15] |= bit;
+        q->hi0[c0 >> 4] |= bit;
+        if (q->terms[i].len > 1) {
+            uint8_t c1 = (uint8_t)text[1] | 0x20;
+            q->lo1[c1 & 15] |= bit;
+            q->hi1[c1 >> 4] |= bit;
+        } else {
+            for (int k = 0; k < 16; k++) { q->lo1[k] |= bit; q->hi1[k] |= bit; }
+        }
+    }
+    for (int c = 0; c < 256; c++) {
+        uint8_t f = (uint8_t)c | 0x20;
+        q->fp0[c] = q->lo0[f & 15] & q->hi0[f >> 4];
+        q->fp1[c] = q->lo1[f & 15] & q->hi1[f >> 4];
+    }
+
+    q->single = -1;
+    if (q->lit_mask && !(q->lit_mask & (q->lit_mask - 1))) {
+        q->single = __builtin_ctzll(q->lit_mask);
+        match_needle(&q->needle, q->pool + q->terms[q->single].off, q->terms[q->single].len);
+    }
+}
+
+static inline int query_term_cost(const Query *q, int id) {
+    const QueryTerm *t = &q->terms[id];
+    if (t->glob < 0) return QUERY_COST_SCAN;
+    int kind = q->globs[t->glob].kind;
+    return (kind == GLOB_ALL || kind == GLOB_PREFIX || kind == GLOB_SUFFIX) ? QUERY_COST_FIXED : QUERY_COST_GLOB;
+}
+
+// A clause is decided at the stage of its most expensive term; a stage computes
+// the terms its clauses need that no earlier stage did
+static inline void query_plan(Query *q) {
+    memset(q->stage_terms, 0, sizeof(q->stage_terms));
+    memset(q->stage_clauses, 0, sizeof(q->stage_clauses));
+    uint64_t known = 0;
+    int stage[QUERY_MAX_CLAUSES];
+    for (int i = 0; i < q->clause_count; i++) {
+        stage[i] = QUERY_COST_FIXED;
+        for (uint64_t m = q->clauses[i].pos | q->clauses[i].neg; m; m &= m - 1) {
+            int cost = query_term_cost(q, __builtin_ctzll(m));
+            if (cost > stage[i]) stage[i] = cost;
+        }
+        q->stage_clauses[stage[i]] |= 1u << i;
+    }
+    for (int st = 0; st < QUERY_STAGES; st++) {
+        for (int i = 0; i < q->clause_count; i++) {
+            if (stage[i] == st) q->stage_terms[st] |= (q->clauses[i].pos | q->clauses[i].neg) & ~known;
+        }
+        known |= q->stage_terms[st];
+    }
+}
+
+// Returns 0 if the query has more terms or clauses than the program can hold; the
+// program then holds the leading part that fit. An empty query matches everything.
+static inline int query_compile(Query *q, const char *text) {
+    match_init();
+    memset(q, 0, sizeof(*q));
+    const uint8_t *fold = match_fold;
+    char term[256];
+    int join_next = 0;
+    int ok = 1;
+    const char *p = text;
+
+    while (*p) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p) break;
+
+        // "|" or a bare "OR" merges the neighbouring terms into one clause
+        if (p[0] == '|' || (p[0] == 'O' && p[1] == 'R' && (p[2] == ' ' || p[2] == '\t' || !p[2]))) {
+            if (q->clause_count > 0) join_next = 1;
+            p += p[0] == '|' ? 1 : 2;
+            continue;
+        }
+
+        int fresh = !join_next;
+        if (fresh) {
+            if (q->clause_count == QUERY_MAX_CLAUSES) { ok = 0; break; }
+            q->clause_count++;
+        }
+        join_next = 0;
+        QueryClause *c = &q->clauses[q->clause_count - 1];
+
+        // One token: alternatives separated by '|', each optionally negated or quoted
+        for (;;) {
+            int negate = 0;
+            if (*p == '-' && p[1] && p[1] != ' ' && p[1] != '|') { negate = 1; p++; }
+            size_t len = 0;
+            if (*p == '"') {
+                p++;
+                while (*p && *p != '"') { if (len < sizeof(term) - 1) term[len++] = (char)fold[(uint8_t)*p]; p++; }
+                if (*p == '"') p++;
+            } else {
+                while (*p && *p != ' ' && *p != '\t' && *p != '|') { if (len < sizeof(term) - 1) term[len++] = (char)fold[(uint8_t)*p]; p++; }
+            }
+            if (len > 0) {
+                term[len] = '\0';
+                int glob = glob_has_meta(term, len);
+                int id = query_add_term(q, term, len, glob);
+                if (id < 0) { ok = 0; break; }
+                if (glob) q->glob_mask |= 1ULL << id;
+                else q->lit_mask |= 1ULL << id;
+                if (negate) c->neg |= 1ULL << id;
+                else c->pos |= 1ULL << id;
+            }
+            if (*p != '|') break;
+            p++;
+            if (!*p || *p == ' ' || *p == '\t') { join_next = 1; break; }
+        }
+        // A token that produced nothing ("" or a lone "|") leaves an empty clause behind
+        if (fresh && !c->pos && !c->neg && !join_next) q->clause_count--;
+        if (!ok) break;
+    }
+    query_build_prefilter(q);
+    query_plan(q);
+    return ok;
+}
+
+// ==========================================
+// NARROWING
+// ==========================================
+// Whether term a of qa being present forces term b of qb to be present:
+// a literal contains every literal it has as a substring; globs only imply themselves
+static inline int query_term_implies(const Query *qa, int a, const Query *qb, int b) {
+    const QueryTerm *ta = &qa->terms[a], *tb = &qb->terms[b];
+    const char *sa = qa->pool + ta->off, *sb = qb->pool + tb->off;
+    if ((ta->glob >= 0) != (tb->glob >= 0)) return 0;
+    if (ta->glob >= 0) return ta->len == tb->len && memcmp(sa, sb, ta->len) == 0;
+    return ta->len >= tb->len && strstr(sa, sb) != NULL;
+}
+
+// Every way of satisfying clause cn (of n) also satisfies clause co (of o)
+static inline int query_clause_implies(const Query *n, const QueryClause *cn, const Query *o, const QueryClause *co) {
+    for (uint64_t m = cn->pos; m; m &= m - 1) {
+        int t = __builtin_ctzll(m), ok = 0;
+        for (uint64_t k = co->pos; k && !ok; k &= k - 1) ok = query_term_implies(n, t, o, __builtin_ctzll(k));
+        if (!ok) return 0;
+    }
+    // "t absent" implies "u absent" when t is contained in u
+    for (uint64_t m = cn->neg; m; m &= m - 1) {
+        int t = __builtin_ctzll(m), ok = 0;
+        for (uint64_t k = co->neg; k && !ok; k &= k - 1) ok = query_term_implies(o, __builtin_ctzll(k), n, t);
+        if (!ok) return 0;
+    }
+    return 1;
+}
+
+// Nonzero if everything n matches is also matched by o, so n can be evaluated on
+// o's results alone (typing more of a filter usually narrows it; "a" -> "a|b" does not)
+static inline int query_narrows(const Query *n, const Query *o) {
+    for (int i = 0; i < o->clause_count; i++) {
+        int implied = 0;
+        for (int j = 0; j < n->clause_count && !implied; j++) implied = query_clause_implies(n, &n->clauses[j], o, &o->clauses[i]);
+        if (!implied) return 0;
+    }
+    return 1;
+}
+
+// ==========================================
+// MATCHER
+// ==========================================
+static inline int query_verify(const char *text, uint32_t len, const char *s) {
+    for (uint32_t k = 0; k < len; k++) {
+        if (match_fold[(uint8_t)s[k]] != (uint8_t)text[k]) return 0;
+    }
+    return 1;
+}
+
+static inline uint64_t query_check(const Query *q, const char *s, size_t len, size_t p, unsigned bits, uint64_t hits) {
+    while (bits) {
+        int b = __builtin_ctz(bits);
+        bits &= bits - 1;
+        uint64_t todo = q->bucket_terms[b] & ~hits;
+        while (todo) {
+            int id = __builtin_ctzll(todo);
+            todo &= todo - 1;
+            const QueryTerm *t = &q->terms[id];
+            if (p + t->len <= len && query_verify(q->pool + t->off, t->len, s + p)) hits |= 1ULL << id;
+        }
+    }
+    return hits;
+}
+
+static inline uint64_t query_scan_tail(const Query *q, const char *s, size_t len, size_t i, uint64_t hits) {
+    for (; i < len; i++) {
+        unsigned bits = q->fp0[(uint8_t)s[i]] & q->fp1[i + 1 < len ? (uint8_t)s[i + 1] : 0];
+        if (bits) hits = query_check(q, s, len, i, bits, hits);
+    }
+    return hits;
+}
+
+#ifdef MATCH_X86
+// Bucket mask per position for p[0..31]; reads p[0..32]
+__attribute__((target("avx2")))
+static inline __m256i query_teddy_avx2(const Query *q, const char *p) {
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    const __m256i nib = _mm256_set1_epi8(0x0F);
+    const __m256i lo0 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)q->lo0));
+    const __m256i hi0 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)q->hi0));
+    const __m256i lo1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)q->lo1));
+    const __m256i hi1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)q->hi1));
+    __m256i b0 = _mm256_or_si256(_mm256_loadu_si256((const __m256i*)p), case_bit);
+    __m256i b1 = _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(p + 1)), case_bit);
+    __m256i m0 = _mm256_and_si256(_mm256_shuffle_epi8(lo0, _mm256_and_si256(b0, nib)),
+                                  _mm256_shuffle_epi8(hi0, _mm256_and_si256(_mm256_srli_epi16(b0, 4), nib)));
+    __m256i m1 = _mm256_and_si256(_mm256_shuffle_epi8(lo1, _mm256_and_si256(b1, nib)),
+                                  _mm256_shuffle_epi8(hi1, _mm256_and_si256(_mm256_srli_epi16(b1, 4), nib)));
+    return _mm256_and_si256(m0, m1);
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t query_scan_avx2(const Query *q, const char *s, size_t len) {
+    uint64_t hits = 0;
+    uint8_t bytes[32];
+    char tmp[64];
+    for (size_t i = 0; i < len; i += 32) {
+        __m256i cand;
+        uint32_t valid = ~0u;
+        if (i + 33 <= len) {
+            cand = query_teddy_avx2(q, s + i);
+        } else {
+            // Tail: zero padded copy, so nothing past the name is read
+            size_t rem = len - i;
+            memcpy(tmp, s + i, rem);
+            memset(tmp + rem, 0, sizeof(tmp) - rem);
+            cand = query_teddy_avx2(q, tmp);
+            if (rem < 32) valid = (1u << rem) - 1;
+        }
+        uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(cand, _mm256_setzero_si256())) & valid;
+        if (!mask) continue;
+        _mm256_storeu_si256((__m256i*)bytes, cand);
+        while (mask) {
+            int j = __builtin_ctz(mask);
+            mask &= mask - 1;
+            hits = query_check(q, s, len, i + j, bytes[j], hits);
+        }
+        if (hits == q->lit_mask) break;
+    }
+    return hits;
+}
+#endif
+
+// Bit per literal found in s[0..len). Bytes past the end may be read within the
+// page of s[len - 1] (the blade_match.h kernels), never into the next page.
+static inline uint64_t query_scan(const Query *q, const char *s, size_t len) {
+    if (q->single >= 0) return match_find(&q->needle, s, len) ? q->lit_mask : 0;
+#ifdef MATCH_X86
+    if (match_active >= MATCH_AVX2) return query_scan_avx2(q, s, len);
+#endif
+    return query_scan_tail(q, s, len, 0, 0);
+}
+
+// Bit per literal that occurs in s
+static inline uint64_t query_literals(const Query *q, const char *s, size_t len) {
+    return q->lit_mask ? query_scan(q, s, len) : 0;
+}
+
+// Bit per glob term in mask that matches s
+static inline uint64_t query_globs(const Query *q, const char *s, size_t len, uint64_t mask) {
+    uint64_t hits = 0;
+    while (mask) {
+        int id = __builtin_ctzll(mask);
+        mask &= mask - 1;
+        if (glob_match(&q->globs[q->terms[id].glob], s, len)) hits |= 1ULL << id;
+    }
+    return hits;
+}
+
+// Bit per term that occurs in (literals) or matches (globs) s
+static inline uint64_t query_hits(const Query *q, const char *s, size_t len) {
+    return query_literals(q, s, len) | query_globs(q, s, len, q->glob_mask);
+}
+
+// The needle when the whole query is one positive literal, else NULL. Such a query
+// matches exactly where the needle occurs, so callers may search many names at once.
+static inline const MatchNeedle *query_plain_literal(const Query *q) {
+    if (q->clause_count != 1 || q->single < 0 || q->glob_mask) return NULL;
+    const QueryClause *c = &q->clauses[0];
+    return (c->neg == 0 && c->pos == q->lit_mask) ? &q->needle : NULL;
+}
+
+// Callers that know hits for parts of a string separately (a directory and the
+// names inside it) can OR them and evaluate once
+static inline int query_eval(const Query *q, uint64_t hits) {
+    for (int i = 0; i < q->clause_count; i++) {
+        const QueryClause *c = &q->clauses[i];
+        if (!((hits & c->pos) | (~hits & c->neg))) return 0;
+    }
+    return 1;
+}
+
+// Stage by stage along the plan, stopping at the first clause that fails
+static inline int query_match(const Query *q, const char *s, size_t len) {
+    uint64_t hits = 0;
+    for (int st = 0; st < QUERY_STAGES; st++) {
+        uint32_t clauses = q->stage_clauses[st];
+        if (!clauses) continue;
+        uint64_t need = q->stage_terms[st];
+        if (need & q->lit_mask) hits |= query_literals(q, s, len);
+        hits |= query_globs(q, s, len, need & q->glob_mask);
+        for (; clauses; clauses &= clauses - 1) {
+            const QueryClause *c = &q->clauses[__builtin_ctz(clauses)];
+            if (!((hits & c->pos) | (~hits & c->neg))) return 0;
+        }
+    }
+    return 1;
+}
+
+#endif // BLADE_QUERY_H
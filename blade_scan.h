@@ -0,0 +1,698 @@
+// blade_scan.h - Parallel directory traversal engine (work-stealing)
+//
+// Each worker owns a Chase-Lev deque of pending directories. The owner pushes
+// and pops at the bottom (depth-first, cache friendly); idle workers steal from
+// the top of a random victim. Directory paths live in pooled 64 KB chunks that
+// are recycled once every job inside them has been processed, so the hot path
+// never calls malloc/free. Termination is a single atomic counter of jobs that
+// have been pushed but not finished: when it hits zero the scan is complete.
+//
+// Enumeration goes through a blade_fs.h backend. When the backend supports
+// fd-relative opens, a directory with subdirectories keeps its fd open until
+// every child has opened itself with openat against it.
+//
+// Pruning rules (blade_prune.h) given with scan_set_prune are applied before
+// on_entry sees an entry and before a child directory is queued.
+
+#ifndef BLADE_SCAN_H
+#define BLADE_SCAN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#endif
+#include "blade_fs.h"
+#include "blade_prune.h"
+
+// ==========================================
+// CONFIGURATION
+// ==========================================
+#define SCAN_MAX_THREADS 64
+#define SCAN_PATH_MAX 4096
+#define SCAN_CHUNK_SIZE (64 * 1024)
+#define SCAN_DEQUE_INITIAL 256
+#define SCAN_MAX_OPEN_DIRS 512  // parent fds kept open for relative opens, across all workers
+
+#ifdef _WIN32
+#define SCAN_SEP '\\'
+#else
+#define SCAN_SEP '/'
+#endif
+
+// Return value of on_entry: SCAN_SKIP keeps the engine from descending into a directory
+#define SCAN_CONTINUE 0
+#define SCAN_SKIP 1
+
+// ==========================================
+// PLATFORM
+// ==========================================
+#ifdef _WIN32
+typedef CRITICAL_SECTION scan_lock_t;
+typedef CONDITION_VARIABLE scan_cond_t;
+#define scan_lock_init(l) InitializeCriticalSection(l)
+#define scan_lock_free(l) DeleteCriticalSection(l)
+#define scan_lock(l) EnterCriticalSection(l)
+#define scan_unlock(l) LeaveCriticalSection(l)
+#define scan_cond_init(c) InitializeConditionVariable(c)
+#define scan_cond_free(c) ((void)0)
+#define scan_cond_wait(c, l) SleepConditionVariableCS(c, l, INFINITE)
+#define scan_cond_signal(c) WakeConditionVariable(c)
+#define scan_cond_broadcast(c) WakeAllConditionVariable(c)
+#else
+typedef pthread_mutex_t scan_lock_t;
+typedef pthread_cond_t scan_cond_t;
+#define scan_lock_init(l) pthread_mutex_init(l, NULL)
+#define scan_lock_free(l) pthread_mutex_destroy(l)
+#define scan_lock(l) pthread_mutex_lock(l)
+#define scan_unlock(l) pthread_mutex_unlock(l)
+#define scan_cond_init(c) pthread_cond_init(c, NULL)
+#define scan_cond_free(c) pthread_cond_destroy(c)
+#define scan_cond_wait(c, l) pthread_cond_wait(c, l)
+#define scan_cond_signal(c) pthread_cond_signal(c)
+#define scan_cond_broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+#define scan_load(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define scan_store(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define scan_inc(p) __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST)
+#define scan_dec(p) __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST)
+
+// ==========================================
+// DATA STRUCTURES
+// ==========================================
+typedef struct PathChunk {
+    struct PathChunk *next_free;
+    struct PathChunk *next_all;
+    long refs;      // 1 for the owning worker + 1 per unfinished job
+    size_t used;
+    char data[SCAN_CHUNK_SIZE];
+} PathChunk;
+
+// A pending directory. Lives inside a PathChunk; never allocated on its own.
+typedef struct ScanJob {
+    PathChunk *chunk;
+    uint32_t id;        // unique per scan, roots included (starts at 1)
+    uint32_t parent_id; // 0 for roots
+    uint32_t depth;
+    uint32_t len;
+    uint32_t name_off;  // leaf name starts at path + name_off
+    uintptr_t tag;      // caller data carried from on_entry / scan_push_child (an id or a pointer)
+    struct ScanJob *parent; // pinned parent to open relative to, NULL if none
+    intptr_t fd;        // kept open while children still need it, FS_NO_FD otherwise
+    long fd_refs;       // 1 while enumerating + 1 per child that has not opened yet
+    const PruneIgnore *ignore;  // ignore rules in force here, NULL if none
+    uint64_t dev;       // device of the root, for same-filesystem pruning
+    char path[];
+} ScanJob;
+
+// size and mtime are only valid once scan_entry_stat has returned 1
+typedef struct ScanEntry {
+    const char *name;
+    size_t name_len;
+    int is_dir;
+    int is_reparse;
+    int descend;    // 1 if the engine will queue this subdirectory unless on_entry skips it
+    uint64_t size;
+    uint64_t mtime; // FILETIME ticks (100ns since 1601) on every platform
+    uintptr_t tag;  // on_entry may set this; it becomes the child job's tag
+    FsDir *dir;
+    FsEntry *fs;
+} ScanEntry;
+
+typedef struct DequeArray {
+    int64_t size;
+    struct DequeArray *retired;
+    ScanJob *slots[];
+} DequeArray;
+
+typedef struct WorkDeque {
+    int64_t top;
+    char pad0[56];
+    int64_t bottom;
+    DequeArray *array;
+    char pad1[48];
+} WorkDeque;
+
+struct ScanCtx;
+
+typedef struct ScanWorker {
+    WorkDeque dq;
+    struct ScanCtx *ctx;
+    PathChunk *chunk;
+    uint32_t rng;
+    int id;
+    void *local;            // per-thread state owned by the callbacks
+    FsDir *dir;
+    uint64_t dirs_scanned;
+    uint64_t entries_seen;
+    uint64_t steals;
+    char pad[64];
+} ScanWorker;
+
+typedef struct ScanCtx {
+    ScanWorker workers[SCAN_MAX_THREADS];
+    int worker_count;
+    int next_root;
+
+    long pending;           // jobs pushed but not yet finished
+    uint32_t next_id;
+    long sleepers;
+    long active;            // worker threads still running
+    long refs;              // owner + one per running thread
+    int done;
+    int cancel;
+    int finished;
+    long open_dirs;         // pinned parent fds
+    const FsBackend *fs;    // enumeration backend; may be replaced before scan_start
+    Prune *prune;           // NULL when nothing is pruned
+    PruneIgnore *ignores;   // every ignore rule set loaded, freed with the scan
+
+    scan_lock_t park_lock;
+    scan_cond_t park_cond;
+    scan_lock_t pool_lock;
+    PathChunk *free_chunks;
+    PathChunk *all_chunks;
+
+    void *user;
+    void (*on_start)(ScanWorker *w);
+    int  (*on_dir)(ScanWorker *w, const ScanJob *dir);      // SCAN_SKIP: callback handled the directory itself
+    int  (*on_entry)(ScanWorker *w, const ScanJob *dir, ScanEntry *e);
+    void (*on_dir_end)(ScanWorker *w, const ScanJob *dir);  // only after a successful enumeration
+    void (*on_dir_done)(ScanWorker *w, const ScanJob *dir); // after every job taken, even if it could not be opened
+    void (*on_idle)(ScanWorker *w);
+    void (*on_stop)(ScanWorker *w);
+    void (*on_finish)(struct ScanCtx *ctx);
+} ScanCtx;
+
+// ==========================================
+// CHASE-LEV DEQUE
+// ==========================================
+static inline void deque_init(WorkDeque *dq) {
+    dq->top = 0;
+    dq->bottom = 0;
+    dq->array = (DequeArray*)malloc(sizeof(DequeArray) + SCAN_DEQUE_INITIAL * sizeof(ScanJob*));
+    dq->array->size = SCAN_DEQUE_INITIAL;
+    dq->array->retired = NULL;
+}
+
+static inline void deque_free(WorkDeque *dq) {
+    DequeArray *a = dq->array;
+    while (a) {
+        DequeArray *prev = a->retired;
+        free(a);
+        a = prev;
+    }
+    dq->array = NULL;
+}
+
+// Owner only. Old arrays stay reachable through 'retired' until the scan is destroyed
+// because a concurrent thief may still be reading from them.
+static inline DequeArray* deque_grow(WorkDeque *dq, DequeArray *a, int64_t t, int64_t b) {
+    DequeArray *n = (DequeArray*)malloc(sizeof(DequeArray) + (size_t)a->size * 2 * sizeof(ScanJob*));
+    if (!n) return NULL;
+    n->size = a->size * 2;
+    n->retired = a;
+    for (int64_t i = t; i < b; i++) n->slots[i & (n->size - 1)] = a->slots[i & (a->size - 1)];
+    __atomic_store_n(&dq->array, n, __ATOMIC_RELEASE);
+    return n;
+}
+
+static inline int deque_push(WorkDeque *dq, ScanJob *job) {
+    int64_t b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED);
+    int64_t t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+    DequeArray *a = __atomic_load_n(&dq->array, __ATOMIC_RELAXED);
+    if (b - t > a->size - 1) {
+        a = deque_grow(dq, a, t, b);
+        if (!a) return 0;
+    }
+    __atomic_store_n(&a->slots[b & (a->size - 1)], job, __ATOMIC_RELEASE);
+    __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static inline ScanJob* deque_take(WorkDeque *dq) {
+    int64_t b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED) - 1;
+    DequeArray *a = __atomic_load_n(&dq->array, __ATOMIC_RELAXED);
+    __atomic_store_n(&dq->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t t = __atomic_load_n(&dq->top, __ATOMIC_RELAXED);
+    ScanJob *job = NULL;
+    if (t <= b) {
+        job = __atomic_load_n(&a->slots[b & (a->size - 1)], __ATOMIC_RELAXED);
+        if (t == b) {
+            // Last element: race against thieves for it
+            if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) job = NULL;
+            __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return job;
+}
+
+static inline ScanJob* deque_steal(WorkDeque *dq) {
+    int64_t t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&dq->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) return NULL;
+    DequeArray *a = __atomic_load_n(&dq->array, __ATOMIC_ACQUIRE);
+    ScanJob *job = __atomic_load_n(&a->slots[t & (a->size - 1)], __ATOMIC_ACQUIRE);
+    if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) return NULL;
+    return job;
+}
+
+static inline int deque_nonempty(WorkDeque *dq) {
+    return __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE) < __atomic_load_n(&dq->bottom, __ATOMIC_ACQUIRE);
+}
+
+// ==========================================
+// PATH CHUNK POOL
+// ==========================================
+static inline PathChunk* chunk_acquire(ScanCtx *ctx) {
+    scan_lock(&ctx->pool_lock);
+    PathChunk *c = ctx->free_chunks;
+    if (c) ctx->free_chunks = c->next_free;
+    scan_unlock(&ctx->pool_lock);
+
+    if (!c) {
+        c = (PathChunk*)malloc(sizeof(PathChunk));
+        if (!c) return NULL;
+        scan_lock(&ctx->pool_lock);
+        c->next_all = ctx->all_chunks;
+        ctx->all_chunks = c;
+        scan_unlock(&ctx->pool_lock);
+    }
+    c->next_free = NULL;
+    c->refs = 1;
+    c->used = 0;
+    return c;
+}
+
+static inline void chunk_release(ScanCtx *ctx, PathChunk *c) {
+    if (scan_dec(&c->refs) != 0) return;
+    scan_lock(&ctx->pool_lock);
+    c->next_free = ctx->free_chunks;
+    ctx->free_chunks = c;
+    scan_unlock(&ctx->pool_lock);
+}
+
+// Carve a job out of the worker's current chunk: "<dir><SEP><name>" or just <name> for roots
+static inline ScanJob* job_alloc(ScanWorker *w, const char *dir, size_t dir_len, const char *name, size_t name_len, uint32_t depth) {
+    int need_sep = (dir_len > 0 && dir[dir_len - 1] != '\\' && dir[dir_len - 1] != '/');
+    size_t len = dir_len + need_sep + name_len;
+    if (len >= SCAN_PATH_MAX) return NULL;
+    size_t need = (sizeof(ScanJob) + len + 1 + 7) & ~(size_t)7;
+
+    if (!w->chunk || w->chunk->used + need > SCAN_CHUNK_SIZE) {
+        if (w->chunk) chunk_release(w->ctx, w->chunk);
+        w->chunk = chunk_acquire(w->ctx);
+        if (!w->chunk) return NULL;
+    }
+
+    ScanJob *job = (ScanJob*)(w->chunk->data + w->chunk->used);
+    w->chunk->used += need;
+    scan_inc(&w->chunk->refs);
+
+    job->chunk = w->chunk;
+    job->id = __atomic_add_fetch(&w->ctx->next_id, 1, __ATOMIC_RELAXED);
+    job->parent_id = 0;
+    job->tag = 0;
+    job->parent = NULL;
+    job->fd = FS_NO_FD;
+    job->fd_refs = 0;
+    job->ignore = NULL;
+    job->dev = 0;
+    job->len = (uint32_t)len;
+    job->depth = depth;
+    job->name_off = (uint32_t)(dir_len + need_sep);
+    memcpy(job->path, dir, dir_len);
+    if (need_sep) job->path[dir_len] = SCAN_SEP;
+    memcpy(job->path + dir_len + need_sep, name, name_len);
+    job->path[len] = '\0';
+    return job;
+}
+
+// ==========================================
+// SCHEDULING
+// ==========================================
+static inline void scan_wake(ScanCtx *ctx) {
+    // Pairs with the sleepers increment in scan_park: either the sleeper sees our
+    // job in its recheck or we see the sleeper here.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ctx->sleepers, __ATOMIC_RELAXED) > 0) {
+        scan_lock(&ctx->park_lock);
+        scan_cond_signal(&ctx->park_cond);
+        scan_unlock(&ctx->park_lock);
+    }
+}
+
+static inline void scan_push(ScanWorker *w, ScanJob *job) {
+    scan_inc(&w->ctx->pending);
+    if (!deque_push(&w->dq, job)) {
+        chunk_release(w->ctx, job->chunk);
+        scan_dec(&w->ctx->pending);
+        return;
+    }
+    scan_wake(w->ctx);
+}
+
+// Also used by on_dir callbacks that produce the children of a directory themselves
+static inline void scan_push_child(ScanWorker *w, const ScanJob *dir, const char *name, size_t name_len, uintptr_t tag) {
+    ScanJob *child = job_alloc(w, dir->path, dir->len, name, name_len, dir->depth + 1);
+    if (!child) return;
+    child->parent_id = dir->id;
+    child->tag = tag;
+    child->ignore = dir->ignore;
+    child->dev = dir->dev;
+    if (dir->fd != FS_NO_FD) {
+        // The child keeps both the fd and the memory of its parent job alive until it has opened
+        ScanJob *parent = (ScanJob*)dir;
+        scan_inc(&parent->fd_refs);
+        scan_inc(&parent->chunk->refs);
+        child->parent = parent;
+    }
+    scan_push(w, child);
+}
+
+static inline void scan_fd_unref(ScanCtx *ctx, ScanJob *job) {
+    if (scan_dec(&job->fd_refs) != 0) return;
+    fs_close_fd(job->fd);
+    scan_dec(&ctx->open_dirs);
+}
+
+static inline void scan_unpin_parent(ScanCtx *ctx, ScanJob *job) {
+    ScanJob *parent = job->parent;
+    if (!parent) return;
+    job->parent = NULL;
+    scan_fd_unref(ctx, parent);
+    chunk_release(ctx, parent->chunk);
+}
+
+static inline void scan_job_done(ScanWorker *w, ScanJob *job) {
+    ScanCtx *ctx = w->ctx;
+    chunk_release(ctx, job->chunk);
+    if (scan_dec(&ctx->pending) == 0) {
+        scan_lock(&ctx->park_lock);
+        scan_store(&ctx->done, 1);
+        scan_cond_broadcast(&ctx->park_cond);
+        scan_unlock(&ctx->park_lock);
+    }
+}
+
+static inline int scan_work_visible(ScanCtx *ctx) {
+    for (int i = 0; i < ctx->worker_count; i++) {
+        if (deque_nonempty(&ctx->workers[i].dq)) return 1;
+    }
+    return 0;
+}
+
+static inline ScanJob* scan_steal(ScanWorker *w) {
+    ScanCtx *ctx = w->ctx;
+    int n = ctx->worker_count;
+    if (n < 2) return NULL;
+    w->rng = w->rng * 1664525u + 1013904223u;
+    int start = (int)((w->rng >> 8) % (uint32_t)n);
+    for (int round = 0; round < 2; round++) {
+        for (int k = 0; k < n; k++) {
+            int v = (start + k) % n;
+            if (v == w->id) continue;
+            ScanJob *job = deque_steal(&ctx->workers[v].dq);
+            if (job) { w->steals++; return job; }
+        }
+    }
+    return NULL;
+}
+
+static inline void scan_park(ScanWorker *w) {
+    ScanCtx *ctx = w->ctx;
+    scan_lock(&ctx->park_lock);
+    scan_inc(&ctx->sleepers);
+    while (!scan_load(&ctx->done) && !scan_load(&ctx->cancel) && !scan_work_visible(ctx)) {
+        scan_cond_wait(&ctx->park_cond, &ctx->park_lock);
+    }
+    scan_dec(&ctx->sleepers);
+    scan_unlock(&ctx->park_lock);
+}
+
+// ==========================================
+// ENUMERATION
+// ==========================================
+// Fills size/mtime on demand. Backends that report them with the name make this free.
+static inline int scan_entry_stat(ScanEntry *e) {
+    if (!(e->fs->flags & FS_HAVE_STAT) && !fs_stat(e->dir, e->fs)) return 0;
+    e->size = e->fs->size;
+    e->mtime = e->fs->mtime;
+    return 1;
+}
+
+static inline void scan_directory(ScanWorker *w, ScanJob *job) {
+    ScanCtx *ctx = w->ctx;
+    FsDir *d = w->dir;
+    ScanEntry e;
+    w->dirs_scanned++;
+    if (ctx->on_dir && ctx->on_dir(w, job) == SCAN_SKIP) { scan_unpin_parent(ctx, job); return; }
+
+    int opened = d && fs_open(d, job->parent ? job->parent->fd : FS_NO_FD, job->path, job->path + job->name_off);
+    scan_unpin_parent(ctx, job);
+    if (!opened) return;
+
+    const Prune *pr = ctx->prune;
+    int descend = 1;
+    if (pr) {
+        if (pr->same_fs) {
+            uint64_t dev = prune_device(d);
+            if (job->depth == 0) job->dev = dev;
+            else if (dev != job->dev) { fs_close(d, 0); return; }
+        }
+        if (pr->ignore_files) {
+            PruneIgnore *ig = prune_load_ignore(d, job->path, job->len, job->ignore);
+            if (ig) {
+                job->ignore = ig;
+                ig->next_all = __atomic_load_n(&ctx->ignores, __ATOMIC_RELAXED);
+                while (!__atomic_compare_exchange_n(&ctx->ignores, &ig->next_all, ig, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {}
+            }
+        }
+        descend = !pr->max_depth || job->depth + 1 < pr->max_depth;
+    }
+
+    // Pin our fd for the children unless too many are open already
+    int pin = d->be->relative && d->fd != FS_NO_FD;
+    if (pin && scan_inc(&ctx->open_dirs) > SCAN_MAX_OPEN_DIRS) { scan_dec(&ctx->open_dirs); pin = 0; }
+    if (pin) { job->fd_refs = 1; job->fd = d->fd; }
+
+    int n;
+    while (!scan_load(&ctx->cancel) && (n = fs_read(d)) > 0) {
+        for (int i = 0; i < n; i++) {
+            FsEntry *fe = &d->batch[i];
+            w->entries_seen++;
+            e.name = fe->name;
+            e.name_len = fe->name_len;
+            e.is_dir = fe->type == FS_TYPE_DIR;
+            e.is_reparse = fe->type == FS_TYPE_LINK || (fe->flags & FS_REPARSE);
+            e.descend = e.is_dir && !e.is_reparse && descend;
+            e.size = fe->size;
+            e.mtime = fe->mtime;
+            e.tag = 0;
+            e.dir = d;
+            e.fs = fe;
+            if (pr && prune_entry(pr, job->ignore, job->path, job->len, e.name, e.name_len, e.is_dir)) continue;
+
+            int r = ctx->on_entry ? ctx->on_entry(w, job, &e) : SCAN_CONTINUE;
+            if (e.descend && r != SCAN_SKIP) scan_push_child(w, job, e.name, e.name_len, e.tag);
+        }
+    }
+    fs_close(d, pin);
+    if (pin) scan_fd_unref(ctx, job);
+    if (ctx->on_dir_end && !scan_load(&ctx->cancel)) ctx->on_dir_end(w, job);
+}
+
+// ==========================================
+// WORKER THREAD
+// ==========================================
+static inline void scan_ctx_free(ScanCtx *ctx);
+
+static inline void scan_ctx_unref(ScanCtx *ctx) {
+    if (scan_dec(&ctx->refs) == 0) scan_ctx_free(ctx);
+}
+
+static inline void scan_worker_loop(ScanWorker *w) {
+    ScanCtx *ctx = w->ctx;
+    w->dir = fs_dir_alloc(ctx->fs);
+    if (ctx->on_start) ctx->on_start(w);
+
+    while (!scan_load(&ctx->cancel)) {
+        ScanJob *job = deque_take(&w->dq);
+        if (!job) job = scan_steal(w);
+        if (!job) {
+            if (scan_load(&ctx->done)) break;
+            if (ctx->on_idle) ctx->on_idle(w);
+            scan_park(w);
+            continue;
+        }
+        scan_directory(w, job);
+        if (ctx->on_dir_done) ctx->on_dir_done(w, job);
+        scan_job_done(w, job);
+    }
+
+    if (ctx->on_stop) ctx->on_stop(w);
+    fs_dir_free(w->dir);
+    w->dir = NULL;
+
+    scan_lock(&ctx->park_lock);
+    if (--ctx->active == 0) {
+        scan_store(&ctx->finished, 1);
+        if (ctx->on_finish) ctx->on_finish(ctx);
+        scan_cond_broadcast(&ctx->park_cond);
+    }
+    scan_unlock(&ctx->park_lock);
+    scan_ctx_unref(ctx);
+}
+
+#ifdef _WIN32
+static inline unsigned __stdcall scan_thread_main(void *arg) { scan_worker_loop((ScanWorker*)arg); return 0; }
+#else
+static inline void* scan_thread_main(void *arg) { scan_worker_loop((ScanWorker*)arg); return NULL; }
+#endif
+
+// ==========================================
+// PUBLIC API
+// ==========================================
+static inline ScanCtx* scan_create(int threads, void *user) {
+    if (threads < 1) threads = 1;
+    if (threads > SCAN_MAX_THREADS) threads = SCAN_MAX_THREADS;
+    ScanCtx *ctx = (ScanCtx*)calloc(1, sizeof(ScanCtx));
+    if (!ctx) return NULL;
+    ctx->worker_count = threads;
+    ctx->user = user;
+    ctx->refs = 1;
+    ctx->fs = fs_default_backend();
+    scan_lock_init(&ctx->park_lock);
+    scan_cond_init(&ctx->park_cond);
+    scan_lock_init(&ctx->pool_lock);
+    for (int i = 0; i < threads; i++) {
+        ScanWorker *w = &ctx->workers[i];
+        deque_init(&w->dq);
+        w->ctx = ctx;
+        w->id = i;
+        w->rng = 0x9E3779B9u * (uint32_t)(i + 1);
+    }
+    return ctx;
+}
+
+// Must be called before scan_start. Roots are spread round-robin over the workers.
+static inline void scan_add_root_tagged(ScanCtx *ctx, const char *path, uintptr_t tag) {
+    ScanWorker *w = &ctx->workers[ctx->next_root++ % ctx->worker_count];
+    ScanJob *job = job_alloc(w, "", 0, path, strlen(path), 0);
+    if (!job) return;
+    job->tag = tag;
+    ctx->pending++;
+    deque_push(&w->dq, job);
+}
+
+static inline void scan_add_root(ScanCtx *ctx, const char *path) {
+    scan_add_root_tagged(ctx, path, 0);
+}
+
+// Must be called before scan_start; the rules are copied. Returns 0 if out of memory.
+static inline int scan_set_prune(ScanCtx *ctx, const Prune *p) {
+    free(ctx->prune);
+    ctx->prune = NULL;
+    if (!p || !prune_active(p)) return 1;
+    ctx->prune = (Prune*)malloc(sizeof(Prune));
+    if (!ctx->prune) return 0;
+    *ctx->prune = *p;
+    return 1;
+}
+
+// Returns the number of workers that run the scan, at least 1
+static inline int scan_start(ScanCtx *ctx) {
+    if (ctx->pending == 0) ctx->done = 1;
+    ctx->active = ctx->worker_count;
+    ctx->refs += ctx->worker_count;
+    for (int i = 0; i < ctx->worker_count; i++) {
+#ifdef _WIN32
+        HANDLE h = (HANDLE)_beginthreadex(NULL, 0, scan_thread_main, &ctx->workers[i], 0, NULL);
+        if (h) { CloseHandle(h); continue; }
+#else
+        pthread_t t;
+        if (pthread_create(&t, NULL, scan_thread_main, &ctx->workers[i]) == 0) { pthread_detach(t); continue; }
+#endif
+        // Could not spawn: run with what we have. The deques of the missing workers
+        // stay visible to thieves, so any roots queued on them still get scanned.
+        // With no thread at all the caller becomes worker 0, and scan_start only
+        // returns once the scan is over.
+        int kept = i ? i : 1;
+        scan_lock(&ctx->park_lock);
+        ctx->active -= ctx->worker_count - kept;
+        __atomic_sub_fetch(&ctx->refs, ctx->worker_count - kept, __ATOMIC_SEQ_CST);
+        if (ctx->active == 0) {     // the spawned workers are already done
+            scan_store(&ctx->finished, 1);
+            if (ctx->on_finish) ctx->on_finish(ctx);
+            scan_cond_broadcast(&ctx->park_cond);
+        }
+        scan_unlock(&ctx->park_lock);
+        if (i == 0) scan_worker_loop(&ctx->workers[0]);
+        return kept;
+    }
+    return ctx->worker_count;
+}
+
+static inline void scan_cancel(ScanCtx *ctx) {
+    scan_lock(&ctx->park_lock);
+    scan_store(&ctx->cancel, 1);
+    scan_cond_broadcast(&ctx->park_cond);
+    scan_unlock(&ctx->park_lock);
+}
+
+static inline int scan_finished(ScanCtx *ctx) {
+    return scan_load(&ctx->finished);
+}
+
+static inline void scan_wait(ScanCtx *ctx) {
+    scan_lock(&ctx->park_lock);
+    while (ctx->active > 0) scan_cond_wait(&ctx->park_cond, &ctx->park_lock);
+    scan_unlock(&ctx->park_lock);
+}
+
+// Drop the owner's reference. Memory goes away once the last worker has exited.
+static inline void scan_release(ScanCtx *ctx) {
+    if (ctx) scan_ctx_unref(ctx);
+}
+
+static inline void scan_ctx_free(ScanCtx *ctx) {
+    // Jobs left behind by a cancel may still pin their parents' fds
+    for (int i = 0; i < SCAN_MAX_THREADS; i++) {
+        WorkDeque *dq = &ctx->workers[i].dq;
+        if (!dq->array) continue;
+        for (int64_t k = dq->top; k < dq->bottom; k++) scan_unpin_parent(ctx, dq->array->slots[k & (dq->array->size - 1)]);
+    }
+    PathChunk *c = ctx->all_chunks;
+    while (c) {
+        PathChunk *next = c->next_all;
+        free(c);
+        c = next;
+    }
+    for (int i = 0; i < SCAN_MAX_THREADS; i++) {
+        if (ctx->workers[i].dq.array) deque_free(&ctx->workers[i].dq);
+    }
+    PruneIgnore *ig = ctx->ignores;
+    while (ig) {
+        PruneIgnore *next = ig->next_all;
+        free(ig);
+        ig = next;
+    }
+    free(ctx->prune);
+    scan_lock_free(&ctx->park_lock);
+    scan_cond_free(&ctx->park_cond);
+    scan_lock_free(&ctx->pool_lock);
+    free(ctx);
+}
+
+#endif // BLADE_SCAN_H
@@ -0,0 +1,170 @@
+// blade_tree.h - Directory node table for scan results
+//
+// Results keep a directory id and their own leaf name instead of a full path.
+// Each directory is one node (parent id + leaf name; roots hold their whole
+// path), so a deep prefix is stored once instead of once per file. Full paths
+// are rebuilt by walking the parents, which only the renderer, open/copy and
+// path-mode filtering need.
+//
+// Node ids are the scan engine's job ids (blade_scan.h), so a worker can
+// register the directory it is enumerating without any lock: ids are unique,
+// node chunks are installed with a CAS and every worker copies names into its
+// own text blocks. A node is written in on_dir before the directory's children
+// are pushed, so it is visible to anyone who sees a result below it.
+
+#ifndef BLADE_TREE_H
+#define BLADE_TREE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "blade_scan.h"
+
+// ==========================================
+// CONFIGURATION
+// ==========================================
+#define TREE_CHUNK_BITS 16
+#define TREE_CHUNK_NODES (1u << TREE_CHUNK_BITS)
+#define TREE_MAX_CHUNKS 4096                // 268M directories
+#define TREE_TEXT_BLOCK (256 * 1024)
+#define TREE_MAX_DEPTH (SCAN_PATH_MAX / 2)
+#define TREE_NONE 0                         // id 0 is never a job, so it means "no directory"
+
+// ==========================================
+// DATA STRUCTURES
+// ==========================================
+typedef struct DirNode {
+    const char *name;   // NULL until registered
+    uint32_t name_len;
+    uint32_t parent;    // TREE_NONE for roots
+} DirNode;
+
+typedef struct TreeText {
+    struct TreeText *next;
+    size_t used;
+    char data[TREE_TEXT_BLOCK];
+} TreeText;
+
+typedef struct DirTree {
+    DirNode *chunks[TREE_MAX_CHUNKS];
+    TreeText *text[SCAN_MAX_THREADS];   // one writer per slot (the worker id)
+    uint32_t max_id;
+} DirTree;
+
+static inline DirTree *tree_create(void) {
+    return (DirTree*)calloc(1, sizeof(DirTree));
+}
+
+static inline void tree_free(DirTree *t) {
+    if (!t) return;
+    for (int i = 0; i < TREE_MAX_CHUNKS; i++) free(t->chunks[i]);
+    for (int i = 0; i < SCAN_MAX_THREADS; i++) {
+        TreeText *b = t->text[i];
+        while (b) { TreeText *next = b->next; free(b); b = next; }
+    }
+    free(t);
+}
+
+// ==========================================
+// WRITERS
+// ==========================================
+static inline const char *tree_copy_name(DirTree *t, int slot, const char *name, size_t len) {
+    TreeText *b = t->text[slot];
+    if (!b || b->used + len + 1 > TREE_TEXT_BLOCK) {
+        if (len + 1 > TREE_TEXT_BLOCK) return NULL;
+        TreeText *n = (TreeText*)malloc(sizeof(TreeText));
+        if (!n) return NULL;
+        n->next = b;
+        n->used = 0;
+        t->text[slot] = b = n;
+    }
+    char *dst = b->data + b->used;
+    memcpy(dst, name, len);
+    dst[len] = '\0';
+    b->used += len + 1;
+    return dst;
+}
+
+// slot picks the text blocks to copy into: each concurrent writer needs its own
+static inline int tree_add(DirTree *t, int slot, uint32_t id, uint32_t parent, const char *name, size_t len) {
+    uint32_t c = id >> TREE_CHUNK_BITS;
+    if (id == TREE_NONE || c >= TREE_MAX_CHUNKS) return 0;
+    DirNode *chunk = __atomic_load_n(&t->chunks[c], __ATOMIC_ACQUIRE);
+    if (!chunk) {
+        DirNode *fresh = (DirNode*)calloc(TREE_CHUNK_NODES, sizeof(DirNode));
+        if (!fresh) return 0;
+        DirNode *expected = NULL;
+        if (__atomic_compare_exchange_n(&t->chunks[c], &expected, fresh, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) chunk = fresh;
+        else { free(fresh); chunk = expected; }
+    }
+    const char *copy = tree_copy_name(t, slot, name, len);
+    if (!copy) return 0;
+    DirNode *n = &chunk[id & (TREE_CHUNK_NODES - 1)];
+    n->name_len = (uint32_t)len;
+    n->parent = parent;
+    __atomic_store_n(&n->name, copy, __ATOMIC_RELEASE);
+
+    uint32_t max = __atomic_load_n(&t->max_id, __ATOMIC_RELAXED);
+    while (id > max && !__atomic_compare_exchange_n(&t->max_id, &max, id, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+    return 1;
+}
+
+// Registers the directory a worker is about to enumerate (call from on_dir)
+static inline int tree_add_job(DirTree *t, const ScanWorker *w, const ScanJob *job) {
+    return tree_add(t, w->id, job->id, job->parent_id, job->path + job->name_off, job->len - job->name_off);
+}
+
+// ==========================================
+// READERS
+// ==========================================
+static inline const DirNode *tree_node(const DirTree *t, uint32_t id) {
+    uint32_t c = id >> TREE_CHUNK_BITS;
+    if (id == TREE_NONE || c >= TREE_MAX_CHUNKS) return NULL;
+    const DirNode *chunk = __atomic_load_n(&t->chunks[c], __ATOMIC_ACQUIRE);
+    if (!chunk) return NULL;
+    const DirNode *n = &chunk[id & (TREE_CHUNK_NODES - 1)];
+    return __atomic_load_n(&n->name, __ATOMIC_ACQUIRE) ? n : NULL;
+}
+
+// Full path of directory id. Returns its length, or 0 if unknown or longer than cap - 1.
+static inline size_t tree_path(const DirTree *t, uint32_t id, char *out, size_t cap) {
+    const DirNode *chain[TREE_MAX_DEPTH];
+    int depth = 0;
+    while (id != TREE_NONE) {
+        const DirNode *n = tree_node(t, id);
+        if (!n || depth == TREE_MAX_DEPTH) return 0;
+        chain[depth++] = n;
+        id = n->parent;
+    }
+    size_t len = 0;
+    while (depth-- > 0) {
+        const DirNode *n = chain[depth];
+        int need_sep = (len > 0 && out[len - 1] != '\\' && out[len - 1] != '/');
+        if (len + need_sep + n->name_len + 1 > cap) return 0;
+        if (need_sep) out[len++] = SCAN_SEP;
+        memcpy(out + len, n->name, n->name_len);
+        len += n->name_len;
+    }
+    if (cap == 0) return 0;
+    out[len] = '\0';
+    return len;
+}
+
+// Path of a leaf under directory id; dir == TREE_NONE means name already is the full path
+static inline size_t tree_join(const DirTree *t, uint32_t dir, const char *name, size_t name_len, char *out, size_t cap) {
+    size_t len = 0;
+    if (dir != TREE_NONE) {
+        len = tree_path(t, dir, out, cap);
+        if (len == 0) return 0;
+        if (out[len - 1] != '\\' && out[len - 1] != '/') {
+            if (len + 1 >= cap) return 0;
+            out[len++] = SCAN_SEP;
+        }
+    }
+    if (len + name_len + 1 > cap) return 0;
+    memcpy(out + len, name, name_len);
+    out[len + name_len] = '\0';
+    return len + name_len;
+}
+
+#endif // BLADE_TREE_H
@@ -11,8 +11,16 @@
 #include <ctype.h>
 #include <stdint.h>
 #include <malloc.h>
-#include <immintrin.h> // AVX2
+#include <immintrin.h>
 #include "version.h"
+#include "blade_scan.h"
+#include "blade_prune.h"
+#include "blade_index.h"
+#include "blade_query.h"
+#include "blade_match.h"
+#include "blade_tree.h"
+#include "blade_du.h"
+#include "blade_watch.h"
 
 // ==========================================
 // CONFIGURATION
@@ -21,6 +29,12 @@
 #define THREAD_COUNT 16
 #define INITIAL_RESULT_CAPACITY 4096
 #define WORKER_BATCH_SIZE 64 
+#define RESULT_SEG_BITS 16
+#define RESULT_SEG_SIZE (1L << RESULT_SEG_BITS)
+#define RESULT_MAX_SEGS 16384   // 1G results
+#define FILTER_CACHE_DEPTH 64
+#define FILTER_PARALLEL_MIN 65536 // smaller passes are faster on one thread
+#define FILTER_MAX_THREADS 64
 
 // Color Macros
 #define FOREGROUND_WHITE (FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE)
@@ -30,22 +44,31 @@
 // GLOBAL STATE
 // ==========================================
 typedef struct {
-    char path[MAX_PATH_LEN];
+    uint64_t name;  // string pool offset of the NUL-terminated file name
+    uint32_t dir;   // dir_tree node of the containing directory
+    uint32_t name_len;
 } Result;
 
-Result *results = NULL;
-uint64_t *file_sizes = NULL; // SoA: 32-byte aligned
-volatile long result_count = 0;
-long result_capacity = 0;
-CRITICAL_SECTION result_lock;
+// Results live in fixed segments that never move (see RESULT STORE)
+typedef struct {
+    Result results[RESULT_SEG_SIZE];
+    uint64_t sizes[RESULT_SEG_SIZE];    // SoA: 32-byte aligned for the AVX2 sum
+    uint8_t dead[RESULT_SEG_SIZE];      // removed by a live update (size zeroed too)
+} ResultSeg;
+
+ResultSeg *result_segs[RESULT_MAX_SEGS];
+volatile long result_count = 0;     // published: results [0, result_count) are complete
+long result_reserved = 0;           // slots handed out to writers
+long result_sealed = 0;             // set when a segment could not be allocated
+long result_dead_count = 0;         // results a live update removed (see LIVE UPDATES)
+DirTree *dir_tree = NULL; // directories of all results (blade_tree.h)
 
 // Filter State
 int is_filtering = 0;
 char filter_text[256] = {0};
 int filter_mode = 0; // 0 = Name, 1 = Path
-long *filtered_indices = NULL;
+long *filtered_indices = NULL; // the top filter level's indices
 long filtered_count = 0;
-long filtered_capacity = 0;
 
 // UI State
 int selected_index = 0;
@@ -57,190 +80,437 @@ HANDLE hConsoleIn;
 volatile int running = 1;
 
 // Search State
-volatile long active_workers = 0;
+ScanCtx *scan_ctx = NULL;
 volatile long finished_scanning = 0;
-char TARGET_RAW[256];
-char TARGET_LOWER[256];
-size_t TARGET_LEN;
-int IS_WILDCARD = 0;
+Query target_query;  // search term, compiled once in main
+Prune scan_prune;    // --exclude etc. and the exclude:/maxdepth: terms of the search
+Query filter_query;  // recompiled by update_filter
 
 // Forward Declarations
 void open_selection();
 void update_filter(int reset_selection);
 
 // ==========================================
-// SEARCH ENGINES
+// STRING POOL
 // ==========================================
-int fast_glob_match(const char *text, const char *pattern) {
-    while (*pattern) {
-        if (*pattern == '*') {
-            while (*pattern == '*') pattern++;
-            if (!*pattern) return 1;
-            while (*text) {
-                if (fast_glob_match(text, pattern)) return 1;
-                text++;
-            }
-            return 0;
-        }
-        char t = tolower((unsigned char)*text);
-        char p = tolower((unsigned char)*pattern);
-        if (t != p && *pattern != '?') return 0;
-        if (!*text) return 0;
-        text++; pattern++;
-    }
-    return !*text;
-}
-
-const char* stristr(const char* haystack, const char* needle) {
-    if (!*needle) return haystack;
-    for (; *haystack; ++haystack) {
-        if (tolower(*haystack) == tolower(*needle)) {
-            const char *h, *n;
-            for (h = haystack, n = needle; *h && *n; ++h, ++n) {
-                if (tolower(*h) != tolower(*n)) break;
-            }
-            if (!*n) return haystack;
-        }
+// Result file names live back to back in fixed-size chunks that never move, so
+// growing the pool copies nothing and a Result only holds an offset. Every
+// writer fills a chunk of its own; only taking a fresh chunk index is shared.
+#define POOL_CHUNK_BITS 20
+#define POOL_CHUNK_SIZE (1u << POOL_CHUNK_BITS)
+#define POOL_MAX_CHUNKS 65536
+
+typedef struct {
+    char *chunk;        // NULL until the first name
+    uint32_t index;
+    uint32_t used;
+} PoolWriter;
+
+char *pool_chunks[POOL_MAX_CHUNKS];
+uint32_t pool_chunk_count = 0;
+
+// Copies s plus a NUL terminator. Returns UINT64_MAX when out of memory.
+uint64_t pool_add(PoolWriter *pw, const char *s, size_t len) {
+    if (!pw->chunk || pw->used + len + 1 > POOL_CHUNK_SIZE) {
+        uint32_t index = __atomic_fetch_add(&pool_chunk_count, 1, __ATOMIC_RELAXED);
+        if (index >= POOL_MAX_CHUNKS) return UINT64_MAX;
+        char *chunk = (char*)malloc(POOL_CHUNK_SIZE);
+        if (!chunk) return UINT64_MAX;
+        pool_chunks[index] = chunk;     // readers see it through the release of result_count
+        pw->chunk = chunk;
+        pw->index = index;
+        pw->used = 0;
     }
-    return NULL;
+    char *dst = pw->chunk + pw->used;
+    memcpy(dst, s, len);
+    dst[len] = '\0';
+    uint64_t off = ((uint64_t)pw->index << POOL_CHUNK_BITS) | pw->used;
+    pw->used += (uint32_t)len + 1;
+    return off;
 }
 
-__forceinline int avx2_strcasestr(const char *haystack, const char *needle, size_t needle_len) {
-    if (needle_len == 0) return 1;
-    char first_char = tolower(needle[0]);
-    __m256i vec_first = _mm256_set1_epi8(first_char);
-    __m256i vec_case_mask = _mm256_set1_epi8(0x20);
-    size_t i = 0;
-    
-    for (; haystack[i]; i += 32) {
-        __m256i block = _mm256_loadu_si256((const __m256i*)(haystack + i));
-        __m256i block_lower = _mm256_or_si256(block, vec_case_mask);
-        __m256i eq = _mm256_cmpeq_epi8(vec_first, block_lower);
-        unsigned int mask = _mm256_movemask_epi8(eq);
-        while (mask) {
-            int bit_pos = __builtin_ctz(mask);
-            if (_strnicmp(haystack + i + bit_pos, needle, needle_len) == 0) return 1;
-            mask &= ~(1 << bit_pos);
-        }
+static inline const char *pool_str(uint64_t off) {
+    return pool_chunks[off >> POOL_CHUNK_BITS] + (off & (POOL_CHUNK_SIZE - 1));
+}
+
+// ==========================================
+// RESULT STORE
+// ==========================================
+// Writers reserve a run of slots with one atomic add, fill them, then publish
+// by moving result_count past the run once every earlier run is published.
+// Segments are installed once and never move, so growing copies nothing and
+// readers take result_count (acquire) as a snapshot without any lock.
+static inline Result *result_at(long i) {
+    return &result_segs[i >> RESULT_SEG_BITS]->results[i & (RESULT_SEG_SIZE - 1)];
+}
+
+static inline uint64_t result_size(long i) {
+    return result_segs[i >> RESULT_SEG_BITS]->sizes[i & (RESULT_SEG_SIZE - 1)];
+}
+
+static inline int result_dead(long i) {
+    return result_segs[i >> RESULT_SEG_BITS]->dead[i & (RESULT_SEG_SIZE - 1)];
+}
+
+static inline long result_snapshot() {
+    return __atomic_load_n(&result_count, __ATOMIC_ACQUIRE);
+}
+
+// Full path of result i, rebuilt from its directory node. Returns the length, 0 if it does not fit.
+size_t result_path(long i, char *out, size_t cap) {
+    const Result *r = result_at(i);
+    return tree_join(dir_tree, r->dir, pool_str(r->name), r->name_len, out, cap);
+}
+
+// Whether b's name directly follows a's in the same pool chunk
+static inline int result_names_adjacent(const Result *a, const Result *b) {
+    return b->name == a->name + a->name_len + 1 && (b->name >> POOL_CHUNK_BITS) == (a->name >> POOL_CHUNK_BITS);
+}
+
+int result_segment(long s) {
+    if (s >= RESULT_MAX_SEGS) return 0;
+    if (__atomic_load_n(&result_segs[s], __ATOMIC_ACQUIRE)) return 1;
+    ResultSeg *fresh = (ResultSeg*)_aligned_malloc(sizeof(ResultSeg), 32);
+    if (!fresh) return 0;
+    ResultSeg *expected = NULL;
+    if (!__atomic_compare_exchange_n(&result_segs[s], &expected, fresh, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) _aligned_free(fresh);
+    return 1;
+}
+
+// Waits for the runs before start, then makes [start, start + n) visible
+void result_publish(long start, long n) {
+    for (int spins = 0; __atomic_load_n(&result_count, __ATOMIC_ACQUIRE) != start; spins++) {
+        if (__atomic_load_n(&result_sealed, __ATOMIC_ACQUIRE)) return;
+        if (spins < 64) YieldProcessor();
+        else SwitchToThread();
     }
-    return 0;
+    __atomic_store_n(&result_count, start + n, __ATOMIC_RELEASE);
 }
 
 // ==========================================
 // STORAGE & BATCHING
 // ==========================================
-void add_results_batch(const char (*paths)[MAX_PATH_LEN], const uint64_t *sizes, int count) {
-    if (count == 0) return;
-
-    EnterCriticalSection(&result_lock);
-    
-    if (result_count + count >= result_capacity) {
-        long new_cap = result_capacity + count + (result_capacity / 2) + 1024;
-        Result *new_ptr = (Result*)realloc(results, new_cap * sizeof(Result));
-        uint64_t *new_sizes = (uint64_t*)_aligned_malloc(new_cap * sizeof(uint64_t), 32);
-        
-        if (new_ptr && new_sizes) {
-            results = new_ptr;
-            if (file_sizes) {
-                memcpy(new_sizes, file_sizes, result_count * sizeof(uint64_t));
-                _aligned_free(file_sizes);
-            }
-            file_sizes = new_sizes;
-            result_capacity = new_cap;
-        } else {
-            if (new_sizes) _aligned_free(new_sizes);
-            LeaveCriticalSection(&result_lock);
+// names are pool offsets the caller already wrote
+void add_results_batch(const uint64_t *names, const uint32_t *lens, const uint32_t *dirs, const uint64_t *sizes, int count) {
+    if (count == 0 || __atomic_load_n(&result_sealed, __ATOMIC_ACQUIRE)) return;
+
+    long start = __atomic_fetch_add(&result_reserved, count, __ATOMIC_RELAXED);
+    long end = start + count;
+    for (long s = start >> RESULT_SEG_BITS; s <= (end - 1) >> RESULT_SEG_BITS; s++) {
+        if (!result_segment(s)) {
+            // Nothing past this run can be published; later writers give up
+            __atomic_store_n(&result_sealed, 1, __ATOMIC_RELEASE);
             return;
         }
     }
 
-    for(int i=0; i<count; i++) {
-        strcpy(results[result_count + i].path, paths[i]);
+    for (int i = 0; i < count; i++) {
+        long slot = start + i;
+        ResultSeg *seg = result_segs[slot >> RESULT_SEG_BITS];
+        Result *r = &seg->results[slot & (RESULT_SEG_SIZE - 1)];
+        r->name = names[i];
+        r->dir = dirs[i];
+        r->name_len = lens[i];
+        seg->sizes[slot & (RESULT_SEG_SIZE - 1)] = sizes[i];
+        seg->dead[slot & (RESULT_SEG_SIZE - 1)] = 0;
     }
-    memcpy(&file_sizes[result_count], sizes, count * sizeof(uint64_t));
-    
-    result_count += count;
-    LeaveCriticalSection(&result_lock);
+    result_publish(start, count);
+}
+
+// ==========================================
+// FILTER LOGIC
+// ==========================================
+// Path mode: literal hits of each directory's full path, computed once per
+// directory per filter pass and ORed with the hits of each name below it
+uint64_t *dir_hits = NULL;
+uint32_t *dir_stamp = NULL;
+uint32_t dir_cache_cap = 0;
+uint32_t filter_stamp = 0;
+
+int directory_hits_reserve(uint32_t dir) {
+    if (dir < dir_cache_cap) return 1;
+    uint32_t cap = __atomic_load_n(&dir_tree->max_id, __ATOMIC_RELAXED) + 1024;
+    if (cap <= dir) cap = dir + 1024;
+    uint64_t *h = (uint64_t*)realloc(dir_hits, cap * sizeof(uint64_t));
+    if (h) dir_hits = h;
+    uint32_t *st = h ? (uint32_t*)realloc(dir_stamp, cap * sizeof(uint32_t)) : NULL;
+    if (!st) return 0;
+    dir_stamp = st;
+    memset(dir_stamp + dir_cache_cap, 0, (cap - dir_cache_cap) * sizeof(uint32_t));
+    dir_cache_cap = cap;
+    return 1;
+}
+
+uint64_t directory_hits(uint32_t dir) {
+    if (!directory_hits_reserve(dir)) return 0;
+    if (dir_stamp[dir] != filter_stamp) {
+        char path[MAX_PATH_LEN];
+        size_t len = tree_path(dir_tree, dir, path, sizeof(path));
+        dir_hits[dir] = query_literals(&filter_query, path, len);
+        dir_stamp[dir] = filter_stamp;
+    }
+    return dir_hits[dir];
+}
+
+int filter_result(long i) {
+    const Result *r = result_at(i);
+    const char *name = pool_str(r->name);
+    if (filter_mode == 0) return query_match(&filter_query, name, r->name_len);
+
+    // Literals without a separator lie wholly inside the directory or the name.
+    // Globs and separator literals see the rebuilt path.
+    if (filter_query.glob_mask | filter_query.sep_mask) {
+        char path[MAX_PATH_LEN];
+        size_t len = result_path(i, path, sizeof(path));
+        return query_match(&filter_query, path, len);
+    }
+    return query_eval(&filter_query, directory_hits(r->dir) | query_literals(&filter_query, name, r->name_len));
 }
 
-void join_path(char *dest, const char *p1, const char *p2) {
-    size_t len = strlen(p1);
-    strcpy(dest, p1);
-    if (len > 0 && dest[len - 1] != '\\' && dest[len - 1] != '/') {
-        strcat(dest, "\\");
+// Filter levels form a chain of texts, each a prefix of the next; the top one
+// is displayed. Typing narrows the top level's results when the new query
+// implies the old one, backspace pops back to a cached level, and every level
+// remembers how many results it has seen so a running scan only costs the
+// newly appended ones.
+typedef struct {
+    char text[256];
+    int mode;
+    long *indices;
+    long count;
+    long capacity;
+    long upto;      // results [0, upto) have been examined
+} FilterLevel;
+
+FilterLevel filter_levels[FILTER_CACHE_DEPTH];
+int filter_depth = 0;
+char filter_compiled[256] = {0}; // text currently held by filter_query
+Query filter_parent;             // scratch: the level being narrowed from
+
+void filter_use(const char *text) {
+    if (filter_stamp != 0 && strcmp(filter_compiled, text) == 0) return;
+    query_compile(&filter_query, text);
+    strcpy(filter_compiled, text);
+    if (++filter_stamp == 0) {
+        if (dir_stamp) memset(dir_stamp, 0, dir_cache_cap * sizeof(uint32_t));
+        filter_stamp = 1;
     }
-    strcat(dest, p2);
+}
+
+// Dead results have to be skipped, so the view goes through a filter level
+// (with an empty text when not filtering) once there are any
+static inline int view_filtered() {
+    return is_filtering || result_dead_count > 0;
+}
+
+int filter_push_index(FilterLevel *l, long i) {
+    if (l->count == l->capacity) {
+        long new_cap = l->capacity ? l->capacity * 2 : INITIAL_RESULT_CAPACITY;
+        long *new_ptr = (long*)realloc(l->indices, new_cap * sizeof(long));
+        if (!new_ptr) return 0;
+        l->indices = new_ptr;
+        l->capacity = new_cap;
+    }
+    l->indices[l->count++] = i;
+    return 1;
 }
 
 // ==========================================
-// FILTER LOGIC
+// PARALLEL FILTER
 // ==========================================
-void update_filter(int reset_selection) {
-    EnterCriticalSection(&result_lock);
-    
-    if (filtered_capacity < result_count) {
-        long new_cap = result_count + 1024;
-        long *new_ptr = (long*)realloc(filtered_indices, new_cap * sizeof(long));
-        if (new_ptr) {
-            filtered_indices = new_ptr;
-            filtered_capacity = new_cap;
-        }
+// A pass tests either a list of result indices (narrowing a cached level) or a
+// range of results (a fresh pass or newly appended results). Large passes are
+// split over threads that collect hits locally; the parts are appended in
+// order. In name mode a query that is one plain literal skips the per-name
+// calls: the names of a range sit back to back in the string pool, NUL
+// separated, so one SIMD scan over the pool finds the hits and the name
+// offsets map each back to its result (a needle has no NUL, so a hit never
+// spans two names).
+typedef struct {
+    int dirs;           // fill the path-mode directory cache for ids [begin, end) instead
+    const long *src;    // indices to test, NULL to test results [begin, end)
+    long begin, end;    // positions in src, or result indices
+    long *hits;
+    long count;
+    long capacity;
+} FilterTask;
+
+int filter_task_push(FilterTask *t, long i) {
+    if (result_dead(i)) return 1;
+    if (t->count == t->capacity) {
+        long new_cap = t->capacity ? t->capacity * 2 : 1024;
+        long *new_ptr = (long*)realloc(t->hits, new_cap * sizeof(long));
+        if (!new_ptr) return 0;
+        t->hits = new_ptr;
+        t->capacity = new_cap;
     }
+    t->hits[t->count++] = i;
+    return 1;
+}
 
-    filtered_count = 0;
-    int has_wildcard = (strchr(filter_text, '*') || strchr(filter_text, '?'));
-    size_t f_len = strlen(filter_text);
+// First result in [lo, hi) whose name starts after pool offset off
+long filter_result_after(long lo, long hi, uint64_t off) {
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (result_at(mid)->name <= off) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
 
-    if (f_len == 0) {
-        long i = 0;
-        for (; i <= result_count - 8; i += 8) {
-            filtered_indices[i] = i; filtered_indices[i+1] = i+1;
-            filtered_indices[i+2] = i+2; filtered_indices[i+3] = i+3;
-            filtered_indices[i+4] = i+4; filtered_indices[i+5] = i+5;
-            filtered_indices[i+6] = i+6; filtered_indices[i+7] = i+7;
+void filter_scan_names(FilterTask *t, const MatchNeedle *n) {
+    long i = t->begin;
+    while (i < t->end) {
+        // Run of results whose names are contiguous in one pool chunk
+        long j = i + 1;
+        while (j < t->end && result_names_adjacent(result_at(j - 1), result_at(j))) j++;
+        uint64_t base = result_at(i)->name;
+        const char *text = pool_str(base);
+        const Result *last = result_at(j - 1);
+        size_t len = (size_t)(last->name + last->name_len - base);
+        size_t pos = 0;
+        long cur = i;
+        while (pos < len) {
+            size_t hit = match_find(n, text + pos, len - pos);
+            if (!hit) break;
+            long r = filter_result_after(cur, j, base + pos + hit - 1) - 1;
+            if (!filter_task_push(t, r)) return;
+            cur = r + 1;
+            if (cur >= j) break;
+            pos = (size_t)(result_at(cur)->name - base);
         }
-        for (; i < result_count; i++) filtered_indices[i] = i;
-        filtered_count = result_count;
-    } else {
-        long i = 0;
-        for (; i <= result_count - 4; i += 4) {
-            const char *s[4];
-            s[0] = results[i].path; s[1] = results[i+1].path;
-            s[2] = results[i+2].path; s[3] = results[i+3].path;
-
-            if (filter_mode == 0) {
-                const char *ls;
-                ls = strrchr(s[0], '\\'); if(ls) s[0] = ls+1;
-                ls = strrchr(s[1], '\\'); if(ls) s[1] = ls+1;
-                ls = strrchr(s[2], '\\'); if(ls) s[2] = ls+1;
-                ls = strrchr(s[3], '\\'); if(ls) s[3] = ls+1;
-            }
+        i = j;
+    }
+}
 
-            int m[4];
-            if (has_wildcard) {
-                m[0] = fast_glob_match(s[0], filter_text); m[1] = fast_glob_match(s[1], filter_text);
-                m[2] = fast_glob_match(s[2], filter_text); m[3] = fast_glob_match(s[3], filter_text);
-            } else {
-                m[0] = (stristr(s[0], filter_text) != NULL); m[1] = (stristr(s[1], filter_text) != NULL);
-                m[2] = (stristr(s[2], filter_text) != NULL); m[3] = (stristr(s[3], filter_text) != NULL);
-            }
+void filter_task_run(FilterTask *t) {
+    if (t->dirs) {
+        for (long id = t->begin; id < t->end; id++) {
+            if (tree_node(dir_tree, (uint32_t)id)) directory_hits((uint32_t)id);
+        }
+        return;
+    }
+    const MatchNeedle *n = (!t->src && filter_mode == 0) ? query_plain_literal(&filter_query) : NULL;
+    if (n) { filter_scan_names(t, n); return; }
+    for (long k = t->begin; k < t->end; k++) {
+        long i = t->src ? t->src[k] : k;
+        if ((filter_query.clause_count == 0 || filter_result(i)) && !filter_task_push(t, i)) return;
+    }
+}
 
-            if (m[0]) filtered_indices[filtered_count++] = i;
-            if (m[1]) filtered_indices[filtered_count++] = i+1;
-            if (m[2]) filtered_indices[filtered_count++] = i+2;
-            if (m[3]) filtered_indices[filtered_count++] = i+3;
+unsigned __stdcall filter_thread(void *arg) {
+    filter_task_run((FilterTask*)arg);
+    return 0;
+}
+
+int filter_thread_count() {
+    static int count = 0;
+    if (!count) {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        count = (int)si.dwNumberOfProcessors;
+        if (count < 1) count = 1;
+        if (count > FILTER_MAX_THREADS) count = FILTER_MAX_THREADS;
+    }
+    return count;
+}
+
+// Runs tasks[0..n) with tasks[0] on the calling thread
+void filter_run_tasks(FilterTask *tasks, int n) {
+    HANDLE threads[FILTER_MAX_THREADS];
+    int started = 0;
+    for (int k = 1; k < n; k++) {
+        HANDLE h = (HANDLE)_beginthreadex(NULL, 0, filter_thread, &tasks[k], 0, NULL);
+        if (h) threads[started++] = h;
+        else filter_task_run(&tasks[k]);
+    }
+    filter_task_run(&tasks[0]);
+    if (started) WaitForMultipleObjects(started, threads, TRUE, INFINITE);
+    for (int k = 0; k < started; k++) CloseHandle(threads[k]);
+}
+
+void filter_split(FilterTask *tasks, int n, int dirs, const long *src, long begin, long end) {
+    long per = (end - begin + n - 1) / n;
+    for (int k = 0; k < n; k++) {
+        memset(&tasks[k], 0, sizeof(FilterTask));
+        tasks[k].dirs = dirs;
+        tasks[k].src = src;
+        tasks[k].begin = begin + per * k < end ? begin + per * k : end;
+        tasks[k].end = tasks[k].begin + per < end ? tasks[k].begin + per : end;
+    }
+}
+
+// Tests src[begin..end) (or results [begin, end) when src is NULL) against
+// filter_query and appends the hits to l in order. replace empties l first;
+// src may be l's own indices then. Results below end must be published.
+void filter_run(FilterLevel *l, const long *src, long begin, long end, int replace) {
+    FilterTask tasks[FILTER_MAX_THREADS];
+    int n = filter_thread_count();
+    if (end - begin < FILTER_PARALLEL_MIN) n = 1;
+
+    // Threads only read the path-mode directory cache, so fill it up front
+    if (n > 1 && filter_mode == 1 && filter_query.clause_count && !(filter_query.glob_mask | filter_query.sep_mask)) {
+        uint32_t max_id = __atomic_load_n(&dir_tree->max_id, __ATOMIC_ACQUIRE);
+        if (!directory_hits_reserve(max_id)) n = 1;
+        else {
+            filter_split(tasks, n, 1, NULL, 1, (long)max_id + 1);
+            filter_run_tasks(tasks, n);
         }
+    }
 
-        for (; i < result_count; i++) {
-            const char *s = results[i].path;
-            if (filter_mode == 0) {
-                const char *ls = strrchr(s, '\\');
-                if (ls) s = ls + 1;
+    filter_split(tasks, n, 0, src, begin, end);
+    if (n > 1) filter_run_tasks(tasks, n);
+    else filter_task_run(&tasks[0]);
+
+    if (replace) l->count = 0;
+    for (int k = 0; k < n; k++) {
+        for (long h = 0; h < tasks[k].count; h++) filter_push_index(l, tasks[k].hits[h]);
+        free(tasks[k].hits);
+    }
+}
+
+void update_filter(int reset_selection) {
+    long count = result_snapshot();
+    // Not filtering, the empty text still keeps dead results out of the view
+    const char *text = is_filtering ? filter_text : "";
+    int mode = is_filtering ? filter_mode : 0;
+
+    FilterLevel *top = filter_depth ? &filter_levels[filter_depth - 1] : NULL;
+    if (!top || top->mode != mode || strcmp(top->text, text) != 0) {
+        // Drop the levels the new text does not extend (backspace, mode switch)
+        while (filter_depth > 0) {
+            FilterLevel *l = &filter_levels[filter_depth - 1];
+            if (l->mode == mode && strncmp(l->text, text, strlen(l->text)) == 0) break;
+            filter_depth--;
+        }
+        top = filter_depth ? &filter_levels[filter_depth - 1] : NULL;
+
+        if (!top || strcmp(top->text, text) != 0) {
+            FilterLevel *src = NULL;
+            filter_use(text);
+            if (top) {
+                query_compile(&filter_parent, top->text);
+                if (query_narrows(&filter_query, &filter_parent)) src = top;
             }
-            int match = has_wildcard ? fast_glob_match(s, filter_text) : (stristr(s, filter_text) != NULL);
-            if (match) filtered_indices[filtered_count++] = i;
+            // A full cache reuses the top slot; narrowing in place is safe
+            FilterLevel *l = (filter_depth < FILTER_CACHE_DEPTH) ? &filter_levels[filter_depth++] : top;
+            long upto = src ? src->upto : 0;
+            if (src) filter_run(l, src->indices, 0, src->count, 1);
+            else l->count = 0;
+            l->upto = upto;
+            l->mode = mode;
+            strcpy(l->text, text);
+            top = l;
         }
     }
+
+    // Results appended since this level last looked
+    if (top->upto < count) {
+        filter_use(top->text);
+        filter_run(top, NULL, top->upto, count, 0);
+        top->upto = count;
+    }
+    filtered_indices = top->indices;
+    filtered_count = top->count;
     
     if (reset_selection) {
         selected_index = 0;
@@ -250,68 +520,21 @@ void update_filter(int reset_selection) {
             selected_index = filtered_count - 1;
         }
     }
-    
-    LeaveCriticalSection(&result_lock);
 }
 
 // ==========================================
-// DYNAMIC WORK QUEUE
+// SIZE ESTIMATOR (AVX2 when the CPU has it)
 // ==========================================
-typedef struct QueueNode {
-    char *path;
-    struct QueueNode *next;
-} QueueNode;
-
-QueueNode *q_head = NULL;
-QueueNode *q_tail = NULL;
-CRITICAL_SECTION queue_lock;
-CONDITION_VARIABLE queue_cond;
-volatile long idle_workers = 0;
-
-void push_job(const char *path) {
-    QueueNode *node = (QueueNode*)malloc(sizeof(QueueNode));
-    if (!node) return;
-    node->path = _strdup(path);
-    node->next = NULL;
-
-    EnterCriticalSection(&queue_lock);
-    if (q_tail) {
-        q_tail->next = node;
-        q_tail = node;
-    } else {
-        q_head = q_tail = node;
-    }
-    WakeConditionVariable(&queue_cond);
-    LeaveCriticalSection(&queue_lock);
-}
-
-int pop_job(char *out_path) {
-    int found = 0;
-    EnterCriticalSection(&queue_lock);
-    if (q_head) {
-        QueueNode *node = q_head;
-        strcpy(out_path, node->path);
-        q_head = node->next;
-        if (q_head == NULL) q_tail = NULL;
-        free(node->path);
-        free(node);
-        found = 1;
-    }
-    LeaveCriticalSection(&queue_lock);
-    return found;
-}
-
-// ==========================================
-// AVX2 SIZE ESTIMATOR
-// ==========================================
-unsigned long long calculate_total_size_avx2(uint64_t *sizes, long *indices, long count) {
+__attribute__((target("avx2")))
+unsigned long long calculate_total_size_avx2(uint64_t *sizes, const long *indices, long count, long bias) {
     if (count == 0) return 0;
     __m256i v_sum = _mm256_setzero_si256();
     long i = 0;
     
     if (indices) {
+        __m256i v_bias = _mm256_set1_epi32((int)bias);
         for (; i <= count - 8; i += 8) {
-            __m256i v_idx_raw = _mm256_loadu_si256((__m256i const*)&indices[i]);
+            __m256i v_idx_raw = _mm256_sub_epi32(_mm256_loadu_si256((__m256i const*)&indices[i]), v_bias);
             __m256i v_sizes_lo = _mm256_i32gather_epi64((long long const*)sizes,
                                                        _mm256_castsi256_si128(v_idx_raw), 8);
             __m128i v_idx_hi_128 = _mm256_extracti128_si256(v_idx_raw, 1);
@@ -323,7 +546,7 @@ unsigned long long calculate_total_size_avx2(uint64_t *sizes, long *indices, lon
         uint64_t buffer[4];
         _mm256_storeu_si256((__m256i*)buffer, v_sum);
         total = buffer[0] + buffer[1] + buffer[2] + buffer[3];
-        for (; i < count; i++) total += sizes[indices[i]];
+        for (; i < count; i++) total += sizes[indices[i] - bias];
         return total;
     } else {
         for (; i <= count - 16; i += 16) {
@@ -344,6 +567,34 @@ unsigned long long calculate_total_size_avx2(uint64_t *sizes, long *indices, lon
     }
 }
 
+// indices (minus bias) select from sizes; NULL sums sizes[0..count)
+unsigned long long calculate_total_size(uint64_t *sizes, const long *indices, long count, long bias) {
+    if (match_active >= MATCH_AVX2) return calculate_total_size_avx2(sizes, indices, count, bias);
+    unsigned long long total = 0;
+    if (indices) for (long i = 0; i < count; i++) total += sizes[indices[i] - bias];
+    else for (long i = 0; i < count; i++) total += sizes[i];
+    return total;
+}
+
+// Sum over results [0, count), or over ascending result indices: one pass per segment
+unsigned long long results_total_size(const long *indices, long count) {
+    unsigned long long total = 0;
+    long i = 0;
+    while (i < count) {
+        long seg = (indices ? indices[i] : i) >> RESULT_SEG_BITS;
+        long next = (seg + 1) << RESULT_SEG_BITS;
+        long j;
+        if (indices) {
+            long lo = i, hi = count;
+            while (lo < hi) { long mid = lo + (hi - lo) / 2; if (indices[mid] < next) lo = mid + 1; else hi = mid; }
+            j = lo;
+        } else j = next < count ? next : count;
+        total += calculate_total_size(result_segs[seg]->sizes, indices ? indices + i : NULL, j - i, indices ? seg << RESULT_SEG_BITS : 0);
+        i = j;
+    }
+    return total;
+}
+
 void format_size_fast(unsigned long long bytes, char *out) {
     const char *units[] = {"B", "KB", "MB", "GB", "TB"};
     int unit_idx = 0;
@@ -356,127 +607,653 @@ void format_size_fast(unsigned long long bytes, char *out) {
 }
 
 // ==========================================
-// WORKER THREAD (ADAPTIVE BATCHING)
+// WORKER CALLBACKS (ADAPTIVE BATCHING)
 // ==========================================
-unsigned __stdcall worker_thread(void *arg) {
-    char current_dir[MAX_PATH_LEN];
-    char search_path[MAX_PATH_LEN];
-    
+typedef struct {
+    PoolWriter pool;    // names go straight into this worker's pool chunk
+    uint64_t names[WORKER_BATCH_SIZE];
+    uint32_t lens[WORKER_BATCH_SIZE];
+    uint32_t dirs[WORKER_BATCH_SIZE];
+    uint64_t sizes[WORKER_BATCH_SIZE];
+    int count;
+    int limit;
+} WorkerBatch;
+
+void flush_batch(WorkerBatch *b) {
+    if (b->count > 0) add_results_batch(b->names, b->lens, b->dirs, b->sizes, b->count);
+    b->count = 0;
+}
+
+void batch_push(WorkerBatch *b, uint32_t dir, const char *name, size_t len, uint64_t size) {
+    uint64_t off = pool_add(&b->pool, name, len);
+    if (off == UINT64_MAX) return;
+    b->names[b->count] = off;
+    b->lens[b->count] = (uint32_t)len;
+    b->dirs[b->count] = dir;
+    b->sizes[b->count] = size;
+    b->count++;
+}
+
+void worker_start(ScanWorker *w) {
     // THREAD LOCAL BATCH STORAGE
-    char (*batch_paths)[MAX_PATH_LEN] = malloc(WORKER_BATCH_SIZE * MAX_PATH_LEN);
-    uint64_t *batch_sizes = malloc(WORKER_BATCH_SIZE * sizeof(uint64_t));
-    int batch_count = 0;
-    
+    WorkerBatch *b = (WorkerBatch*)calloc(1, sizeof(WorkerBatch));
     // ADAPTIVE BATCHING: Start at 1 for instant feedback, ramp to 64 for speed
-    int current_batch_limit = 1;
+    b->limit = 1;
+    w->local = b;
+}
 
-    WIN32_FIND_DATAA find_data;
-    HANDLE hFind;
+int worker_dir(ScanWorker *w, const ScanJob *dir) {
+    tree_add_job(dir_tree, w, dir);
+    return SCAN_CONTINUE;
+}
 
-    InterlockedIncrement(&active_workers);
+int worker_entry(ScanWorker *w, const ScanJob *dir, ScanEntry *e) {
+    WorkerBatch *b = (WorkerBatch*)w->local;
 
-    while (running) {
-        int has_work = 0;
-
-        // ----------------------------------------
-        // THE WAITING ROOM
-        // ----------------------------------------
-        EnterCriticalSection(&queue_lock);
-        while (q_head == NULL && running) {
-            if (batch_count > 0) {
-                LeaveCriticalSection(&queue_lock); 
-                add_results_batch(batch_paths, batch_sizes, batch_count);
-                batch_count = 0;
-                EnterCriticalSection(&queue_lock); 
-                continue; 
-            }
+    if (query_match(&target_query, e->name, e->name_len)) {
+        batch_push(b, dir->id, e->name, e->name_len, scan_entry_stat(e) ? e->size : 0);
 
-            // If we sleep, reset batch limit to 1 for responsiveness on next wake
-            current_batch_limit = 1;
+        // ADAPTIVE FLUSH TRIGGER
+        if (b->count >= b->limit) {
+            flush_batch(b);
 
-            idle_workers++;
-            if (idle_workers == THREAD_COUNT) {
-                finished_scanning = 1;
-                WakeAllConditionVariable(&queue_cond);
+            // Ramp up: 1 -> 8 -> 64
+            if (b->limit < WORKER_BATCH_SIZE) {
+                b->limit *= 8;
+                if (b->limit > WORKER_BATCH_SIZE) b->limit = WORKER_BATCH_SIZE;
             }
-            if (finished_scanning) {
-                idle_workers--;
-                LeaveCriticalSection(&queue_lock);
-                if (batch_count > 0) add_results_batch(batch_paths, batch_sizes, batch_count);
-                free(batch_paths);
-                free(batch_sizes);
-                InterlockedDecrement(&active_workers);
-                return 0;
-            }
-            SleepConditionVariableCS(&queue_cond, &queue_lock, INFINITE);
-            idle_workers--;
         }
+    }
+    return SCAN_CONTINUE;
+}
+
+void worker_idle(ScanWorker *w) {
+    WorkerBatch *b = (WorkerBatch*)w->local;
+    flush_batch(b);
+    // If we sleep, reset batch limit to 1 for responsiveness on next wake
+    b->limit = 1;
+}
+
+void worker_stop(ScanWorker *w) {
+    WorkerBatch *b = (WorkerBatch*)w->local;
+    flush_batch(b);
+    free(b);
+    w->local = NULL;
+}
 
-        if (q_head) {
-            QueueNode *node = q_head;
-            strcpy(current_dir, node->path);
-            q_head = node->next;
-            if (q_head == NULL) q_tail = NULL;
-            free(node->path);
+void scan_complete(ScanCtx *ctx) {
+    finished_scanning = 1;
+}
+
+// ==========================================
+// SCAN BENCHMARK
+// ==========================================
+double bench_scan(const char *dir, int threads, uint64_t *dirs, uint64_t *entries) {
+    LARGE_INTEGER freq, t0, t1;
+    QueryPerformanceFrequency(&freq);
+
+    ScanCtx *ctx = scan_create(threads, NULL);
+    scan_add_root(ctx, dir);
+    QueryPerformanceCounter(&t0);
+    scan_start(ctx);
+    scan_wait(ctx);
+    QueryPerformanceCounter(&t1);
+
+    *dirs = 0; *entries = 0;
+    for (int i = 0; i < ctx->worker_count; i++) {
+        *dirs += ctx->workers[i].dirs_scanned;
+        *entries += ctx->workers[i].entries_seen;
+    }
+    scan_release(ctx);
+    return (double)(t1.QuadPart - t0.QuadPart) / (double)freq.QuadPart;
+}
+
+// Directories/sec from 1 to SCAN_MAX_THREADS workers over the same tree.
+// The first pass only warms the file system cache so every row sees the same state.
+int run_benchmark(const char *dir) {
+    uint64_t dirs, entries;
+    printf("blade %s scan benchmark: %s\n", VERSION, dir);
+    bench_scan(dir, THREAD_COUNT, &dirs, &entries);
+    printf("%8s %12s %12s %10s %14s\n", "threads", "dirs", "entries", "seconds", "dirs/sec");
+    for (int threads = 1; threads <= SCAN_MAX_THREADS; threads *= 2) {
+        double secs = bench_scan(dir, threads, &dirs, &entries);
+        printf("%8d %12llu %12llu %10.3f %14.0f\n", threads, (unsigned long long)dirs,
+               (unsigned long long)entries, secs, secs > 0 ? dirs / secs : 0.0);
+    }
+    return 0;
+}
+
+// ==========================================
+// STREAMING OUTPUT (--print0 / --ndjson)
+// ==========================================
+// Headless mode: matches go straight to stdout and nothing is kept in results.
+// Each worker formats records into its own buffer and hands it to stdout in one
+// WriteFile once it is nearly full or the worker runs out of work.
+//
+// --ordered prints matches in the order a single-threaded depth-first walk
+// would: each directory's entries in enumeration order, a subdirectory's
+// matches right after the subdirectory itself. A directory's records are kept
+// in its StreamNode (with a marker where each subdirectory's output belongs)
+// until everything before it has been printed, so memory grows only with the
+// part of the tree that finished ahead of the output cursor.
+#define STREAM_PRINT0 1
+#define STREAM_NDJSON 2
+#define STREAM_BUF_SIZE (1024 * 1024)
+#define STREAM_RECORD_MAX ((SCAN_PATH_MAX + 256) * 6 + 128) // every path byte escaped as \u00XX
+#define STREAM_CHILD UINT32_MAX                     // record header of a subdirectory marker
+
+typedef struct {
+    size_t used;
+    char data[STREAM_BUF_SIZE];
+} StreamBuf;
+
+// Records of one directory: [uint32 len][len bytes] or [STREAM_CHILD][StreamNode*]
+typedef struct StreamNode {
+    char *buf;          // written only by the worker enumerating the directory
+    size_t used;
+    size_t cap;
+    long done;          // set once that worker is finished with it
+} StreamNode;
+
+typedef struct {
+    StreamNode *node;
+    size_t pos;
+} StreamFrame;
+
+int stream_mode = 0;
+int stream_ordered = 0;
+HANDLE stream_handle;
+CRITICAL_SECTION stream_lock;   // keeps whole buffers together on stdout
+StreamBuf *stream_out = NULL;   // ordered mode: records the cursor has released
+StreamFrame stream_stack[SCAN_PATH_MAX / 2 + 1];
+int stream_depth = 0;
+
+// Caller holds stream_lock
+void stream_write(const char *data, size_t len) {
+    DWORD written;
+    while (len > 0 && running) {
+        DWORD chunk = len > (1u << 30) ? (1u << 30) : (DWORD)len;
+        if (!WriteFile(stream_handle, data, chunk, &written, NULL) || written == 0) {
+            running = 0;    // reader went away (e.g. "| head"): stop the scan
+            break;
+        }
+        data += written;
+        len -= written;
+    }
+}
+
+void stream_flush(StreamBuf *b) {
+    if (b->used == 0) return;
+    EnterCriticalSection(&stream_lock);
+    stream_write(b->data, b->used);
+    LeaveCriticalSection(&stream_lock);
+    b->used = 0;
+}
+
+size_t stream_json_string(char *out, const char *s, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = (uint8_t)s[i];
+        if (c == '"' || c == '\\') { out[n++] = '\\'; out[n++] = (char)c; }
+        else if (c < 0x20) {
+            memcpy(out + n, "\\u00", 4);
+            out[n + 4] = hex[c >> 4];
+            out[n + 5] = hex[c & 15];
+            n += 6;
+        } else out[n++] = (char)c;
+    }
+    return n;
+}
+
+// Formats one match into out (at least STREAM_RECORD_MAX bytes). Returns its length.
+size_t stream_record(char *out, const ScanJob *dir, ScanEntry *e) {
+    char path[SCAN_PATH_MAX * 2];
+    size_t len = dir->len;
+    memcpy(path, dir->path, len);
+    if (len > 0 && path[len - 1] != '\\' && path[len - 1] != '/') path[len++] = SCAN_SEP;
+    memcpy(path + len, e->name, e->name_len);
+    len += e->name_len;
+
+    if (stream_mode == STREAM_PRINT0) {
+        memcpy(out, path, len);
+        out[len] = '\0';
+        return len + 1;
+    }
+    uint64_t size = 0, mtime = 0;
+    if (scan_entry_stat(e)) {
+        size = e->size;
+        // FILETIME ticks to Unix seconds
+        if (e->mtime >= 116444736000000000ULL) mtime = e->mtime / 10000000ULL - 11644473600ULL;
+    }
+    size_t n = 0;
+    memcpy(out, "{\"path\":\"", 9); n = 9;
+    n += stream_json_string(out + n, path, len);
+    n += sprintf(out + n, "\",\"size\":%llu,\"mtime\":%llu,\"dir\":%s}\n",
+                 (unsigned long long)size, (unsigned long long)mtime, e->is_dir ? "true" : "false");
+    return n;
+}
+
+StreamNode *stream_node_create() {
+    return (StreamNode*)calloc(1, sizeof(StreamNode));
+}
+
+int stream_node_append(StreamNode *node, uint32_t head, const void *data, size_t len) {
+    if (node->used + 4 + len > node->cap) {
+        size_t cap = node->cap ? node->cap * 2 : 256;
+        while (cap < node->used + 4 + len) cap *= 2;
+        char *buf = (char*)realloc(node->buf, cap);
+        if (!buf) return 0;
+        node->buf = buf;
+        node->cap = cap;
+    }
+    memcpy(node->buf + node->used, &head, 4);
+    memcpy(node->buf + node->used + 4, data, len);
+    node->used += 4 + len;
+    return 1;
+}
+
+void stream_out_append(const char *data, size_t len) {
+    if (stream_out->used + len > STREAM_BUF_SIZE) {
+        stream_write(stream_out->data, stream_out->used);
+        stream_out->used = 0;
+    }
+    if (len > STREAM_BUF_SIZE) { stream_write(data, len); return; }
+    memcpy(stream_out->data + stream_out->used, data, len);
+    stream_out->used += len;
+}
+
+// Prints everything the cursor can reach without passing an unfinished directory.
+// force (after the scan) treats every node as finished. Caller holds stream_lock.
+void stream_drain(int force) {
+    while (stream_depth > 0) {
+        StreamFrame *f = &stream_stack[stream_depth - 1];
+        StreamNode *node = f->node;
+        if (!force && !__atomic_load_n(&node->done, __ATOMIC_ACQUIRE)) break;
+        if (f->pos == node->used) {
+            free(node->buf);
             free(node);
-            has_work = 1;
+            stream_depth--;
+            continue;
         }
-        LeaveCriticalSection(&queue_lock);
-
-        // ----------------------------------------
-        // THE GRIND
-        // ----------------------------------------
-        if (has_work) {
-            join_path(search_path, current_dir, "*");
-            hFind = FindFirstFileExA(search_path, FindExInfoBasic, &find_data, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
-            
-            if (hFind != INVALID_HANDLE_VALUE) {
-                do {
-                    if (find_data.cFileName[0] == '.') {
-                        if (find_data.cFileName[1] == '\0') continue;
-                        if (find_data.cFileName[1] == '.' && find_data.cFileName[2] == '\0') continue;
-                    }
-                    
-                    int match = 0;
-                    if (IS_WILDCARD) match = fast_glob_match(find_data.cFileName, TARGET_RAW);
-                    else match = avx2_strcasestr(find_data.cFileName, TARGET_LOWER, TARGET_LEN);
-
-                    if (match) {
-                        join_path(batch_paths[batch_count], current_dir, find_data.cFileName);
-                        batch_sizes[batch_count] = ((uint64_t)find_data.nFileSizeHigh << 32) | find_data.nFileSizeLow;
-                        batch_count++;
-
-                        // ADAPTIVE FLUSH TRIGGER
-                        if (batch_count >= current_batch_limit) {
-                            add_results_batch(batch_paths, batch_sizes, batch_count);
-                            batch_count = 0;
-                            
-                            // Ramp up: 1 -> 8 -> 64
-                            if (current_batch_limit < WORKER_BATCH_SIZE) {
-                                current_batch_limit *= 8;
-                                if (current_batch_limit > WORKER_BATCH_SIZE) 
-                                    current_batch_limit = WORKER_BATCH_SIZE;
-                            }
-                        }
-                    }
-                    
-                    if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-                        if (!(find_data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
-                            char new_dir_path[MAX_PATH_LEN];
-                            join_path(new_dir_path, current_dir, find_data.cFileName);
-                            push_job(new_dir_path);
-                        }
-                    }
-                } while (FindNextFileA(hFind, &find_data) && running);
-                FindClose(hFind);
-            }
+        uint32_t head;
+        memcpy(&head, node->buf + f->pos, 4);
+        f->pos += 4;
+        if (head != STREAM_CHILD) {
+            stream_out_append(node->buf + f->pos, head);
+            f->pos += head;
+            continue;
         }
+        StreamNode *child;
+        memcpy(&child, node->buf + f->pos, sizeof(child));
+        f->pos += sizeof(child);
+        if (stream_depth == (int)(sizeof(stream_stack) / sizeof(stream_stack[0]))) {
+            free(child->buf);   // deeper than any path can be; cannot happen
+            free(child);
+            continue;
+        }
+        stream_stack[stream_depth].node = child;
+        stream_stack[stream_depth].pos = 0;
+        stream_depth++;
     }
-    
-    if (batch_count > 0) add_results_batch(batch_paths, batch_sizes, batch_count);
-    free(batch_paths);
-    free(batch_sizes);
-    InterlockedDecrement(&active_workers);
+}
+
+void stream_start(ScanWorker *w) {
+    StreamBuf *b = (StreamBuf*)malloc(sizeof(StreamBuf));
+    if (b) b->used = 0;
+    w->local = b;
+}
+
+int stream_entry(ScanWorker *w, const ScanJob *dir, ScanEntry *e) {
+    StreamBuf *b = (StreamBuf*)w->local;
+    if (!running) { scan_cancel(w->ctx); return SCAN_SKIP; }
+    if (!b) return SCAN_SKIP;
+
+    if (!stream_ordered) {
+        if (query_match(&target_query, e->name, e->name_len)) {
+            if (b->used + STREAM_RECORD_MAX > STREAM_BUF_SIZE) stream_flush(b);
+            b->used += stream_record(b->data + b->used, dir, e);
+        }
+        return SCAN_CONTINUE;
+    }
+
+    StreamNode *node = (StreamNode*)dir->tag;
+    if (!node) return SCAN_SKIP;
+    if (query_match(&target_query, e->name, e->name_len)) {
+        size_t n = stream_record(b->data, dir, e);
+        stream_node_append(node, (uint32_t)n, b->data, n);
+    }
+    // Reserve the subdirectory's place in the output; its job fills the node in.
+    // Folders the engine will not queue (below maxdepth, or too long) get no node,
+    // or the cursor would wait for them.
+    int need_sep = dir->len > 0 && dir->path[dir->len - 1] != '\\' && dir->path[dir->len - 1] != '/';
+    if (e->descend && dir->len + need_sep + e->name_len < SCAN_PATH_MAX) {
+        StreamNode *child = stream_node_create();
+        if (!child) return SCAN_SKIP;
+        if (!stream_node_append(node, STREAM_CHILD, &child, sizeof(child))) { free(child); return SCAN_SKIP; }
+        e->tag = (uintptr_t)child;
+    }
+    return SCAN_CONTINUE;
+}
+
+void stream_dir_done(ScanWorker *w, const ScanJob *dir) {
+    if (!dir->tag) return;
+    EnterCriticalSection(&stream_lock);
+    __atomic_store_n(&((StreamNode*)dir->tag)->done, 1, __ATOMIC_RELEASE);
+    stream_drain(0);
+    LeaveCriticalSection(&stream_lock);
+}
+
+void stream_idle(ScanWorker *w) {
+    StreamBuf *b = (StreamBuf*)w->local;
+    if (b && !stream_ordered) stream_flush(b);
+}
+
+void stream_stop(ScanWorker *w) {
+    stream_idle(w);
+    free(w->local);
+    w->local = NULL;
+}
+
+void stream_finish(ScanCtx *ctx) {
+    if (stream_ordered) {
+        EnterCriticalSection(&stream_lock);
+        stream_drain(1);
+        stream_write(stream_out->data, stream_out->used);
+        stream_out->used = 0;
+        LeaveCriticalSection(&stream_lock);
+    }
+    finished_scanning = 1;
+}
+
+int run_stream(const char *root) {
+    stream_handle = GetStdHandle(STD_OUTPUT_HANDLE);
+    InitializeCriticalSection(&stream_lock);
+    scan_ctx = scan_create(THREAD_COUNT, NULL);
+    if (!scan_ctx || !scan_set_prune(scan_ctx, &scan_prune)) return 1;
+    scan_ctx->on_start = stream_start;
+    scan_ctx->on_entry = stream_entry;
+    scan_ctx->on_idle = stream_idle;
+    scan_ctx->on_stop = stream_stop;
+    scan_ctx->on_finish = stream_finish;
+    if (stream_ordered) {
+        stream_out = (StreamBuf*)malloc(sizeof(StreamBuf));
+        StreamNode *top = stream_node_create();
+        if (!stream_out || !top) return 1;
+        stream_out->used = 0;
+        stream_stack[0].node = top;
+        stream_stack[0].pos = 0;
+        stream_depth = 1;
+        scan_ctx->on_dir_done = stream_dir_done;
+        scan_add_root_tagged(scan_ctx, root, (uintptr_t)top);
+    } else {
+        scan_add_root(scan_ctx, root);
+    }
+    scan_start(scan_ctx);
+    while (!finished_scanning) {
+        if (!running) scan_cancel(scan_ctx);
+        Sleep(10);
+    }
+    scan_release(scan_ctx);
+    return 0;
+}
+
+// ==========================================
+// INDEX MODE
+// ==========================================
+int use_index = 0;
+const char * volatile index_status = "Scanning...";
+
+// Node id of index directory d (d + 1), registering it and its ancestors on first use
+uint32_t index_node(const BladeIndex *ix, uint32_t d) {
+    uint32_t id = d + 1;
+    if (tree_node(dir_tree, id)) return id;
+    uint32_t e = ix->dirs[d].entry;
+    if (e == INDEX_NONE) {
+        tree_add(dir_tree, 0, id, TREE_NONE, ix->root, ix->hdr->root_len);
+    } else {
+        char name[INDEX_NAME_MAX + 1];
+        size_t n = index_entry_name(ix, e, name);
+        tree_add(dir_tree, 0, id, index_node(ix, ix->entries[e].parent), name, n);
+    }
+    return id;
+}
+
+int index_visit(void *user, const BladeIndex *ix, uint32_t entry, const char *name, size_t len) {
+    WorkerBatch *b = (WorkerBatch*)user;
+    if (!running) return 1;
+
+    if (query_match(&target_query, name, len)) {
+        batch_push(b, index_node(ix, ix->entries[entry].parent), name, len, ix->entries[entry].size);
+        if (b->count >= WORKER_BATCH_SIZE) flush_batch(b);
+    }
+    return 0;
+}
+
+// Opens (or builds) the on-disk index for the root, brings it up to date by re-reading
+// only directories whose mtime moved, then answers the query from the mapping.
+unsigned __stdcall index_thread(void *arg) {
+    const char *root = (const char*)arg;
+    char file[MAX_PATH_LEN];
+    BladeIndex ix;
+    index_default_path(root, file, sizeof(file));
+
+    int opened = index_open(&ix, file);
+    if (opened && _stricmp(ix.root, root) != 0) { index_close(&ix); opened = 0; }
+    if (opened) {
+        index_status = "Refreshing index...";
+        if (index_refresh(&ix, file, THREAD_COUNT) < 0) opened = 0;
+    }
+    if (!opened) {
+        index_status = "Building index...";
+        opened = index_build(root, file, THREAD_COUNT) && index_open(&ix, file);
+    }
+    index_status = opened ? "Searching index..." : "Index failed";
+
+    if (opened) {
+        WorkerBatch b;
+        memset(&b, 0, sizeof(b));
+        b.limit = WORKER_BATCH_SIZE;
+        index_foreach(&ix, index_visit, &b);
+        flush_batch(&b);
+        index_close(&ix);
+    }
+    finished_scanning = 1;
+    return 0;
+}
+
+// ==========================================
+// LIVE UPDATES (--watch, see blade_watch.h)
+// ==========================================
+// The root is watched from startup; once the scan or index lookup is done the
+// queued changes patch the results in place. Results are indexed by path hash:
+// a path that is gone marks its result dead (and, if it was a folder, every
+// result below it), a changed one takes its new size, and a new one that
+// matches the search term is appended like a scan result. Dead results keep
+// their slot and are skipped by every view. The on-disk index is not rewritten;
+// its next refresh re-reads the folders whose mtime moved.
+int watch_mode = 0;
+Watch *live_watch = NULL;
+WatchBatch live_batch;
+WatchSet live_set;
+WatchNodes live_nodes;      // path hashes of dir_tree nodes
+WatchMap live_results;      // path hash -> result
+WatchMap live_dirs;         // path hash -> dir_tree node
+long live_indexed = 0;      // results [0, live_indexed) are in live_results
+uint32_t live_dirs_indexed = 0;
+int live_stale = 0;         // changes were lost: only a new run is complete again
+WorkerBatch live_added;
+
+uint64_t live_result_hash(long i) {
+    const Result *r = result_at(i);
+    uint64_t dir = watch_node_hash(&live_nodes, dir_tree, r->dir);
+    return dir ? du_hash_child(dir, pool_str(r->name), r->name_len) : 0;
+}
+
+// Indexes the folders and results added since the last call
+void live_index() {
+    uint32_t max_id = __atomic_load_n(&dir_tree->max_id, __ATOMIC_ACQUIRE);
+    for (uint32_t id = live_dirs_indexed + 1; id <= max_id; id++) {
+        uint64_t h = tree_node(dir_tree, id) ? watch_node_hash(&live_nodes, dir_tree, id) : 0;
+        if (h) watch_map_put(&live_dirs, h, id);
+    }
+    live_dirs_indexed = max_id;
+
+    long count = result_snapshot();
+    for (; live_indexed < count; live_indexed++) {
+        uint64_t h = live_result_hash(live_indexed);
+        if (h && !result_dead(live_indexed)) watch_map_put(&live_results, h, (uint64_t)live_indexed);
+    }
+}
+
+// Node of folder path, registered (with any missing parents) if no scan result
+// named it yet. TREE_NONE outside the root.
+uint32_t live_dir(const char *path, size_t len) {
+    while (len > 0 && (path[len - 1] == '\\' || path[len - 1] == '/')) len--;
+    uint64_t h = du_hash(path, len);
+    WatchMapSlot *s = watch_map_find(&live_dirs, h);
+    if (s) return (uint32_t)s->value;
+
+    uint32_t parent = TREE_NONE;
+    size_t cut = len;
+    if (len > live_watch->root_len) {
+        while (cut > 0 && path[cut - 1] != '\\' && path[cut - 1] != '/') cut--;
+        parent = cut > 0 ? live_dir(path, cut) : TREE_NONE;
+        if (parent == TREE_NONE) return TREE_NONE;
+    } else if (du_hash(live_watch->root, live_watch->root_len) != h) return TREE_NONE;
+    else cut = 0;   // the root itself (an index lookup with no results registers none)
+
+    uint32_t id = __atomic_load_n(&dir_tree->max_id, __ATOMIC_RELAXED) + 1;
+    if (!tree_add(dir_tree, 0, id, parent, path + cut, len - cut)) return TREE_NONE;
+    watch_map_put(&live_dirs, h, id);
+    return id;
+}
+
+void live_kill(long i, uint64_t h) {
+    ResultSeg *seg = result_segs[i >> RESULT_SEG_BITS];
+    seg->dead[i & (RESULT_SEG_SIZE - 1)] = 1;
+    seg->sizes[i & (RESULT_SEG_SIZE - 1)] = 0;
+    result_dead_count++;
+    if (h) watch_map_remove(&live_results, h);
+}
+
+// Main loop, after the scan. Workers are done, so this thread is the only writer.
+void live_apply() {
+    if (!live_watch || !finished_scanning || live_stale) return;
+    if (!watch_take(live_watch, &live_batch)) return;
+    if (live_batch.overflow || !watch_set_build(&live_set, &live_batch)) { live_stale = 1; return; }
+    live_index();
+
+    long dead_before = result_dead_count;
+    int gone_dirs = 0;
+    for (uint32_t k = 0; k < live_set.cap; k++) {
+        const WatchSlot *s = &live_set.slots[k];
+        if (!s->hash) continue;
+        WatchMapSlot *r = watch_map_find(&live_results, s->hash);
+        if (s->state == WATCH_GONE) {
+            if (r) live_kill((long)r->value, s->hash);
+            if (watch_map_find(&live_dirs, s->hash)) gone_dirs = 1;
+            continue;
+        }
+        if (r) {
+            result_segs[r->value >> RESULT_SEG_BITS]->sizes[r->value & (RESULT_SEG_SIZE - 1)] = s->size;
+            continue;
+        }
+        size_t cut = s->len;
+        while (cut > 0 && s->path[cut - 1] != '\\' && s->path[cut - 1] != '/') cut--;
+        const char *name = s->path + cut;
+        size_t name_len = s->len - cut;
+        if (cut == 0 || !query_match(&target_query, name, name_len)) continue;
+        if (prune_path(&scan_prune, live_watch->root_len, s->path, s->len, s->state == WATCH_DIR)) continue;
+        uint32_t dir = live_dir(s->path, cut);
+        if (dir == TREE_NONE) continue;
+        batch_push(&live_added, dir, name, name_len, s->size);
+        if (live_added.count == WORKER_BATCH_SIZE) flush_batch(&live_added);
+    }
+    flush_batch(&live_added);
+
+    // Results below a folder that went away
+    if (gone_dirs) {
+        watch_nodes_batch(&live_nodes);
+        for (long i = 0; i < live_indexed; i++) {
+            if (!result_dead(i) && watch_node_gone(&live_nodes, dir_tree, &live_set, result_at(i)->dir)) live_kill(i, live_result_hash(i));
+        }
+    }
+    live_index();
+
+    // Cached filter levels still hold the dead results
+    if (result_dead_count != dead_before) filter_depth = 0;
+    if (view_filtered()) update_filter(0);
+}
+
+// ==========================================
+// DU MODE
+// ==========================================
+// Folders down to du_depth below the root, largest first, sized by one
+// parallel bottom-up pass (blade_du.h)
+typedef struct {
+    uint64_t bytes;
+    uint64_t files;
+    uint32_t id;
+    uint32_t depth;
+} DuRow;
+
+DuRow *du_rows = NULL;
+long du_row_count = 0;
+long du_row_cap = 0;
+uint32_t du_depth = 1;
+CRITICAL_SECTION du_lock;
+
+void du_collect(DuRun *run, const DuNode *n) {
+    if (n->depth == 0 || n->depth > du_depth) return;
+    EnterCriticalSection(&du_lock);
+    if (du_row_count == du_row_cap) {
+        long cap = du_row_cap ? du_row_cap * 2 : 1024;
+        DuRow *grown = (DuRow*)realloc(du_rows, cap * sizeof(DuRow));
+        if (grown) { du_rows = grown; du_row_cap = cap; }
+    }
+    if (du_row_count < du_row_cap) {
+        DuRow *r = &du_rows[du_row_count++];
+        r->bytes = n->bytes;
+        r->files = n->files;
+        r->id = n->id;
+        r->depth = n->depth;
+    }
+    LeaveCriticalSection(&du_lock);
+}
+
+int du_row_cmp(const void *pa, const void *pb) {
+    const DuRow *a = (const DuRow*)pa, *b = (const DuRow*)pb;
+    if (a->bytes != b->bytes) return a->bytes < b->bytes ? 1 : -1;
+    return a->id < b->id ? -1 : (a->id > b->id);
+}
+
+int run_du(const char *root) {
+    LARGE_INTEGER freq, t0, t1;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&t0);
+    InitializeCriticalSection(&du_lock);
+    DuRun *run = du_start(root, 0, THREAD_COUNT, &scan_prune, du_collect, NULL);
+    if (!run) return 1;
+    while (!du_finished(run)) {
+        if (!running) du_cancel(run);
+        Sleep(10);
+    }
+    QueryPerformanceCounter(&t1);
+    if (!running) { du_free(run); return 1; }
+
+    qsort(du_rows, du_row_count, sizeof(DuRow), du_row_cmp);
+    char size[32], path[MAX_PATH_LEN];
+    for (long i = 0; i < du_row_count; i++) {
+        if (!tree_path(run->tree, du_rows[i].id, path, sizeof(path))) continue;
+        format_size_fast(du_rows[i].bytes, size);
+        printf("%12s %10llu  %s\n", size, (unsigned long long)du_rows[i].files, path);
+    }
+    format_size_fast(run->root.bytes, size);
+    printf("%12s %10llu  %s  (%llu folders, %.3f s)\n", size, (unsigned long long)run->root.files, root,
+           (unsigned long long)run->root.dirs, (double)(t1.QuadPart - t0.QuadPart) / (double)freq.QuadPart);
+    du_free(run);
+    free(du_rows);
     return 0;
 }
 
@@ -511,19 +1288,19 @@ void render_ui() {
     }
 
     char header[512];
-    long display_total = is_filtering ? filtered_count : result_count;
+    // One snapshot per frame; workers keep appending past it without waiting for us
+    long count = view_filtered() ? filtered_count : result_snapshot();
+    long display_total = count;
     unsigned long long selected_bytes = 0;
     int have_selected_size = 0;
     
-    EnterCriticalSection(&result_lock);
-    long count = is_filtering ? filtered_count : result_count;
-    unsigned long long total_view_bytes = calculate_total_size_avx2(file_sizes, is_filtering ? filtered_indices : NULL, count);
+    unsigned long long total_view_bytes = results_total_size(view_filtered() ? filtered_indices : NULL, count);
     
     if (count > 0 && selected_index >= 0 && selected_index < count) {
-        long real_index_hdr = is_filtering ? filtered_indices[selected_index] : selected_index;
-        if (file_sizes) { selected_bytes = file_sizes[real_index_hdr]; have_selected_size = 1; }
+        long real_index_hdr = view_filtered() ? filtered_indices[selected_index] : selected_index;
+        selected_bytes = result_size(real_index_hdr);
+        have_selected_size = 1;
     }
-    LeaveCriticalSection(&result_lock);
 
     char sel_size_str[32] = "-";
     if (have_selected_size) format_size_fast(selected_bytes, sel_size_str);
@@ -533,7 +1310,7 @@ void render_ui() {
 
     snprintf(header, 512, " blade %s :: Found: %ld (%s) :: Sel: %s :: %s", 
              VERSION, display_total, total_size_str, sel_size_str,
-             finished_scanning ? "Ready" : "Scanning...");
+             !finished_scanning ? index_status : live_stale ? "Changes lost, run again" : live_watch ? "Watching" : "Ready");
     
     for (int i = 0; i < strlen(header) && i < console_width; i++) {
         buffer[i].Char.AsciiChar = header[i];
@@ -560,9 +1337,6 @@ void render_ui() {
         list_height--; 
     }
 
-    EnterCriticalSection(&result_lock);
-    count = is_filtering ? filtered_count : result_count;
-    
     if (selected_index < scroll_offset) scroll_offset = selected_index;
     if (selected_index >= scroll_offset + (list_height)) scroll_offset = selected_index - (list_height - 1);
     if (scroll_offset < 0) scroll_offset = 0;
@@ -573,17 +1347,15 @@ void render_ui() {
         WORD attr = FOREGROUND_GREEN | FOREGROUND_INTENSITY;
         if (is_selected) attr = BACKGROUND_GREEN | FOREGROUND_BLACK;
 
-        long real_index = is_filtering ? filtered_indices[i] : i;
-        char *text = results[real_index].path;
-
-        int len = strlen(text);
+        long real_index = view_filtered() ? filtered_indices[i] : i;
+        char text[MAX_PATH_LEN];
+        int len = (int)result_path(real_index, text, sizeof(text));
         for (int x = 0; x < len && x < console_width; x++) {
             buffer[y * console_width + x].Char.AsciiChar = text[x];
             buffer[y * console_width + x].Attributes = attr;
         }
         y++;
     }
-    LeaveCriticalSection(&result_lock);
 
     COORD bufferSize = { (SHORT)console_width, (SHORT)console_height };
     COORD bufferCoord = { 0, 0 };
@@ -592,15 +1364,17 @@ void render_ui() {
 }
 
 void open_selection() {
-    long count = is_filtering ? filtered_count : result_count;
-    if (count == 0) return;
+    long count = view_filtered() ? filtered_count : result_snapshot();
+    if (count == 0 || selected_index < 0 || selected_index >= count) return;
     
-    long real_index = is_filtering ? filtered_indices[selected_index] : selected_index;
+    long real_index = view_filtered() ? filtered_indices[selected_index] : selected_index;
     
+    char path[MAX_PATH_LEN];
     char absolute_path[MAX_PATH_LEN];
     char *file_part;
     
-    GetFullPathNameA(results[real_index].path, MAX_PATH_LEN, absolute_path, &file_part);
+    result_path(real_index, path, sizeof(path));
+    GetFullPathNameA(path, MAX_PATH_LEN, absolute_path, &file_part);
     for (int i = 0; absolute_path[i]; i++) {
         if (absolute_path[i] == '/') absolute_path[i] = '\\';
     }
@@ -613,29 +1387,71 @@ void open_selection() {
 // MAIN
 // ==========================================
 int main(int argc, char **argv) {
-    if (argc < 3) {
+    match_init();
+    if (argc == 3 && strcmp(argv[1], "--bench") == 0) return run_benchmark(argv[2]);
+    if (argc == 2 && strcmp(argv[1], "--selfcheck") == 0) {
+        printf("blade %s: CPU level %s, using %s\n", VERSION, match_level_names[match_cpu], match_level_names[match_active]);
+        return match_selfcheck(200000, stdout) ? 1 : 0;
+    }
+    int argi = 1;
+    int prune_ok = 1;
+    int du_mode = 0;
+    prune_init(&scan_prune);
+    for (; argi < argc; argi++) {
+        if (strcmp(argv[argi], "--index") == 0) use_index = 1;
+        else if (strcmp(argv[argi], "--print0") == 0) stream_mode = STREAM_PRINT0;
+        else if (strcmp(argv[argi], "--ndjson") == 0) stream_mode = STREAM_NDJSON;
+        else if (strcmp(argv[argi], "--ordered") == 0) stream_ordered = 1;
+        else if (strcmp(argv[argi], "--du") == 0) du_mode = 1;
+        else if (strcmp(argv[argi], "--watch") == 0) watch_mode = 1;
+        else if (strcmp(argv[argi], "--ignore-files") == 0) scan_prune.ignore_files = 1;
+        else if (strcmp(argv[argi], "--same-fs") == 0) scan_prune.same_fs = 1;
+        else if (strcmp(argv[argi], "--exclude") == 0 && argi + 1 < argc) prune_ok &= prune_add_exclude_list(&scan_prune, argv[++argi]);
+        else if (strcmp(argv[argi], "--maxdepth") == 0 && argi + 1 < argc) scan_prune.max_depth = (uint32_t)strtoul(argv[++argi], NULL, 10);
+        else break;
+    }
+    // exclude: and maxdepth: in the search term prune the scan instead of matching names
+    char term[1024] = {0};
+    if (argc - argi >= 2 && !du_mode) prune_ok &= prune_parse_query(&scan_prune, argv[argi + 1], term, sizeof(term));
+    // In du mode maxdepth limits the folders listed, not the folders summed
+    if (du_mode) { if (scan_prune.max_depth) du_depth = scan_prune.max_depth; scan_prune.max_depth = 0; }
+    if (argc - argi < (du_mode ? 1 : 2) || (stream_ordered && !stream_mode) || (stream_mode && use_index) ||
+        (use_index && prune_active(&scan_prune)) || (du_mode && (use_index || stream_mode)) || (watch_mode && (stream_mode || du_mode))) {
         printf("version %s (%s)\n", VERSION, COMMIT_SHA);
-        printf("Usage: blade.exe <directory> <search_term>\n");
+        printf("Usage: blade.exe [--index] [--watch] <directory> <search_term>\n");
+        printf("       blade.exe --print0|--ndjson [--ordered] <directory> <search_term>\n");
+        printf("       blade.exe --du [--maxdepth <n>] <directory>\n");
+        printf("       blade.exe --bench <directory>\n");
+        printf("       blade.exe --selfcheck\n");
+        printf("Pruning (live scans): --exclude <glob;glob> --ignore-files --same-fs --maxdepth <n>\n");
+        return 1;
+    }
+    if (!prune_ok) {
+        printf("Too many or too long exclude globs\n");
         return 1;
     }
 
     SetConsoleCtrlHandler(CtrlHandler, TRUE);
 
-    strcpy(TARGET_RAW, argv[2]);
-    TARGET_LEN = strlen(TARGET_RAW);
-    if (strchr(TARGET_RAW, '*') || strchr(TARGET_RAW, '?')) IS_WILDCARD = 1;
-    for(int i=0; i<TARGET_LEN; i++) TARGET_LOWER[i] = tolower(TARGET_RAW[i]);
-    TARGET_LOWER[TARGET_LEN] = 0;
+    if (!du_mode && !query_compile(&target_query, term)) {
+        printf("Search term has too many terms\n");
+        return 1;
+    }
+
+    char start_dir[MAX_PATH_LEN];
+    char *file_part;
+    DWORD result_len = GetFullPathNameA(argv[argi], MAX_PATH_LEN, start_dir, &file_part);
+    if (result_len == 0) strcpy(start_dir, argv[argi]);
+    else {
+        size_t len = strlen(start_dir);
+        if (len > 3 && start_dir[len - 1] == '\\') start_dir[len - 1] = '\0';
+    }
 
-    results = (Result*)malloc(INITIAL_RESULT_CAPACITY * sizeof(Result));
-    file_sizes = (uint64_t*)_aligned_malloc(INITIAL_RESULT_CAPACITY * sizeof(uint64_t), 32);
-    result_capacity = INITIAL_RESULT_CAPACITY;
-    filtered_indices = (long*)malloc(INITIAL_RESULT_CAPACITY * sizeof(long));
-    filtered_capacity = INITIAL_RESULT_CAPACITY;
+    if (stream_mode) return run_stream(start_dir);
+    if (du_mode) return run_du(start_dir);
 
-    InitializeCriticalSection(&queue_lock);
-    InitializeCriticalSection(&result_lock);
-    InitializeConditionVariable(&queue_cond); 
+    dir_tree = tree_create();
+    if (!dir_tree) return 1;
 
     hConsoleOut = GetStdHandle(STD_OUTPUT_HANDLE);
     hConsoleIn = GetStdHandle(STD_INPUT_HANDLE);
@@ -650,20 +1466,24 @@ int main(int argc, char **argv) {
     console_width = csbi.srWindow.Right - csbi.srWindow.Left + 1;
     console_height = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
 
-    char start_dir[MAX_PATH_LEN];
-    char *file_part;
-    DWORD result_len = GetFullPathNameA(argv[1], MAX_PATH_LEN, start_dir, &file_part);
-    if (result_len == 0) strcpy(start_dir, argv[1]);
-    else {
-        size_t len = strlen(start_dir);
-        if (len > 3 && start_dir[len - 1] == '\\') start_dir[len - 1] = '\0';
-    }
+    // Watching starts before the scan so nothing that changes during it is missed
+    if (watch_mode) live_watch = watch_start(start_dir, 1);
 
-    push_job(start_dir);
-
-    HANDLE threads[THREAD_COUNT];
-    for (int i = 0; i < THREAD_COUNT; i++) {
-        threads[i] = (HANDLE)_beginthreadex(NULL, 0, worker_thread, NULL, 0, NULL);
+    if (use_index) {
+        HANDLE h = (HANDLE)_beginthreadex(NULL, 0, index_thread, start_dir, 0, NULL);
+        if (h) CloseHandle(h);
+        else finished_scanning = 1;
+    } else {
+        scan_ctx = scan_create(THREAD_COUNT, NULL);
+        if (!scan_ctx || !scan_set_prune(scan_ctx, &scan_prune)) return 1;
+        scan_ctx->on_start = worker_start;
+        scan_ctx->on_dir = worker_dir;
+        scan_ctx->on_entry = worker_entry;
+        scan_ctx->on_idle = worker_idle;
+        scan_ctx->on_stop = worker_stop;
+        scan_ctx->on_finish = scan_complete;
+        scan_add_root(scan_ctx, start_dir);
+        scan_start(scan_ctx);
     }
 
     INPUT_RECORD ir[128];
@@ -671,6 +1491,7 @@ int main(int argc, char **argv) {
 
     while (running) {
         if (is_filtering && !finished_scanning) update_filter(0);
+        live_apply();
 
         DWORD events = 0;
         GetNumberOfConsoleInputEvents(hConsoleIn, &events);
@@ -685,7 +1506,7 @@ int main(int argc, char **argv) {
 
                     if (vk == 'F' && (ctrl & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED))) {
                         is_filtering = !is_filtering;
-                        if (is_filtering) update_filter(1);
+                        if (view_filtered()) update_filter(1);
                         continue;
                     }
                     if (vk == VK_ESCAPE) {
@@ -703,7 +1524,7 @@ int main(int argc, char **argv) {
                         continue;
                     }
 
-                    long max_items = is_filtering ? filtered_count : result_count;
+                    long max_items = view_filtered() ? filtered_count : result_snapshot();
                     
                     if (vk == VK_UP && selected_index > 0) { selected_index--; continue; }
                     if (vk == VK_DOWN && selected_index < max_items - 1) { selected_index++; continue; }
@@ -728,6 +1549,8 @@ int main(int argc, char **argv) {
         render_ui();
         Sleep(16); 
     }
+    if (scan_ctx) scan_cancel(scan_ctx);
+    watch_stop(live_watch);
 
     cursorInfo.bVisible = TRUE;
     SetConsoleCursorInfo(hConsoleOut, &cursorInfo);
@@ -0,0 +1,636 @@
+// blade_watch.h - Live change notifications for a folder
+//
+// A Watch runs one thread that turns the platform's notifications into a queue
+// of changed paths: ReadDirectoryChangesW on Windows (one handle covers the
+// whole subtree), inotify elsewhere (one watch per directory, added as
+// directories appear). The owner drains the queue with watch_take whenever it
+// likes, typically from its UI timer, so nothing is patched from this thread.
+//
+// Events only name a path. What happened to it is read back from the disk
+// when a batch is applied (WatchSet), so a burst of creates, writes and
+// renames on one path costs a single stat, and a rename is just its old path
+// gone and its new path present. A directory that appears under a recursive
+// watch is walked and its contents queued too, because a folder moved in from
+// elsewhere is reported as one event. When the queue (here or in the kernel)
+// overflows the batch says so and the owner rescans.
+//
+// WatchSet keys a batch by path hash (du_hash, blade_du.h) and WatchNodes
+// memoizes the hash of every DirTree node, so an owner finds the entries a
+// batch touched with one hash per entry and no path rebuilt. WatchMap is a
+// plain hash -> value table for owners that keep their entries indexed.
+
+#ifndef BLADE_WATCH_H
+#define BLADE_WATCH_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "blade_scan.h"
+#include "blade_tree.h"
+#include "blade_du.h"
+
+#ifndef _WIN32
+#include <poll.h>
+#include <errno.h>
+#include <sys/inotify.h>
+#endif
+
+// ==========================================
+// CONFIGURATION
+// ==========================================
+#define WATCH_MAX_EVENTS 65536      // queued paths before the batch overflows
+#define WATCH_BUFFER (64 * 1024)    // notification buffer
+#define WATCH_WALK_DEPTH 256        // new folders are walked this deep
+
+#define WATCH_GONE 0
+#define WATCH_FILE 1
+#define WATCH_DIR  2
+
+#ifdef _WIN32
+#define WATCH_FILTER (FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE)
+#else
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+#endif
+
+// ==========================================
+// DATA STRUCTURES
+// ==========================================
+// Changed paths, NUL-terminated back to back in text
+typedef struct WatchBatch {
+    uint32_t *paths;        // offsets into text
+    long count;
+    long cap;
+    char *text;
+    size_t used;
+    size_t text_cap;
+    int overflow;           // paths were lost: the owner has to rescan
+} WatchBatch;
+
+typedef struct Watch {
+    char root[SCAN_PATH_MAX];
+    size_t root_len;
+    int recursive;
+    scan_lock_t lock;
+    WatchBatch pending;     // under lock
+    volatile int stop;
+#ifdef _WIN32
+    HANDLE dir;
+    HANDLE thread;
+    HANDLE io_event;
+    HANDLE stop_event;
+    DWORD buf[WATCH_BUFFER / sizeof(DWORD)];
+#else
+    pthread_t thread;
+    int fd;
+    int wake[2];            // written by watch_stop to end the poll
+    char **dirs;            // path of each inotify watch descriptor
+    int dir_cap;
+    uint8_t buf[WATCH_BUFFER] __attribute__((aligned(8)));
+#endif
+} Watch;
+
+// One distinct path of a batch and what the disk says about it now
+typedef struct WatchSlot {
+    uint64_t hash;          // du_hash of the path, 0 for an empty slot
+    const char *path;       // inside the batch it was built from
+    uint32_t len;
+    uint8_t state;          // WATCH_GONE / WATCH_FILE / WATCH_DIR
+    uint8_t seen;           // for the owner: the path matched one of its entries
+    uint64_t size;
+    uint64_t mtime;         // FILETIME ticks like FsEntry
+} WatchSlot;
+
+typedef struct WatchSet {
+    WatchSlot *slots;
+    uint32_t cap;           // power of two
+    uint32_t count;
+    uint32_t gone;          // slots whose path no longer exists
+} WatchSet;
+
+// Per DirTree node: its path hash, and whether it lies below a path the
+// current batch found gone (valid while stamp matches)
+typedef struct WatchNodes {
+    uint64_t *hash;
+    uint32_t *stamp;        // batch stamp << 1 | gone
+    uint32_t cap;
+    uint32_t batch;
+} WatchNodes;
+
+typedef struct WatchMapSlot {
+    uint64_t hash;          // 0 empty, 1 deleted
+    uint64_t value;
+} WatchMapSlot;
+
+typedef struct WatchMap {
+    WatchMapSlot *slots;
+    uint32_t cap;
+    uint32_t used;          // live + deleted
+} WatchMap;
+
+// ==========================================
+// QUEUE
+// ==========================================
+static inline void watch_batch_free(WatchBatch *b) {
+    free(b->paths);
+    free(b->text);
+    memset(b, 0, sizeof(*b));
+}
+
+// Caller holds w->lock. A repeat of the last path is dropped, which folds the
+// stream of writes to a growing log file into one entry.
+static inline void watch_push(Watch *w, const char *path, size_t len) {
+    WatchBatch *b = &w->pending;
+    if (b->overflow) return;
+    if (b->count > 0) {
+        const char *last = b->text + b->paths[b->count - 1];
+        if (strlen(last) == len && memcmp(last, path, len) == 0) return;
+    }
+    if (b->count == WATCH_MAX_EVENTS) { b->overflow = 1; return; }
+    if (b->count == b->cap) {
+        long cap = b->cap ? b->cap * 2 : 256;
+        uint32_t *p = (uint32_t*)realloc(b->paths, cap * sizeof(uint32_t));
+        if (!p) { b->overflow = 1; return; }
+        b->paths = p;
+        b->cap = cap;
+    }
+    if (b->used + len + 1 > b->text_cap) {
+        size_t cap = b->text_cap ? b->text_cap * 2 : 16384;
+        while (cap < b->used + len + 1) cap *= 2;
+        char *t = (char*)realloc(b->text, cap);
+        if (!t) { b->overflow = 1; return; }
+        b->text = t;
+        b->text_cap = cap;
+    }
+    memcpy(b->text + b->used, path, len);
+    b->text[b->used + len] = '\0';
+    b->paths[b->count++] = (uint32_t)b->used;
+    b->used += len + 1;
+}
+
+static inline void watch_queue(Watch *w, const char *path, size_t len) {
+    scan_lock(&w->lock);
+    watch_push(w, path, len);
+    scan_unlock(&w->lock);
+}
+
+static inline void watch_queue_overflow(Watch *w) {
+    scan_lock(&w->lock);
+    w->pending.overflow = 1;
+    scan_unlock(&w->lock);
+}
+
+// Hands the queued paths to the owner in out, whose previous contents are
+// dropped (its buffers are reused). Returns nonzero if there is anything to apply.
+static inline int watch_take(Watch *w, WatchBatch *out) {
+    out->count = 0;
+    out->used = 0;
+    out->overflow = 0;
+    scan_lock(&w->lock);
+    WatchBatch t = w->pending;
+    w->pending = *out;
+    *out = t;
+    scan_unlock(&w->lock);
+    return out->count > 0 || out->overflow;
+}
+
+// ==========================================
+// PLATFORM
+// ==========================================
+// Joins dir and name into out. Returns the length, 0 if it does not fit.
+static inline size_t watch_join(char *out, size_t cap, const char *dir, size_t dir_len, const char *name, size_t name_len) {
+    int sep = dir_len > 0 && dir[dir_len - 1] != '\\' && dir[dir_len - 1] != '/';
+    if (dir_len + sep + name_len + 1 > cap) return 0;
+    memcpy(out, dir, dir_len);
+    if (sep) out[dir_len] = SCAN_SEP;
+    memcpy(out + dir_len + sep, name, name_len);
+    out[dir_len + sep + name_len] = '\0';
+    return dir_len + sep + name_len;
+}
+
+// What is at path now. Links are reported as files, as the scan never descends them.
+static inline int watch_stat(const char *path, uint64_t *size, uint64_t *mtime) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA fa;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &fa)) return WATCH_GONE;
+    *size = ((uint64_t)fa.nFileSizeHigh << 32) | fa.nFileSizeLow;
+    *mtime = ((uint64_t)fa.ftLastWriteTime.dwHighDateTime << 32) | fa.ftLastWriteTime.dwLowDateTime;
+    return (fa.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && !(fa.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) ? WATCH_DIR : WATCH_FILE;
+#else
+    struct stat st;
+    if (lstat(path, &st) != 0) return WATCH_GONE;
+    *size = (uint64_t)st.st_size;
+    *mtime = fs_posix_mtime(&st);
+    return S_ISDIR(st.st_mode) ? WATCH_DIR : WATCH_FILE;
+#endif
+}
+
+#ifndef _WIN32
+static inline void watch_add_dir(Watch *w, const char *path) {
+    int wd = inotify_add_watch(w->fd, path, WATCH_MASK | IN_ONLYDIR | IN_DONT_FOLLOW);
+    if (wd < 0) {
+        // Out of watches (fs.inotify.max_user_watches): changes there would go unseen
+        if (errno == ENOSPC) watch_queue_overflow(w);
+        return;
+    }
+    if (wd >= w->dir_cap) {
+        int cap = w->dir_cap ? w->dir_cap : 1024;
+        while (cap <= wd) cap *= 2;
+        char **d = (char**)realloc(w->dirs, cap * sizeof(char*));
+        if (!d) return;
+        memset(d + w->dir_cap, 0, (cap - w->dir_cap) * sizeof(char*));
+        w->dirs = d;
+        w->dir_cap = cap;
+    }
+    free(w->dirs[wd]);      // the same directory reached again under a new path
+    w->dirs[wd] = strdup(path);
+}
+
+// A directory moved or deleted: the watches below it would report stale paths
+static inline void watch_drop_dirs(Watch *w, const char *path, size_t len) {
+    for (int wd = 0; wd < w->dir_cap; wd++) {
+        const char *d = w->dirs[wd];
+        if (!d || strncmp(d, path, len) != 0 || (d[len] != '\0' && d[len] != '/')) continue;
+        inotify_rm_watch(w->fd, wd);
+        free(w->dirs[wd]);
+        w->dirs[wd] = NULL;
+    }
+}
+#endif
+
+// Queues everything below path (when report) and, with inotify, watches every folder
+static inline void watch_walk(Watch *w, const char *path, size_t len, int depth, int report) {
+#ifndef _WIN32
+    watch_add_dir(w, path);
+#endif
+    if (depth >= WATCH_WALK_DEPTH || w->stop) return;
+    FsDir *d = fs_dir_alloc(NULL);
+    if (!d) return;
+    const char *leaf = path + len;
+    while (leaf > path && leaf[-1] != '\\' && leaf[-1] != '/') leaf--;
+    if (fs_open(d, FS_NO_FD, path, leaf)) {
+        int n;
+        while ((n = fs_read(d)) > 0 && !w->stop) {
+            for (int i = 0; i < n; i++) {
+                FsEntry *e = &d->batch[i];
+                char full[SCAN_PATH_MAX];
+                size_t flen = watch_join(full, sizeof(full), path, len, e->name, e->name_len);
+                if (!flen) continue;
+                if (report) watch_queue(w, full, flen);
+                if (e->type == FS_TYPE_UNKNOWN) fs_stat(d, e);
+                if (e->type == FS_TYPE_DIR && !(e->flags & FS_REPARSE)) watch_walk(w, full, flen, depth + 1, report);
+            }
+        }
+        fs_close(d, 0);
+    }
+    fs_dir_free(d);
+}
+
+#ifdef _WIN32
+static inline unsigned __stdcall watch_thread(void *arg) {
+    Watch *w = (Watch*)arg;
+    OVERLAPPED ov;
+    HANDLE waits[2] = { w->io_event, w->stop_event };
+    char rel[SCAN_PATH_MAX], full[SCAN_PATH_MAX];
+
+    while (!w->stop) {
+        memset(&ov, 0, sizeof(ov));
+        ov.hEvent = w->io_event;
+        if (!ReadDirectoryChangesW(w->dir, w->buf, sizeof(w->buf), w->recursive, WATCH_FILTER, NULL, &ov, NULL)) {
+            watch_queue_overflow(w);
+            break;
+        }
+        DWORD got = 0;
+        if (WaitForMultipleObjects(2, waits, FALSE, INFINITE) != WAIT_OBJECT_0) {
+            CancelIoEx(w->dir, &ov);
+            GetOverlappedResult(w->dir, &ov, &got, TRUE);
+            break;
+        }
+        if (!GetOverlappedResult(w->dir, &ov, &got, FALSE)) {
+            watch_queue_overflow(w);
+            if (GetLastError() == ERROR_NOTIFY_ENUM_DIR) continue;
+            break;          // the folder itself went away
+        }
+        if (got == 0) { watch_queue_overflow(w); continue; }   // the kernel's buffer overflowed
+
+        const uint8_t *p = (const uint8_t*)w->buf;
+        for (;;) {
+            const FILE_NOTIFY_INFORMATION *fi = (const FILE_NOTIFY_INFORMATION*)p;
+            int n = WideCharToMultiByte(CP_ACP, 0, fi->FileName, (int)(fi->FileNameLength / sizeof(WCHAR)), rel, sizeof(rel) - 1, NULL, NULL);
+            size_t len = n > 0 ? watch_join(full, sizeof(full), w->root, w->root_len, rel, (size_t)n) : 0;
+            if (len) {
+                watch_queue(w, full, len);
+                if (w->recursive && (fi->Action == FILE_ACTION_ADDED || fi->Action == FILE_ACTION_RENAMED_NEW_NAME)) {
+                    DWORD attr = GetFileAttributesA(full);
+                    if (attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY) && !(attr & FILE_ATTRIBUTE_REPARSE_POINT)) watch_walk(w, full, len, 0, 1);
+                }
+            }
+            if (!fi->NextEntryOffset) break;
+            p += fi->NextEntryOffset;
+        }
+    }
+    return 0;
+}
+#else
+static inline void *watch_thread(void *arg) {
+    Watch *w = (Watch*)arg;
+    char full[SCAN_PATH_MAX];
+
+    // Registering the tree is a walk of its own, so it is done here rather than in watch_start
+    if (w->recursive) watch_walk(w, w->root, w->root_len, 0, 0);
+    else watch_add_dir(w, w->root);
+
+    struct pollfd fds[2] = { { w->fd, POLLIN, 0 }, { w->wake[0], POLLIN, 0 } };
+    while (!w->stop) {
+        if (poll(fds, 2, -1) < 0) { if (errno == EINTR) continue; break; }
+        if (fds[1].revents) break;
+        ssize_t got = read(w->fd, w->buf, sizeof(w->buf));
+        if (got <= 0) { if (got < 0 && (errno == EINTR || errno == EAGAIN)) continue; break; }
+
+        for (ssize_t off = 0; off < got; ) {
+            const struct inotify_event *ev = (const struct inotify_event*)(w->buf + off);
+            off += sizeof(struct inotify_event) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) { watch_queue_overflow(w); continue; }
+            if (ev->wd < 0 || ev->wd >= w->dir_cap || !w->dirs[ev->wd]) continue;
+            const char *dir = w->dirs[ev->wd];
+            if (ev->mask & IN_IGNORED) { free(w->dirs[ev->wd]); w->dirs[ev->wd] = NULL; continue; }
+            if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                if (strcmp(dir, w->root) == 0) watch_queue_overflow(w);
+                continue;   // the parent reports the path itself
+            }
+            size_t len = watch_join(full, sizeof(full), dir, strlen(dir), ev->name, strlen(ev->name));
+            if (!len) continue;
+            watch_queue(w, full, len);
+            if (!(ev->mask & IN_ISDIR) || !w->recursive) continue;
+            if (ev->mask & (IN_CREATE | IN_MOVED_TO)) watch_walk(w, full, len, 0, 1);
+            else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) watch_drop_dirs(w, full, len);
+        }
+    }
+    return NULL;
+}
+#endif
+
+// ==========================================
+// API
+// ==========================================
+// Starts watching root (and everything below it when recursive). NULL on failure.
+static inline Watch *watch_start(const char *root, int recursive) {
+    size_t len = strlen(root);
+    if (len == 0 || len >= SCAN_PATH_MAX) return NULL;
+    Watch *w = (Watch*)calloc(1, sizeof(Watch));
+    if (!w) return NULL;
+    memcpy(w->root, root, len + 1);
+    while (len > 1 && (w->root[len - 1] == '\\' || w->root[len - 1] == '/') && w->root[len - 2] != ':') w->root[--len] = '\0';
+    w->root_len = len;
+    w->recursive = recursive;
+    scan_lock_init(&w->lock);
+#ifdef _WIN32
+    w->dir = CreateFileA(w->root, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                         OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    w->io_event = CreateEventA(NULL, TRUE, FALSE, NULL);
+    w->stop_event = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (w->dir != INVALID_HANDLE_VALUE && w->io_event && w->stop_event) {
+        w->thread = (HANDLE)_beginthreadex(NULL, 0, watch_thread, w, 0, NULL);
+        if (w->thread) return w;
+    }
+    if (w->dir != INVALID_HANDLE_VALUE) CloseHandle(w->dir);
+    if (w->io_event) CloseHandle(w->io_event);
+    if (w->stop_event) CloseHandle(w->stop_event);
+#else
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->fd >= 0 && pipe(w->wake) == 0) {
+        if (pthread_create(&w->thread, NULL, watch_thread, w) == 0) return w;
+        close(w->wake[0]);
+        close(w->wake[1]);
+    }
+    if (w->fd >= 0) close(w->fd);
+#endif
+    scan_lock_free(&w->lock);
+    free(w);
+    return NULL;
+}
+
+// Stops the thread and frees the watch (NULL is fine)
+static inline void watch_stop(Watch *w) {
+    if (!w) return;
+    w->stop = 1;
+#ifdef _WIN32
+    SetEvent(w->stop_event);
+    WaitForSingleObject(w->thread, INFINITE);
+    CloseHandle(w->thread);
+    CloseHandle(w->dir);
+    CloseHandle(w->io_event);
+    CloseHandle(w->stop_event);
+#else
+    if (write(w->wake[1], "x", 1) < 0) {}
+    pthread_join(w->thread, NULL);
+    close(w->wake[0]);
+    close(w->wake[1]);
+    close(w->fd);
+    for (int i = 0; i < w->dir_cap; i++) free(w->dirs[i]);
+    free(w->dirs);
+#endif
+    watch_batch_free(&w->pending);
+    scan_lock_free(&w->lock);
+    free(w);
+}
+
+// ==========================================
+// APPLYING A BATCH
+// ==========================================
+static inline void watch_set_free(WatchSet *s) {
+    free(s->slots);
+    memset(s, 0, sizeof(*s));
+}
+
+// Distinct paths of b with their current state. The slots point into b.
+static inline int watch_set_build(WatchSet *s, const WatchBatch *b) {
+    uint32_t cap = 64;
+    while (cap < (uint32_t)b->count * 2) cap *= 2;
+    if (cap > s->cap) {
+        WatchSlot *slots = (WatchSlot*)malloc(cap * sizeof(WatchSlot));
+        if (!slots) return 0;
+        free(s->slots);
+        s->slots = slots;
+        s->cap = cap;
+    }
+    memset(s->slots, 0, s->cap * sizeof(WatchSlot));
+    s->count = 0;
+    s->gone = 0;
+    for (long i = 0; i < b->count; i++) {
+        const char *path = b->text + b->paths[i];
+        size_t len = strlen(path);
+        uint64_t h = du_hash(path, len);
+        uint32_t k = (uint32_t)h & (s->cap - 1);
+        while (s->slots[k].hash && s->slots[k].hash != h) k = (k + 1) & (s->cap - 1);
+        WatchSlot *slot = &s->slots[k];
+        if (slot->hash) continue;
+        slot->hash = h;
+        slot->path = path;
+        slot->len = (uint32_t)len;
+        slot->state = (uint8_t)watch_stat(path, &slot->size, &slot->mtime);
+        if (slot->state == WATCH_GONE) s->gone++;
+        s->count++;
+    }
+    return 1;
+}
+
+static inline WatchSlot *watch_set_find(WatchSet *s, uint64_t h) {
+    if (!s->count) return NULL;
+    uint32_t k = (uint32_t)h & (s->cap - 1);
+    while (s->slots[k].hash) {
+        if (s->slots[k].hash == h) return &s->slots[k];
+        k = (k + 1) & (s->cap - 1);
+    }
+    return NULL;
+}
+
+static inline int watch_set_is_gone(WatchSet *s, uint64_t h) {
+    const WatchSlot *slot = watch_set_find(s, h);
+    return slot && slot->state == WATCH_GONE;
+}
+
+// Nonzero if a folder above path (a full path) is gone in s
+static inline int watch_path_gone(WatchSet *s, const char *path, size_t len) {
+    uint64_t h = DU_HASH_SEED;
+    for (size_t i = 0; i < len; i++) {
+        int sep = path[i] == '\\' || path[i] == '/';
+        if (sep && i > 0 && (path[i - 1] == '\\' || path[i - 1] == '/')) continue;
+        if (sep && i > 0 && watch_set_is_gone(s, h ? h : 1)) return 1;
+        h = du_hash_add(h, path + i, 1);
+    }
+    return 0;
+}
+
+static inline void watch_nodes_free(WatchNodes *n) {
+    free(n->hash);
+    free(n->stamp);
+    memset(n, 0, sizeof(*n));
+}
+
+// Forgets every memo; call when the tree the node ids refer to is replaced
+static inline void watch_nodes_reset(WatchNodes *n) {
+    if (n->hash) memset(n->hash, 0, n->cap * sizeof(uint64_t));
+    if (n->stamp) memset(n->stamp, 0, n->cap * sizeof(uint32_t));
+    n->batch = 0;
+}
+
+static inline int watch_nodes_reserve(WatchNodes *n, uint32_t id) {
+    if (id < n->cap) return 1;
+    uint32_t cap = n->cap ? n->cap : 4096;
+    while (cap <= id) cap *= 2;
+    uint64_t *h = (uint64_t*)realloc(n->hash, cap * sizeof(uint64_t));
+    if (h) n->hash = h;
+    uint32_t *st = h ? (uint32_t*)realloc(n->stamp, cap * sizeof(uint32_t)) : NULL;
+    if (!st) return 0;
+    n->stamp = st;
+    memset(n->hash + n->cap, 0, (cap - n->cap) * sizeof(uint64_t));
+    memset(n->stamp + n->cap, 0, (cap - n->cap) * sizeof(uint32_t));
+    n->cap = cap;
+    return 1;
+}
+
+// du_hash of directory id's path, 0 if it is unknown
+static inline uint64_t watch_node_hash(WatchNodes *n, const DirTree *t, uint32_t id) {
+    uint32_t chain[TREE_MAX_DEPTH];
+    int depth = 0;
+    uint64_t h = 0;
+    while (id != TREE_NONE) {
+        if (!watch_nodes_reserve(n, id)) return 0;
+        if (n->hash[id]) { h = n->hash[id]; break; }
+        if (depth == TREE_MAX_DEPTH || !tree_node(t, id)) return 0;
+        chain[depth++] = id;
+        id = tree_node(t, id)->parent;
+    }
+    while (depth-- > 0) {
+        const DirNode *d = tree_node(t, chain[depth]);
+        h = h ? du_hash_child(h, d->name, d->name_len) : du_hash(d->name, d->name_len);
+        n->hash[chain[depth]] = h;
+    }
+    return h;
+}
+
+// Starts a new batch for watch_node_gone
+static inline void watch_nodes_batch(WatchNodes *n) {
+    if (++n->batch >= 0x80000000u) {
+        if (n->stamp) memset(n->stamp, 0, n->cap * sizeof(uint32_t));
+        n->batch = 1;
+    }
+}
+
+// Nonzero if directory id, or a folder above it, is gone in s
+static inline int watch_node_gone(WatchNodes *n, const DirTree *t, WatchSet *s, uint32_t id) {
+    if (id == TREE_NONE || !watch_nodes_reserve(n, id)) return 0;
+    if ((n->stamp[id] >> 1) == n->batch) return n->stamp[id] & 1;
+    const DirNode *d = tree_node(t, id);
+    int gone = watch_set_is_gone(s, watch_node_hash(n, t, id)) || (d && watch_node_gone(n, t, s, d->parent));
+    n->stamp[id] = (n->batch << 1) | (uint32_t)gone;
+    return gone;
+}
+
+// ==========================================
+// HASH MAP
+// ==========================================
+static inline void watch_map_free(WatchMap *m) {
+    free(m->slots);
+    memset(m, 0, sizeof(*m));
+}
+
+static inline int watch_map_grow(WatchMap *m) {
+    uint32_t cap = m->cap ? m->cap * 2 : 4096;
+    WatchMapSlot *slots = (WatchMapSlot*)calloc(cap, sizeof(WatchMapSlot));
+    if (!slots) return 0;
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < m->cap; i++) {
+        const WatchMapSlot *o = &m->slots[i];
+        if (o->hash <= 1) continue;
+        uint32_t k = (uint32_t)o->hash & (cap - 1);
+        while (slots[k].hash) k = (k + 1) & (cap - 1);
+        slots[k] = *o;
+        used++;
+    }
+    free(m->slots);
+    m->slots = slots;
+    m->cap = cap;
+    m->used = used;
+    return 1;
+}
+
+// 0 and 1 mark empty and deleted slots
+static inline uint64_t watch_map_key(uint64_t h) {
+    return h > 1 ? h : h + 2;
+}
+
+static inline int watch_map_put(WatchMap *m, uint64_t h, uint64_t value) {
+    h = watch_map_key(h);
+    if ((m->used + 1) * 2 > m->cap && !watch_map_grow(m)) return 0;
+    uint32_t k = (uint32_t)h & (m->cap - 1);
+    uint32_t dead = UINT32_MAX;
+    while (m->slots[k].hash) {
+        if (m->slots[k].hash == h) { m->slots[k].value = value; return 1; }
+        if (m->slots[k].hash == 1 && dead == UINT32_MAX) dead = k;
+        k = (k + 1) & (m->cap - 1);
+    }
+    if (dead != UINT32_MAX) k = dead;
+    else m->used++;
+    m->slots[k].hash = h;
+    m->slots[k].value = value;
+    return 1;
+}
+
+static inline WatchMapSlot *watch_map_find(const WatchMap *m, uint64_t h) {
+    if (!m->cap) return NULL;
+    h = watch_map_key(h);
+    uint32_t k = (uint32_t)h & (m->cap - 1);
+    while (m->slots[k].hash) {
+        if (m->slots[k].hash == h) return &m->slots[k];
+        k = (k + 1) & (m->cap - 1);
+    }
+    return NULL;
+}
+
+static inline void watch_map_remove(WatchMap *m, uint64_t h) {
+    WatchMapSlot *s = watch_map_find(m, h);
+    if (s) s->hash = 1;
+}
+
+#endif // BLADE_WATCH_H